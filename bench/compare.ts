@@ -0,0 +1,61 @@
+/**
+ * Compare two benchmark results produced by index.ts
+ *
+ * npm run bench:compare -- base.json head.json [--threshold 10]
+ *
+ * With --threshold, exits with an error if the fps of any stage
+ * has dropped or its p99 latency has risen by more than this percentage.
+ */
+import * as fs from 'node:fs';
+import { parseArgs } from 'node:util';
+
+import type { BenchmarkReport, BenchmarkResult } from './index';
+
+const { values: args, positionals } = parseArgs({
+  options: {
+    threshold: { type: 'string' }
+  },
+  allowPositionals: true
+});
+if (positionals.length !== 2) {
+  console.error('Usage: compare.ts <base.json> <head.json> [--threshold <percent>]');
+  process.exit(2);
+}
+
+const base = JSON.parse(fs.readFileSync(positionals[0], 'utf-8')) as BenchmarkReport;
+const head = JSON.parse(fs.readFileSync(positionals[1], 'utf-8')) as BenchmarkReport;
+const threshold = args.threshold !== undefined ? +args.threshold : undefined;
+
+const key = (r: BenchmarkResult) => `${r.input} ${r.stage} ${r.mode}`;
+const change = (from: number, to: number) => from ? (to - from) / from * 100 : 0;
+const percent = (v: number) => `${v >= 0 ? '+' : ''}${v.toFixed(1)}%`;
+
+console.log(`base: ${base.commit ?? 'unknown'} ${base.date}`);
+console.log(`head: ${head.commit ?? 'unknown'} ${head.date}`);
+if (base.cpu !== head.cpu || base.node !== head.node)
+  console.log(`warning: comparing ${base.cpu} / ${base.node} with ${head.cpu} / ${head.node}`);
+
+const baseResults = new Map(base.results.map((r) => [key(r), r]));
+let regressions = 0;
+for (const h of head.results) {
+  const b = baseResults.get(key(h));
+  if (!b) {
+    console.log(`${key(h)}: new`);
+    continue;
+  }
+  const fps = change(b.fps, h.fps);
+  const p99 = change(b.latency.p99, h.latency.p99);
+  const regression = threshold !== undefined && (fps < -threshold || p99 > threshold);
+  if (regression) regressions++;
+  console.log(`${key(h)}: ${h.fps.toFixed(1)} fps (${percent(fps)}), ` +
+    `${h.callsPerFrame.toFixed(2)} calls/frame (was ${b.callsPerFrame.toFixed(2)}), ` +
+    `${h.bytesCopied} bytes copied (was ${b.bytesCopied}), ` +
+    `p50 ${h.latency.p50.toFixed(3)}ms (${percent(change(b.latency.p50, h.latency.p50))}), ` +
+    `p99 ${h.latency.p99.toFixed(3)}ms (${percent(p99)})` +
+    (regression ? ' REGRESSION' : ''));
+}
+
+if (regressions) {
+  console.error(`${regressions} regression(s) above ${threshold}%`);
+  process.exit(1);
+}
@@ -0,0 +1,500 @@
+/**
+ * Throughput and latency benchmarks
+ *
+ * Every stage is measured in its synchronous and asynchronous modes - or with
+ * and without a MediaExecutor for the streams API - over the files in test/data.
+ * The filter stage is also measured through the Filter stream.
+ *
+ * For every stage and mode the results include:
+ *  - fps and MB/s of the input of the stage, for the demuxing stages a frame is a packet
+ *  - the number of calls to the native binding per produced frame
+ *  - the bytes copied by the binding according to ffmpeg.stats()
+ *  - p50/p99/max per-frame latency in milliseconds - the time spent producing
+ *    each frame in the sequential loops and the time from the demuxer to the
+ *    end of the pipeline for the streams API
+ *
+ * Each benchmark is run --repeat times and the fastest run is kept.
+ * The results are written as JSON to --output, use compare.ts to compare two runs.
+ *
+ * npm run bench -- [--stages decode,rescale,filter] [--repeat 3] [--output bench/results.json]
+ */
+import * as path from 'node:path';
+import * as fs from 'node:fs';
+import * as os from 'node:os';
+import { once } from 'node:events';
+import { execSync } from 'node:child_process';
+import { performance } from 'node:perf_hooks';
+import { parseArgs } from 'node:util';
+
+import ffmpeg from '@mmomtchev/ffmpeg';
+import { Readable } from 'node:stream';
+import { Demuxer, VideoDecoder, VideoTransform, Filter, Discarder, VideoStreamDefinition } from '@mmomtchev/ffmpeg/stream';
+
+const { values: args } = parseArgs({
+  options: {
+    data: { type: 'string', default: path.resolve(__dirname, '..', 'test', 'data') },
+    output: { type: 'string', default: path.resolve(__dirname, 'results.json') },
+    stages: { type: 'string' },
+    repeat: { type: 'string', default: '3' }
+  }
+});
+
+export interface LatencyResult {
+  p50: number;
+  p99: number;
+  max: number;
+}
+
+export interface BenchmarkResult {
+  input: string;
+  stage: string;
+  mode: string;
+  frames: number;
+  bytes: number;
+  seconds: number;
+  fps: number;
+  mbps: number;
+  callsPerFrame: number;
+  bytesCopied: number;
+  latency: LatencyResult;
+}
+
+export interface BenchmarkReport {
+  version: 1;
+  commit: string | null;
+  date: string;
+  node: string;
+  platform: string;
+  arch: string;
+  cpu: string;
+  repeat: number;
+  results: BenchmarkResult[];
+}
+
+// The sum of all the bytes copied by the binding
+function bytesCopied(): number {
+  const stats = ffmpeg.stats();
+  return ffmpeg.statsFields.reduce((a, field, i) => field.endsWith('BytesCopied') ? a + stats[i] : a, 0);
+}
+
+// Nearest-rank percentile
+function percentile(sorted: number[], p: number): number {
+  if (!sorted.length) return 0;
+  return sorted[Math.max(0, Math.ceil(p * sorted.length) - 1)];
+}
+
+/**
+ * The measurements of a single run, it starts when it is created
+ */
+class Run {
+  frames = 0;
+  bytes = 0;
+  calls = 0;
+  protected latency: number[] = [];
+  protected start = performance.now();
+  protected last = this.start;
+  protected copied = bytesCopied();
+
+  /**
+   * A frame has been produced, without an explicit latency it is the time since the previous one
+   */
+  frame(bytes: number, latency?: number): void {
+    const now = performance.now();
+    this.latency.push(latency ?? now - this.last);
+    this.last = now;
+    this.frames++;
+    this.bytes += bytes;
+  }
+
+  result(input: string, stage: string, mode: string): BenchmarkResult {
+    const seconds = (performance.now() - this.start) / 1000;
+    const sorted = this.latency.sort((a, b) => a - b);
+    return {
+      input,
+      stage,
+      mode,
+      frames: this.frames,
+      bytes: this.bytes,
+      seconds,
+      fps: this.frames / seconds,
+      mbps: this.bytes / seconds / (1024 * 1024),
+      callsPerFrame: this.frames ? this.calls / this.frames : 0,
+      bytesCopied: bytesCopied() - this.copied,
+      latency: {
+        p50: percentile(sorted, 0.5),
+        p99: percentile(sorted, 0.99),
+        max: sorted.length ? sorted[sorted.length - 1] : 0
+      }
+    };
+  }
+}
+
+async function open(file: string): Promise<[ffmpeg.FormatContext, number]> {
+  const formatContext = new ffmpeg.FormatContext;
+  await formatContext.openInputAsync(file);
+  await formatContext.findStreamInfoAsync();
+  for (let i = 0; i < formatContext.streamsCount(); i++)
+    if (formatContext.stream(i).isVideo()) return [formatContext, i];
+  throw new Error(`${file} has no video stream`);
+}
+
+async function openDecoder(formatContext: ffmpeg.FormatContext, idx: number): Promise<ffmpeg.VideoDecoderContext> {
+  const decoder = new ffmpeg.VideoDecoderContext(formatContext.stream(idx));
+  decoder.setRefCountedFrames(true);
+  await decoder.openCodecAsync(new ffmpeg.Codec);
+  return decoder;
+}
+
+async function readPackets(file: string): Promise<[ffmpeg.FormatContext, number, ffmpeg.Packet[]]> {
+  const [formatContext, idx] = await open(file);
+  const packets: ffmpeg.Packet[] = [];
+  for (let packet = await formatContext.readPacketAsync(); !packet.isNull(); packet = await formatContext.readPacketAsync())
+    if (packet.streamIndex() === idx) packets.push(packet);
+  return [formatContext, idx, packets];
+}
+
+/**
+ * FormatContext.readPacket() from a file
+ */
+async function demux(file: string, mode: string): Promise<Run> {
+  const formatContext = new ffmpeg.FormatContext;
+  if (mode === 'sync') {
+    formatContext.openInput(file);
+    formatContext.findStreamInfo();
+  } else {
+    await formatContext.openInputAsync(file);
+    await formatContext.findStreamInfoAsync();
+  }
+
+  const run = new Run;
+  for (;;) {
+    const packet = mode === 'sync' ? formatContext.readPacket() : await formatContext.readPacketAsync();
+    const info = packet.info();
+    run.calls += 2;
+    if (info.isNull) break;
+    run.frame(info.size);
+  }
+  if (mode === 'sync') formatContext.close();
+  else await formatContext.closeAsync();
+  return run;
+}
+
+/**
+ * FormatContext.readPacket() from a WritableCustomIO, fed by
+ * a pull callback in sync mode and by a ReadStream in async mode
+ */
+async function demuxCustomIO(file: string, mode: string): Promise<Run> {
+  const formatContext = new ffmpeg.FormatContext;
+  const fd = fs.openSync(file, 'r');
+  try {
+    if (mode === 'sync') {
+      const input = new ffmpeg.WritableCustomIO({
+        pull: (size: number) => {
+          const buffer = Buffer.allocUnsafe(size);
+          const len = fs.readSync(fd, buffer);
+          return len > 0 ? buffer.subarray(0, len) : null;
+        }
+      });
+      formatContext.openWritable(input, new ffmpeg.InputFormat, 64 * 1024);
+      formatContext.findStreamInfo();
+    } else {
+      const input = new ffmpeg.WritableCustomIO;
+      fs.createReadStream('', { fd, autoClose: false }).pipe(input);
+      await formatContext.openWritableAsync(input, new ffmpeg.InputFormat, 64 * 1024);
+      await formatContext.findStreamInfoAsync();
+    }
+
+    const run = new Run;
+    for (;;) {
+      const packet = mode === 'sync' ? formatContext.readPacket() : await formatContext.readPacketAsync();
+      const info = packet.info();
+      run.calls += 2;
+      if (info.isNull) break;
+      run.frame(info.size);
+    }
+    if (mode === 'sync') formatContext.close();
+    else await formatContext.closeAsync();
+    return run;
+  } finally {
+    fs.closeSync(fd);
+  }
+}
+
+/**
+ * VideoDecoderContext.decode() of the packets of the first video stream
+ */
+async function decode(file: string, mode: string): Promise<Run> {
+  const [formatContext, idx, packets] = await readPackets(file);
+  const decoder = await openDecoder(formatContext, idx);
+
+  const run = new Run;
+  const bytes = packets.map((p) => p.size());
+  let pending = 0;
+  // An empty packet flushes the decoder
+  for (let i = 0; i <= packets.length; i++) {
+    const packet = i < packets.length ? packets[i] : new ffmpeg.Packet;
+    pending += bytes[i] ?? 0;
+    for (;;) {
+      const frame = mode === 'sync' ? decoder.decode(packet, true) : await decoder.decodeAsync(packet, true);
+      const info = frame.info();
+      run.calls += 2;
+      if (info.isComplete) {
+        run.frame(pending);
+        pending = 0;
+      }
+      if (i < packets.length || !info.isComplete) break;
+    }
+  }
+  await formatContext.closeAsync();
+  return run;
+}
+
+async function decodeFrames(file: string, max: number): Promise<[ffmpeg.VideoFrame[], ffmpeg.Rational]> {
+  const [formatContext, idx, packets] = await readPackets(file);
+  const decoder = await openDecoder(formatContext, idx);
+  const timeBase = formatContext.stream(idx).timeBase();
+  const frames: ffmpeg.VideoFrame[] = [];
+  for (const packet of packets) {
+    const frame = await decoder.decodeAsync(packet, true);
+    if (frame.isComplete()) frames.push(frame);
+    if (frames.length >= max) break;
+  }
+  await formatContext.closeAsync();
+  return [frames, timeBase];
+}
+
+/**
+ * VideoRescaler.rescale() of decoded frames to half size in YUV420P
+ */
+async function rescale(file: string, mode: string): Promise<Run> {
+  const [frames] = await decodeFrames(file, 64);
+
+  const src = frames[0];
+  const rescaler = new ffmpeg.VideoRescaler(
+    Math.round(src.width() / 4) * 2, Math.round(src.height() / 4) * 2, new ffmpeg.PixelFormat(ffmpeg.AV_PIX_FMT_YUV420P),
+    src.width(), src.height(), src.pixelFormat(),
+    ffmpeg.SWS_BILINEAR);
+  const bytes = frames.map((f) => f.size());
+
+  const run = new Run;
+  for (let pass = 0; pass < 4; pass++) {
+    for (let i = 0; i < frames.length; i++) {
+      const frame = mode === 'sync' ? rescaler.rescale(frames[i]) : await rescaler.rescaleAsync(frames[i]);
+      run.calls++;
+      if (frame.isNull()) throw new Error('Rescaling failed');
+      run.frame(bytes[i]);
+    }
+  }
+  return run;
+}
+
+/**
+ * A scale filter to half size of decoded frames, through a BufferSrcFilterContext and
+ * a BufferSinkFilterContext drained with getVideoFrames() in sync and async modes,
+ * and through the Filter stream, the latency of which is the time from the source to the sink
+ */
+async function filter(file: string, mode: string): Promise<Run> {
+  const [frames, timeBase] = await decodeFrames(file, 256);
+  const src = frames[0];
+  const width = Math.round(src.width() / 4) * 2;
+  const height = Math.round(src.height() / 4) * 2;
+  const graph = `[in] scale=${width}x${height} [out];  `;
+  const bytes = frames.map((f) => f.size());
+
+  if (mode === 'streams') {
+    const input: VideoStreamDefinition = {
+      type: 'Video',
+      width: src.width(),
+      height: src.height(),
+      pixelFormat: src.pixelFormat(),
+      timeBase
+    } as VideoStreamDefinition;
+    const stream = new Filter({
+      inputs: { 'in': input },
+      outputs: { 'out': { ...input, width, height } as VideoStreamDefinition },
+      graph,
+      timeBase
+    });
+
+    const run = new Run;
+    // Entry time of the frames by pts
+    const entries = new Map<number, number>;
+    let pending = 0;
+    const source = Readable.from((function* () {
+      for (let i = 0; i < frames.length; i++) {
+        const pts = frames[i].info().pts;
+        if (pts !== null) entries.set(pts, performance.now());
+        pending += bytes[i];
+        yield frames[i];
+      }
+    })());
+    stream.sink['out'].on('data', (frame: ffmpeg.VideoFrame) => {
+      const pts = frame.info().pts;
+      let latency: number | undefined;
+      if (pts !== null && entries.has(pts)) {
+        latency = performance.now() - entries.get(pts)!;
+        entries.delete(pts);
+      }
+      run.frame(pending, latency);
+      pending = 0;
+    });
+    const discard = new Discarder;
+    source.pipe(stream.src['in']);
+    stream.sink['out'].pipe(discard);
+    await once(discard, 'finish');
+    run.calls = stream.stats.calls;
+    return run;
+  }
+
+  const filterGraph = new ffmpeg.FilterGraph;
+  filterGraph.parse(`buffer@in=video_size=${src.width()}x${src.height()}:` +
+    `pix_fmt=${src.pixelFormat().toString()}:time_base=${timeBase.toString()} [in];  ` +
+    graph + '[out] buffersink@out;  ');
+  filterGraph.config();
+  const bufferSrc = new ffmpeg.BufferSrcFilterContext(filterGraph.filter('buffer@in'));
+  const bufferSink = new ffmpeg.BufferSinkFilterContext(filterGraph.filter('buffersink@out'));
+
+  const run = new Run;
+  let pending = 0;
+  // A null frame flushes the graph
+  for (let i = 0; i <= frames.length; i++) {
+    const frame = i < frames.length ? frames[i] : ffmpeg.VideoFrame.null();
+    pending += bytes[i] ?? 0;
+    if (mode === 'sync') bufferSrc.writeVideoFrame(frame);
+    else await bufferSrc.writeVideoFrameAsync(frame);
+    // All the frames available are drained in a single call
+    const { frames: filtered, error } = mode === 'sync' ?
+      bufferSink.getVideoFrames(0) : await bufferSink.getVideoFramesAsync(0);
+    run.calls += 2;
+    for (let j = 0; j < filtered.length; j++) {
+      run.frame(pending);
+      pending = 0;
+    }
+    if (error) throw error;
+  }
+  return run;
+}
+
+/**
+ * Demuxer -> VideoDecoder -> VideoTransform on the libuv thread pool or on a MediaExecutor,
+ * the latency is the time from the demuxer to the end of the pipeline
+ */
+async function pipeline(file: string, mode: string): Promise<Run> {
+  const executor = mode === 'executor' ? new ffmpeg.MediaExecutor({ threads: 2 }) : undefined;
+  const input = new Demuxer({ inputFile: file });
+  await once(input, 'ready');
+
+  const decoder = new VideoDecoder({ stream: input.video[0].stream, executor, pipeline: 1 });
+  const inputDefinition = decoder.definition();
+  const outputDefinition = {
+    ...inputDefinition,
+    width: Math.round(inputDefinition.width / 4) * 2,
+    height: Math.round(inputDefinition.height / 4) * 2,
+    pixelFormat: new ffmpeg.PixelFormat(ffmpeg.AV_PIX_FMT_YUV420P)
+  } as VideoStreamDefinition;
+  const transform = new VideoTransform({
+    input: inputDefinition,
+    output: outputDefinition,
+    interpolation: ffmpeg.SWS_BILINEAR,
+    executor,
+    pipeline: 1
+  });
+
+  const run = new Run;
+  // Entry time of the packets by timestamp in milliseconds
+  const entries = new Map<number, number>;
+  let pending = 0;
+  input.video[0].on('data', (packet: ffmpeg.Packet) => {
+    const info = packet.info();
+    pending += info.size;
+    if (info.seconds !== null) entries.set(Math.round(info.seconds * 1000), performance.now());
+  });
+  transform.on('data', (frame: ffmpeg.VideoFrame) => {
+    const info = frame.info();
+    let latency: number | undefined;
+    if (info.seconds !== null) {
+      const key = Math.round(info.seconds * 1000);
+      // Rescaling between time bases can round to the next millisecond
+      const k = [key, key - 1, key + 1].find((k) => entries.has(k));
+      if (k !== undefined) {
+        latency = performance.now() - entries.get(k)!;
+        entries.delete(k);
+      }
+    }
+    run.frame(pending, latency);
+    pending = 0;
+  });
+
+  const videoDiscard = new Discarder;
+  input.video[0].pipe(decoder).pipe(transform).pipe(videoDiscard);
+  // The Demuxer pauses when any stream is full
+  for (const audio of input.audio) audio.pipe(new Discarder);
+  await once(videoDiscard, 'finish');
+
+  run.calls = input.stats.calls + decoder.stats.calls + transform.stats.calls;
+  await executor?.close();
+  return run;
+}
+
+const benchmarks: Record<string, { modes: string[], run: (file: string, mode: string) => Promise<Run> }> = {
+  'demux': { modes: ['sync', 'async'], run: demux },
+  'demux-customio': { modes: ['sync', 'async'], run: demuxCustomIO },
+  'decode': { modes: ['sync', 'async'], run: decode },
+  'rescale': { modes: ['sync', 'async'], run: rescale },
+  'filter': { modes: ['sync', 'async', 'streams'], run: filter },
+  'pipeline': { modes: ['async', 'executor'], run: pipeline }
+};
+
+async function main() {
+  ffmpeg.setLogLevel(process.env.DEBUG_FFMPEG ? ffmpeg.AV_LOG_DEBUG : ffmpeg.AV_LOG_WARNING);
+
+  const repeat = Math.max(1, +args.repeat!);
+  const stages = args.stages ? args.stages.split(',') : Object.keys(benchmarks);
+  for (const stage of stages)
+    if (!benchmarks[stage]) throw new Error(`Unknown stage ${stage}, available: ${Object.keys(benchmarks).join(', ')}`);
+  const files = fs.readdirSync(args.data!).filter((f) => /\.(mp4|mkv|webm|mov|ts)$/.test(f)).sort();
+
+  let commit: string | null = null;
+  try {
+    commit = execSync('git rev-parse HEAD', { cwd: __dirname, stdio: ['ignore', 'pipe', 'ignore'] }).toString().trim();
+  } catch {
+    // Not a git checkout
+  }
+
+  const report: BenchmarkReport = {
+    version: 1,
+    commit,
+    date: new Date().toISOString(),
+    node: process.version,
+    platform: os.platform(),
+    arch: os.arch(),
+    cpu: os.cpus()[0]?.model ?? 'unknown',
+    repeat,
+    results: []
+  };
+
+  for (const file of files) {
+    for (const stage of stages) {
+      for (const mode of benchmarks[stage].modes) {
+        let best: BenchmarkResult | undefined;
+        for (let i = 0; i < repeat; i++) {
+          const run = await benchmarks[stage].run(path.resolve(args.data!, file), mode);
+          const result = run.result(file, stage, mode);
+          if (!best || result.seconds < best.seconds) best = result;
+        }
+        report.results.push(best!);
+        console.log(`${file} ${stage} ${mode}: ${best!.fps.toFixed(1)} fps, ${best!.mbps.toFixed(2)} MB/s, ` +
+          `${best!.callsPerFrame.toFixed(2)} calls/frame, ${best!.bytesCopied} bytes copied, ` +
+          `latency p50 ${best!.latency.p50.toFixed(3)}ms p99 ${best!.latency.p99.toFixed(3)}ms`);
+      }
+    }
+  }
+
+  fs.writeFileSync(args.output!, JSON.stringify(report, null, 2));
+  console.log(`Results written to ${args.output}`);
+}
+
+main().catch((err) => {
+  console.error(err);
+  process.exit(1);
+});
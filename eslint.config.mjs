@@ -44,9 +44,9 @@ export default [...compat.extends("eslint:recommended"), {
     "plugin:@typescript-eslint/recommended",
 ).map(config => ({
     ...config,
-    files: ["test/*.ts", "src/lib/*.ts"],
+    files: ["test/*.ts", "src/lib/*.ts", "bench/*.ts"],
 })), {
-    files: ["test/*.ts", "src/lib/*.ts"],
+    files: ["test/*.ts", "src/lib/*.ts", "bench/*.ts"],
 
     plugins: {
         "@typescript-eslint": typescriptEslint,
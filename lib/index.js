@@ -20,5 +20,64 @@ ffmpeg.BufferSinkFilterContext.prototype.getAudioFrameAsync = function () {
 ffmpeg.BufferSinkFilterContext.prototype.getVideoFrameAsync = function () {
   return ffmpeg._getVideoFrameAsync(this, ...arguments);
 };
+ffmpeg.BufferSinkFilterContext.prototype.getAudioFramesAsync = function () {
+  return ffmpeg._getAudioFramesAsync(this, ...arguments);
+};
+ffmpeg.BufferSinkFilterContext.prototype.getVideoFramesAsync = function () {
+  return ffmpeg._getVideoFramesAsync(this, ...arguments);
+};
+
+ffmpeg.FilterGraph.prototype.sendCommandAsync = function () {
+  return ffmpeg._sendCommandAsync(this, ...arguments);
+};
+
+ffmpeg.Packet.wrap = ffmpeg._wrapPacket;
+
+ffmpeg.VideoEncoderContext.prototype.encodeBatchAsync = function () {
+  return ffmpeg._encodeVideoBatchAsync(this, ...arguments);
+};
+ffmpeg.VideoEncoderContext.prototype.finalizeBatchAsync = function () {
+  return ffmpeg._finalizeVideoBatchAsync(this, ...arguments);
+};
+ffmpeg.AudioEncoderContext.prototype.encodeBatchAsync = function () {
+  return ffmpeg._encodeAudioBatchAsync(this, ...arguments);
+};
+ffmpeg.AudioEncoderContext.prototype.finalizeBatchAsync = function () {
+  return ffmpeg._finalizeAudioBatchAsync(this, ...arguments);
+};
+
+ffmpeg.VideoRescaler.prototype.rescaleIntoAsync = function () {
+  return ffmpeg._rescaleIntoAsync(this, ...arguments);
+};
+
+ffmpeg.FormatContext.prototype.seekAsync = function () {
+  return ffmpeg._seekAsync(this, ...arguments);
+};
+ffmpeg.FormatContext.prototype.readFrameAsync = function () {
+  return ffmpeg._readFrameAsync(this, ...arguments);
+};
+
+ffmpeg.VideoFrame.prototype.encodeImageAsync = function (format, options) {
+  return ffmpeg._encodeImageAsync(this, format, options?.width ?? 0, options?.height ?? 0, options?.quality ?? 0);
+};
+
+ffmpeg.VideoFrame.prototype.histogramAsync = function () {
+  return ffmpeg._histogramAsync(this, ...arguments);
+};
+ffmpeg.VideoFrame.prototype.planeStatsAsync = function () {
+  return ffmpeg._planeStatsAsync(this, ...arguments);
+};
+ffmpeg.VideoFrame.prototype.psnrAsync = function () {
+  return ffmpeg._psnrAsync(this, ...arguments);
+};
+ffmpeg.VideoFrame.prototype.ssimAsync = function () {
+  return ffmpeg._ssimAsync(this, ...arguments);
+};
+ffmpeg.VideoFrame.prototype.differenceAsync = function () {
+  return ffmpeg._differenceAsync(this, ...arguments);
+};
+ffmpeg.AudioSamples.prototype.levelsAsync = function () {
+  return ffmpeg._levelsAsync(this, ...arguments);
+};
 
 module.exports = ffmpeg;
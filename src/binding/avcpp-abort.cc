@@ -0,0 +1,15 @@
+#include "avcpp-abort.h"
+
+AbortToken::AbortToken() : flag{std::make_shared<std::atomic<bool>>(false)} {}
+
+void AbortToken::abort() { flag->store(true, std::memory_order_relaxed); }
+
+bool AbortToken::aborted() const { return flag->load(std::memory_order_relaxed); }
+
+std::shared_ptr<std::atomic<bool>> AbortToken::state() const { return flag; }
+
+void SetAbortToken(FormatContext &ctx, AbortToken &token) {
+  // The interrupt callback holds its own reference to the flag,
+  // the JS token can be collected before the context
+  ctx.setInterruptCallback([flag = token.state()]() -> int { return flag->load(std::memory_order_relaxed) ? 1 : 0; });
+}
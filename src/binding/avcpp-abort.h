@@ -0,0 +1,32 @@
+#pragma once
+#include <atomic>
+#include <formatcontext.h>
+#include <memory>
+
+using namespace av;
+
+// An abort flag that interrupts the blocking I/O of the FormatContexts it is attached to
+//
+// ffmpeg polls the interrupt callback of a FormatContext from the thread running
+// the operation - the built-in protocols check it at least every 100ms while they
+// are waiting for the network. Once the token has been aborted, every pending and
+// future operation fails with AVERROR_EXIT and the worker thread is released.
+// The CustomIO streams are not polled, they have their own abort().
+// A token can be shared by several contexts and it cannot be reset.
+class AbortToken {
+  std::shared_ptr<std::atomic<bool>> flag;
+
+public:
+  AbortToken();
+
+  // Can be called from any thread
+  void abort();
+  bool aborted() const;
+
+  // The state shared with the interrupt callbacks
+  std::shared_ptr<std::atomic<bool>> state() const;
+};
+
+// Installs the token as the interrupt callback of the context, it stays
+// attached for the lifetime of the context
+void SetAbortToken(FormatContext &ctx, AbortToken &token);
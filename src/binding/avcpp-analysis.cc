@@ -0,0 +1,366 @@
+#include "avcpp-analysis.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <stdexcept>
+
+extern "C" {
+#include <libavutil/pixdesc.h>
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define ANALYSIS_X86
+#include <immintrin.h>
+#endif
+#if defined(ANALYSIS_X86) && (defined(__GNUC__) || defined(__clang__))
+// AVX2 is compiled with a target attribute and selected at runtime
+#define ANALYSIS_AVX2
+#endif
+
+// The row kernels, each one has a scalar version,
+// an SSE2 version (always present on x86-64) and an AVX2 version
+struct RowKernels {
+  // Sum and sum of squares
+  void (*sum)(const uint8_t *p, int n, uint64_t &sum, uint64_t &sq);
+  // Sum of absolute differences
+  uint64_t (*sad)(const uint8_t *a, const uint8_t *b, int n);
+  // Sum of squared differences
+  uint64_t (*sse)(const uint8_t *a, const uint8_t *b, int n);
+};
+
+static void SumScalar(const uint8_t *p, int n, uint64_t &sum, uint64_t &sq) {
+  uint64_t s = 0, q = 0;
+  for (int i = 0; i < n; i++) {
+    s += p[i];
+    q += p[i] * p[i];
+  }
+  sum += s;
+  sq += q;
+}
+
+static uint64_t SADScalar(const uint8_t *a, const uint8_t *b, int n) {
+  uint64_t r = 0;
+  for (int i = 0; i < n; i++)
+    r += std::abs(a[i] - b[i]);
+  return r;
+}
+
+static uint64_t SSEScalar(const uint8_t *a, const uint8_t *b, int n) {
+  uint64_t r = 0;
+  for (int i = 0; i < n; i++) {
+    int d = a[i] - b[i];
+    r += d * d;
+  }
+  return r;
+}
+
+#ifdef ANALYSIS_X86
+// The 32-bit accumulators of the squares are flushed every 16K pixels,
+// each lane receives at most 2 * 255^2 per 8 pixels
+constexpr int flush_interval = 16384;
+
+static inline uint64_t HSum64(__m128i v) {
+  return static_cast<uint64_t>(_mm_cvtsi128_si64(v)) + static_cast<uint64_t>(_mm_cvtsi128_si64(_mm_unpackhi_epi64(v, v)));
+}
+
+static inline uint64_t HSum32(__m128i v) {
+  __m128i zero = _mm_setzero_si128();
+  return HSum64(_mm_add_epi64(_mm_unpacklo_epi32(v, zero), _mm_unpackhi_epi32(v, zero)));
+}
+
+static void SumSSE2(const uint8_t *p, int n, uint64_t &sum, uint64_t &sq) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i s = zero;
+  int i = 0;
+  while (i + 16 <= n) {
+    __m128i q = zero;
+    int end = std::min(n - 15, i + flush_interval);
+    for (; i < end; i += 16) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+      s = _mm_add_epi64(s, _mm_sad_epu8(v, zero));
+      __m128i lo = _mm_unpacklo_epi8(v, zero);
+      __m128i hi = _mm_unpackhi_epi8(v, zero);
+      q = _mm_add_epi32(q, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+    }
+    sq += HSum32(q);
+  }
+  sum += HSum64(s);
+  SumScalar(p + i, n - i, sum, sq);
+}
+
+static uint64_t SADSSE2(const uint8_t *a, const uint8_t *b, int n) {
+  __m128i s = _mm_setzero_si128();
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+    __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+    s = _mm_add_epi64(s, _mm_sad_epu8(va, vb));
+  }
+  return HSum64(s) + SADScalar(a + i, b + i, n - i);
+}
+
+static uint64_t SSESSE2(const uint8_t *a, const uint8_t *b, int n) {
+  const __m128i zero = _mm_setzero_si128();
+  uint64_t r = 0;
+  int i = 0;
+  while (i + 16 <= n) {
+    __m128i q = zero;
+    int end = std::min(n - 15, i + flush_interval);
+    for (; i < end; i += 16) {
+      __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+      __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+      __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero));
+      __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero));
+      q = _mm_add_epi32(q, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+    }
+    r += HSum32(q);
+  }
+  return r + SSEScalar(a + i, b + i, n - i);
+}
+#endif
+
+#ifdef ANALYSIS_AVX2
+__attribute__((target("avx2"))) static inline __m128i Fold256(__m256i v) {
+  return _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+}
+
+__attribute__((target("avx2"))) static inline __m128i Fold256_32(__m256i v) {
+  return _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+}
+
+__attribute__((target("avx2"))) static void SumAVX2(const uint8_t *p, int n, uint64_t &sum, uint64_t &sq) {
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i s = zero;
+  int i = 0;
+  while (i + 32 <= n) {
+    __m256i q = zero;
+    int end = std::min(n - 31, i + flush_interval);
+    for (; i < end; i += 32) {
+      __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+      s = _mm256_add_epi64(s, _mm256_sad_epu8(v, zero));
+      __m256i lo = _mm256_unpacklo_epi8(v, zero);
+      __m256i hi = _mm256_unpackhi_epi8(v, zero);
+      q = _mm256_add_epi32(q, _mm256_add_epi32(_mm256_madd_epi16(lo, lo), _mm256_madd_epi16(hi, hi)));
+    }
+    sq += HSum32(Fold256_32(q));
+  }
+  sum += HSum64(Fold256(s));
+  SumSSE2(p + i, n - i, sum, sq);
+}
+
+__attribute__((target("avx2"))) static uint64_t SADAVX2(const uint8_t *a, const uint8_t *b, int n) {
+  __m256i s = _mm256_setzero_si256();
+  int i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+    __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+    s = _mm256_add_epi64(s, _mm256_sad_epu8(va, vb));
+  }
+  return HSum64(Fold256(s)) + SADSSE2(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2"))) static uint64_t SSEAVX2(const uint8_t *a, const uint8_t *b, int n) {
+  const __m256i zero = _mm256_setzero_si256();
+  uint64_t r = 0;
+  int i = 0;
+  while (i + 32 <= n) {
+    __m256i q = zero;
+    int end = std::min(n - 31, i + flush_interval);
+    for (; i < end; i += 32) {
+      __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+      __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+      __m256i lo = _mm256_sub_epi16(_mm256_unpacklo_epi8(va, zero), _mm256_unpacklo_epi8(vb, zero));
+      __m256i hi = _mm256_sub_epi16(_mm256_unpackhi_epi8(va, zero), _mm256_unpackhi_epi8(vb, zero));
+      q = _mm256_add_epi32(q, _mm256_add_epi32(_mm256_madd_epi16(lo, lo), _mm256_madd_epi16(hi, hi)));
+    }
+    r += HSum32(Fold256_32(q));
+  }
+  return r + SSESSE2(a + i, b + i, n - i);
+}
+#endif
+
+static const RowKernels &Kernels() {
+  static const RowKernels kernels = []() -> RowKernels {
+#ifdef ANALYSIS_AVX2
+    if (__builtin_cpu_supports("avx2"))
+      return {SumAVX2, SADAVX2, SSEAVX2};
+#endif
+#ifdef ANALYSIS_X86
+    return {SumSSE2, SADSSE2, SSESSE2};
+#else
+    return {SumScalar, SADScalar, SSEScalar};
+#endif
+  }();
+  return kernels;
+}
+
+struct Plane {
+  const uint8_t *data;
+  int linesize;
+  int width;
+  int height;
+};
+
+static std::vector<Plane> Planes(VideoFrame &frame) {
+  const AVFrame *raw = frame.raw();
+  if (raw == nullptr || raw->data[0] == nullptr)
+    throw std::invalid_argument{"Empty frame"};
+  const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(raw->format));
+  if (desc == nullptr || (desc->flags & AV_PIX_FMT_FLAG_PAL) ||
+      (desc->nb_components > 1 && !(desc->flags & AV_PIX_FMT_FLAG_PLANAR)))
+    throw std::invalid_argument{"Only the 8-bit planar pixel formats are supported"};
+  // The semi-planar formats such as NV12 have the planar flag but interleave the chroma
+  for (int i = 0; i < desc->nb_components; i++)
+    if (desc->comp[i].depth != 8 || desc->comp[i].step != 1)
+      throw std::invalid_argument{"Only the 8-bit planar pixel formats are supported"};
+
+  std::vector<Plane> planes;
+  int count = av_pix_fmt_count_planes(static_cast<AVPixelFormat>(raw->format));
+  for (int i = 0; i < count; i++) {
+    bool chroma = i == 1 || i == 2;
+    planes.push_back({raw->data[i], raw->linesize[i],
+                      chroma ? AV_CEIL_RSHIFT(raw->width, desc->log2_chroma_w) : raw->width,
+                      chroma ? AV_CEIL_RSHIFT(raw->height, desc->log2_chroma_h) : raw->height});
+  }
+  return planes;
+}
+
+static void CheckSameLayout(VideoFrame &a, VideoFrame &b) {
+  const AVFrame *ra = a.raw(), *rb = b.raw();
+  if (ra == nullptr || rb == nullptr || ra->width != rb->width || ra->height != rb->height ||
+      ra->format != rb->format)
+    throw std::invalid_argument{"The frames must have the same size and pixel format"};
+}
+
+TypedVector<uint32_t> FrameHistogram(VideoFrame &frame, int plane) {
+  auto planes = Planes(frame);
+  if (plane < 0 || static_cast<size_t>(plane) >= planes.size())
+    throw std::out_of_range{"Invalid plane " + std::to_string(plane)};
+  const Plane &p = planes[plane];
+
+  // Four interleaved sub-histograms avoid the store-to-load stalls
+  // when consecutive pixels have the same value
+  std::vector<uint32_t> bins(4 * 256, 0);
+  for (int y = 0; y < p.height; y++) {
+    const uint8_t *row = p.data + static_cast<ptrdiff_t>(y) * p.linesize;
+    int x = 0;
+    for (; x + 4 <= p.width; x += 4) {
+      bins[row[x]]++;
+      bins[256 + row[x + 1]]++;
+      bins[512 + row[x + 2]]++;
+      bins[768 + row[x + 3]]++;
+    }
+    for (; x < p.width; x++)
+      bins[row[x]]++;
+  }
+
+  TypedVector<uint32_t> r(256);
+  for (int i = 0; i < 256; i++)
+    r[i] = bins[i] + bins[256 + i] + bins[512 + i] + bins[768 + i];
+  return r;
+}
+
+TypedVector<double> FramePlaneStats(VideoFrame &frame) {
+  const RowKernels &k = Kernels();
+  TypedVector<double> r;
+  for (const Plane &p : Planes(frame)) {
+    uint64_t sum = 0, sq = 0;
+    for (int y = 0; y < p.height; y++)
+      k.sum(p.data + static_cast<ptrdiff_t>(y) * p.linesize, p.width, sum, sq);
+    double n = static_cast<double>(p.width) * p.height;
+    double mean = sum / n;
+    r.push_back(mean);
+    r.push_back(sq / n - mean * mean);
+  }
+  return r;
+}
+
+static double PSNR(uint64_t sse, double n) {
+  if (sse == 0)
+    return std::numeric_limits<double>::infinity();
+  return 10 * std::log10(255.0 * 255.0 * n / static_cast<double>(sse));
+}
+
+TypedVector<double> FramePSNR(VideoFrame &frame, VideoFrame &reference) {
+  CheckSameLayout(frame, reference);
+  const RowKernels &k = Kernels();
+  auto a = Planes(frame), b = Planes(reference);
+  TypedVector<double> r;
+  uint64_t total = 0;
+  double pixels = 0;
+  for (size_t i = 0; i < a.size(); i++) {
+    uint64_t sse = 0;
+    for (int y = 0; y < a[i].height; y++)
+      sse += k.sse(a[i].data + static_cast<ptrdiff_t>(y) * a[i].linesize,
+                   b[i].data + static_cast<ptrdiff_t>(y) * b[i].linesize, a[i].width);
+    double n = static_cast<double>(a[i].width) * a[i].height;
+    r.push_back(PSNR(sse, n));
+    total += sse;
+    pixels += n;
+  }
+  r.push_back(PSNR(total, pixels));
+  return r;
+}
+
+// SSIM of one 8x8 window, the sums are over the window
+static double SSIMWindow(const uint8_t *a, int la, const uint8_t *b, int lb) {
+  constexpr double c1 = (0.01 * 255) * (0.01 * 255);
+  constexpr double c2 = (0.03 * 255) * (0.03 * 255);
+  constexpr double n = 64;
+  uint32_t sa = 0, sb = 0, saa = 0, sbb = 0, sab = 0;
+  for (int y = 0; y < 8; y++, a += la, b += lb) {
+    for (int x = 0; x < 8; x++) {
+      sa += a[x];
+      sb += b[x];
+      saa += a[x] * a[x];
+      sbb += b[x] * b[x];
+      sab += a[x] * b[x];
+    }
+  }
+  double ma = sa / n, mb = sb / n;
+  double va = saa / n - ma * ma, vb = sbb / n - mb * mb, cov = sab / n - ma * mb;
+  return ((2 * ma * mb + c1) * (2 * cov + c2)) / ((ma * ma + mb * mb + c1) * (va + vb + c2));
+}
+
+TypedVector<double> FrameSSIM(VideoFrame &frame, VideoFrame &reference) {
+  CheckSameLayout(frame, reference);
+  auto a = Planes(frame), b = Planes(reference);
+  TypedVector<double> r;
+  double total = 0, windows = 0;
+  for (size_t i = 0; i < a.size(); i++) {
+    double sum = 0;
+    int count = 0;
+    for (int y = 0; y + 8 <= a[i].height; y += 8) {
+      for (int x = 0; x + 8 <= a[i].width; x += 8) {
+        sum += SSIMWindow(a[i].data + static_cast<ptrdiff_t>(y) * a[i].linesize + x, a[i].linesize,
+                          b[i].data + static_cast<ptrdiff_t>(y) * b[i].linesize + x, b[i].linesize);
+        count++;
+      }
+    }
+    r.push_back(count > 0 ? sum / count : 1);
+    total += sum;
+    windows += count;
+  }
+  r.push_back(windows > 0 ? total / windows : 1);
+  return r;
+}
+
+double FrameDifference(VideoFrame &frame, VideoFrame &previous) {
+  CheckSameLayout(frame, previous);
+  const RowKernels &k = Kernels();
+  const Plane a = Planes(frame)[0], b = Planes(previous)[0];
+  uint64_t sad = 0;
+  for (int y = 0; y < a.height; y++)
+    sad += k.sad(a.data + static_cast<ptrdiff_t>(y) * a.linesize, b.data + static_cast<ptrdiff_t>(y) * b.linesize,
+                 a.width);
+  return static_cast<double>(sad) / (255.0 * a.width * a.height);
+}
+
+const char *AnalysisTypeScriptFragment = R"(
+  histogramAsync(plane: number): Promise<Uint32Array>;
+  planeStatsAsync(): Promise<Float64Array>;
+  psnrAsync(reference: VideoFrame): Promise<Float64Array>;
+  ssimAsync(reference: VideoFrame): Promise<Float64Array>;
+  differenceAsync(previous: VideoFrame): Promise<number>;
+)";
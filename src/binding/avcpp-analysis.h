@@ -0,0 +1,60 @@
+#pragma once
+#include <frame.h>
+#include <string>
+#include <vector>
+
+#include <nobind.h>
+
+using namespace av;
+
+// Analysis kernels for quality control, they work on the 8-bit planar formats
+// (yuv420p, yuvj444p, gray...) and use SSE2/AVX2 when available
+//
+// The results are returned as typed arrays without any intermediate JS objects
+template <typename T> class TypedVector : public std::vector<T> {
+public:
+  using std::vector<T>::vector;
+};
+
+// 256 bins of the values of a plane
+TypedVector<uint32_t> FrameHistogram(VideoFrame &frame, int plane);
+// [ mean, variance ] for each plane
+TypedVector<double> FramePlaneStats(VideoFrame &frame);
+// [ PSNR of each plane, PSNR of the whole frame ] in dB, Infinity for identical frames
+TypedVector<double> FramePSNR(VideoFrame &frame, VideoFrame &reference);
+// [ SSIM of each plane, SSIM of the whole frame ] over 8x8 windows
+TypedVector<double> FrameSSIM(VideoFrame &frame, VideoFrame &reference);
+// Mean absolute difference of the luma from 0 (identical) to 1, used for freeze and scene change detection
+double FrameDifference(VideoFrame &frame, VideoFrame &previous);
+
+// The declarations of the async versions which are patched on VideoFrame in JS
+extern const char *AnalysisTypeScriptFragment;
+
+namespace Nobind {
+namespace Typemap {
+
+template <typename T> struct TypedArrayName;
+template <> struct TypedArrayName<double> {
+  static constexpr const char *name = "Float64Array";
+};
+template <> struct TypedArrayName<uint32_t> {
+  static constexpr const char *name = "Uint32Array";
+};
+
+template <typename T, const ReturnAttribute &RETATTR> class ToJS<TypedVector<T>, RETATTR> {
+  Napi::Env env_;
+  TypedVector<T> val_;
+
+public:
+  inline explicit ToJS(Napi::Env env, TypedVector<T> val) : env_(env), val_(std::move(val)) {}
+  inline Napi::Value Get() {
+    auto r = Napi::TypedArrayOf<T>::New(env_, val_.size());
+    std::copy(val_.begin(), val_.end(), r.Data());
+    return r;
+  }
+
+  static const std::string TSType() { return TypedArrayName<T>::name; };
+};
+
+} // namespace Typemap
+} // namespace Nobind
@@ -0,0 +1,96 @@
+#pragma once
+#include <codeccontext.h>
+#include <packet.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace av;
+
+// Resets the internal state of an opened codec context so that it can be reused
+// for a new stream without being closed and reopened - opening an encoder such
+// as x264 spawns threads and allocates the lookahead buffers.
+//
+// Decoders can always be flushed, encoders only if they have AV_CODEC_CAP_ENCODER_FLUSH,
+// returns false if the codec context cannot be reused.
+// An encoder must be drained with finalize() before calling this.
+template <typename T> bool FlushCodecContext(T &ctx) {
+  AVCodecContext *raw = ctx.raw();
+  if (raw == nullptr || !avcodec_is_open(raw))
+    return false;
+  if (av_codec_is_encoder(raw->codec) && !(raw->codec->capabilities & AV_CODEC_CAP_ENCODER_FLUSH))
+    return false;
+  avcodec_flush_buffers(raw);
+  return true;
+}
+
+// An encoding error with the ffmpeg error message
+inline std::runtime_error EncoderError(const char *what, int r) {
+  char msg[AV_ERROR_MAX_STRING_SIZE];
+  av_strerror(r, msg, sizeof(msg));
+  return std::runtime_error{std::string{what} + ": " + msg};
+}
+
+// Receives all the packets that the encoder has ready
+inline void ReceivePackets(AVCodecContext *raw, std::vector<Packet> &packets) {
+  AVPacket *pkt = av_packet_alloc();
+  if (pkt == nullptr)
+    throw std::bad_alloc{};
+  for (;;) {
+    int r = avcodec_receive_packet(raw, pkt);
+    if (r == AVERROR(EAGAIN) || r == AVERROR_EOF)
+      break;
+    if (r < 0) {
+      av_packet_free(&pkt);
+      throw EncoderError("Failed receiving a packet from the encoder", r);
+    }
+    // This adds a new reference
+    Packet packet{pkt};
+    packet.setTimeBase(raw->time_base);
+    packet.setComplete(true);
+    packets.push_back(std::move(packet));
+    av_packet_unref(pkt);
+  }
+  av_packet_free(&pkt);
+}
+
+// Sends a batch of frames to an encoder and returns all the packets produced,
+// an encoder with a lookahead produces them in bursts and the batch can be
+// of any size - including empty. This replaces one encode() per frame
+// with a single call.
+template <typename T, typename F> std::vector<Packet> EncodeBatch(T &ctx, std::vector<F> frames) {
+  AVCodecContext *raw = ctx.raw();
+  if (raw == nullptr || !avcodec_is_open(raw))
+    throw std::logic_error{"Encoder is not open"};
+  std::vector<Packet> packets;
+  for (auto &frame : frames) {
+    // The frame references are already copies, the timestamps are rescaled in place
+    frame.setTimeBase(Rational{raw->time_base});
+    for (;;) {
+      int r = avcodec_send_frame(raw, frame.raw());
+      if (r == AVERROR(EAGAIN)) {
+        ReceivePackets(raw, packets);
+        continue;
+      }
+      if (r < 0)
+        throw EncoderError("Failed sending a frame to the encoder", r);
+      break;
+    }
+    ReceivePackets(raw, packets);
+  }
+  return packets;
+}
+
+// Drains an encoder in a single call, the equivalent of calling finalize()
+// until it returns an empty packet
+template <typename T> std::vector<Packet> FinalizeBatch(T &ctx) {
+  AVCodecContext *raw = ctx.raw();
+  if (raw == nullptr || !avcodec_is_open(raw))
+    throw std::logic_error{"Encoder is not open"};
+  std::vector<Packet> packets;
+  int r = avcodec_send_frame(raw, nullptr);
+  if (r < 0 && r != AVERROR_EOF)
+    throw EncoderError("Failed draining the encoder", r);
+  ReceivePackets(raw, packets);
+  return packets;
+}
@@ -1,13 +1,23 @@
 #pragma once
+#include "avcpp-stats.h"
 #include "instance-data.h"
 #include <condition_variable>
 #include <formatcontext.h>
+#include <atomic>
 #include <mutex>
 #include <nobind.h>
 #include <queue>
 #include <thread>
 #include <uv.h>
 
+// The per-instance counters returned by CustomIO.stats()
+// [ calls from ffmpeg, bytes copied, time blocked waiting for JS in ns, bytes queued ]
+struct CustomIOStats {
+  std::atomic<uint64_t> calls{0};
+  std::atomic<uint64_t> bytes{0};
+  std::atomic<uint64_t> wait_time{0};
+};
+
 // These are the BufferItems that are passed to the background threads
 // The second structure must be freed in the main thread!
 struct BufferReadableItem {
@@ -38,14 +48,38 @@ struct BufferWritableItem {
 // this is compatible only with async mode. The C++ read may be called only from a background
 // thread in which case it will block until the main JS thread has delivered more data.
 //
+// Alternatively, both classes support a synchronous mode for consumers that never
+// go through the libuv thread pool - typically a worker thread running a fully
+// synchronous pipeline. In this mode the sync methods run in-line in the JS thread:
+// the WritableCustomIO reads from a pull callback or from a pre-filled queue and
+// the ReadableCustomIO delivers its data to a sink callback or keeps it for drain().
+// The async methods cannot be used with a synchronous CustomIO.
+//
 // This uses my technique for extending JS classes in C++ by using node-addon-api:
 // https://mmomtchev.medium.com/c-class-inheritance-with-node-api-and-node-addon-api-c180334d9902
 class WritableCustomIO : public av::CustomIO, public Napi::ObjectWrap<WritableCustomIO> {
   Nobind::EnvInstanceData<ffmpegInstanceData> *instance_data;
   std::queue<BufferWritableItem *> queue;
+  // Queue size in number of bytes not yet consumed
+  size_t queue_size;
   std::mutex lock;
   std::condition_variable cv;
   bool eof;
+  // Set by abort(), protected by the lock
+  bool aborted;
+  CustomIOStats stats;
+  // Synchronous mode, without a pull callback the whole input must be queued
+  bool sync;
+  Napi::FunctionReference pull;
+  // Synchronous mode, the callback of a _write() that went above the high-water mark
+  Napi::FunctionReference pending_write;
+  size_t high_water_mark;
+
+  void CountRead(size_t bytes, uint64_t wait);
+  int ReadSync(uint8_t *data, size_t size);
+  void ReleasePendingWrite();
+  void Append(const Napi::Value &data);
+  void Fail(const char *msg);
 
 public:
   // A JS-convention constructor
@@ -64,6 +98,15 @@ public:
   void _Write(const Napi::CallbackInfo &info);
   void _Final(const Napi::CallbackInfo &info);
 
+  // Pre-fills the queue of a synchronous WritableCustomIO, null signals EOF
+  void Enqueue(const Napi::CallbackInfo &info);
+
+  // Unblocks a pending read with AVERROR_EXIT, the queued Buffers are dropped
+  void Abort(const Napi::CallbackInfo &info);
+
+  // Float64Array snapshot of the counters
+  Napi::Value GetStats(const Napi::CallbackInfo &info);
+
   // To be called once for each isolate to set up the Writable inheritance
   static void Init(const Napi::CallbackInfo &info);
 
@@ -82,6 +125,8 @@ class ReadableCustomIO : public av::CustomIO, public Napi::ObjectWrap<ReadableCu
   std::condition_variable cv;
   // Has the end been reached
   bool eof;
+  // Set by abort(), protected by the lock
+  bool aborted;
   Napi::AsyncContext async_context;
   // Does writing from ffmpeg trigger an immediate push, can be used only from the main thread
   bool flowing;
@@ -89,6 +134,12 @@ class ReadableCustomIO : public av::CustomIO, public Napi::ObjectWrap<ReadableCu
   uv_async_t *push_callback;
   // Callback to call after handling EOF, passed by _final
   Napi::FunctionReference final_callback;
+  CustomIOStats stats;
+  // Synchronous mode, without a sink the data is kept until drain()
+  bool sync;
+  Napi::FunctionReference sink;
+
+  int WriteSync(const uint8_t *data, size_t size);
 
   // Main push loop, pushes available data until this.push returns false
   static void PushPendingData(uv_async_t *);
@@ -109,10 +160,19 @@ public:
   // This is the JS stream _read to be called from JS
   void _Read(const Napi::CallbackInfo &info);
 
+  // Retrieves the data written to a synchronous ReadableCustomIO without a sink
+  Napi::Value Drain(const Napi::CallbackInfo &info);
+
+  // Unblocks a pending write with AVERROR_EXIT
+  void Abort(const Napi::CallbackInfo &info);
+
   // This a ffmpeg extension - ffmpeg does not signal EOF to CustomIO
   // It is done manually in the Demuxer
   void _Final(const Napi::CallbackInfo &info);
 
+  // Float64Array snapshot of the counters
+  Napi::Value GetStats(const Napi::CallbackInfo &info);
+
   // To be called once for each isolate to set up the Readable inheritance
   static void Init(const Napi::CallbackInfo &info);
 
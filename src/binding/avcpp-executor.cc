@@ -0,0 +1,578 @@
+#include "avcpp-executor.h"
+#include "avcpp-codec.h"
+#include "avcpp-frame.h"
+#include "avcpp-framepool.h"
+#include "avcpp-stats.h"
+#include "debug.h"
+#include <codeccontext.h>
+#include <exception>
+#include <filters/buffersink.h>
+#include <filters/buffersrc.h>
+#include <packet.h>
+#include <videorescaler.h>
+
+// The native object behind a nobind17-wrapped JS object
+template <typename T> static T &Unwrap(const Napi::Value &val) { return Nobind::Typemap::FromJS<T &>(val).Get(); }
+
+static uint32_t PipelineArg(const Napi::CallbackInfo &info, size_t args) {
+  if (info.Length() != args)
+    throw Napi::TypeError::New(info.Env(), "Expected " + std::to_string(args) + " arguments");
+  if (!info[0].IsNumber())
+    throw Napi::TypeError::New(info.Env(), "pipeline must be a number");
+  return info[0].ToNumber().Uint32Value();
+}
+
+MediaExecutor::MediaExecutor(const Napi::CallbackInfo &info)
+    : Napi::ObjectWrap<MediaExecutor>{info}, work_stealing{true}, stopping{false}, joined{false}, queued{0}, running{0},
+      pending{0},
+      executed{0}, stolen{0}, run_time{0}, wait_time{0}, async_context{info.Env(), "ffmpeg_MediaExecutor"} {
+  Napi::Env env{info.Env()};
+
+  size_t threads = std::thread::hardware_concurrency();
+  if (info.Length() > 0 && info[0].IsObject()) {
+    Napi::Object options = info[0].ToObject();
+    if (options.Has("threads") && options.Get("threads").IsNumber())
+      threads = options.Get("threads").ToNumber().Uint32Value();
+    if (options.Has("workStealing"))
+      work_stealing = options.Get("workStealing").ToBoolean();
+  }
+  if (threads == 0)
+    threads = 1;
+
+  uv_loop_t *event_loop;
+  napi_get_uv_event_loop(env, &event_loop);
+  completion_callback = new uv_async_t;
+  uv_async_init(event_loop, completion_callback, &MediaExecutor::Complete);
+  completion_callback->data = this;
+  // An idle executor does not keep the process alive
+  uv_unref(reinterpret_cast<uv_handle_t *>(completion_callback));
+
+  ready.resize(threads);
+  homes.resize(HomeSlots);
+  for (size_t i = 0; i < HomeSlots; i++)
+    homes[i] = i % threads;
+  for (size_t i = 0; i < threads; i++)
+    workers.emplace_back(&MediaExecutor::Worker, this, i);
+  verbose("MediaExecutor %p: started %lu threads\n", this, threads);
+}
+
+MediaExecutor::~MediaExecutor() {
+  verbose("MediaExecutor %p: destroy\n", this);
+  Stop();
+  completion_callback->data = nullptr;
+  uv_close(reinterpret_cast<uv_handle_t *>(completion_callback),
+           [](uv_handle_t *async) { delete (reinterpret_cast<uv_async_t *>(async)); });
+  // The executor holds a reference to itself as long as it has pending jobs
+  while (!completed.empty()) {
+    delete completed.front();
+    completed.pop();
+  }
+}
+
+void MediaExecutor::Stop() {
+  {
+    std::unique_lock lk{lock};
+    stopping = true;
+  }
+  cv.notify_all();
+  // A close() in progress is joining the workers
+  if (closer.joinable())
+    closer.join();
+  for (auto &worker : workers)
+    if (worker.joinable())
+      worker.join();
+  workers.clear();
+}
+
+void MediaExecutor::Worker(size_t id) {
+  std::unique_lock lk{lock};
+  for (;;) {
+    size_t from = id;
+    if (ready[id].empty() && work_stealing) {
+      for (size_t i = 1; i < ready.size(); i++) {
+        size_t j = (id + i) % ready.size();
+        if (!ready[j].empty()) {
+          from = j;
+          break;
+        }
+      }
+    }
+    if (ready[from].empty()) {
+      // The remaining jobs are always completed before stopping
+      if (stopping)
+        return;
+      cv.wait(lk);
+      continue;
+    }
+
+    uint32_t pid;
+    if (from == id) {
+      pid = ready[id].front();
+      ready[id].pop_front();
+    } else {
+      // Steal from the back, the front is the most likely to be picked up by its own thread
+      pid = ready[from].back();
+      ready[from].pop_back();
+      stolen++;
+    }
+    Pipeline &pipeline = pipelines[pid];
+    ExecutorTask *task = pipeline.tasks.front();
+    pipeline.tasks.pop();
+    queued--;
+    running++;
+    lk.unlock();
+
+    verbose("MediaExecutor: thread %lu running a job of pipeline %u\n", id, pid);
+    uint64_t start = Stats::Now();
+    try {
+      task->Execute();
+    } catch (const std::exception &err) {
+      task->error = err.what();
+      if (task->error.empty())
+        task->error = "Unknown error in MediaExecutor job";
+    } catch (...) {
+      task->error = "Unknown error in MediaExecutor job";
+    }
+
+    uint64_t run = Stats::Now() - start;
+    uint64_t wait = start - task->submitted;
+    Stats::Add(Stats::ExecutorJobs, 1);
+    Stats::Add(Stats::ExecutorRunTime, run);
+    Stats::Add(Stats::ExecutorWaitTime, wait);
+
+    lk.lock();
+    running--;
+    executed++;
+    run_time += run;
+    wait_time += wait;
+    completed.push(task);
+    // A pipeline stays on the thread that ran it last
+    homes[pid % HomeSlots] = id;
+    if (!pipeline.tasks.empty())
+      ready[id].push_back(pid);
+    else
+      pipelines.erase(pid);
+    uv_async_send(completion_callback);
+  }
+}
+
+void MediaExecutor::Complete(uv_async_t *async) {
+  MediaExecutor *self = reinterpret_cast<MediaExecutor *>(async->data);
+  if (self == nullptr)
+    return;
+  Napi::Env env{self->Env()};
+  Napi::HandleScope scope{env};
+  // The Promise continuations run when this scope closes
+  Napi::CallbackScope callback_scope{env, self->async_context};
+
+  std::queue<ExecutorTask *> done;
+  bool closed;
+  {
+    std::unique_lock lk{self->lock};
+    std::swap(done, self->completed);
+    // All the jobs have been completed once the workers are joined
+    closed = self->joined && !self->close_waiters.empty();
+  }
+  verbose("MediaExecutor %p: completing %lu jobs\n", self, done.size());
+  size_t finished = done.size();
+  while (!done.empty()) {
+    ExecutorTask *task = done.front();
+    done.pop();
+    if (task->error.empty()) {
+      try {
+        task->deferred.Resolve(task->Result(env));
+      } catch (const Napi::Error &err) {
+        task->deferred.Reject(err.Value());
+      }
+    } else {
+      task->deferred.Reject(Napi::Error::New(env, task->error).Value());
+    }
+    // The argument references are released here, in the main thread
+    delete task;
+  }
+
+  if (finished > 0) {
+    std::unique_lock lk{self->lock};
+    self->pending -= finished;
+    if (self->pending == 0) {
+      if (self->close_waiters.empty())
+        uv_unref(reinterpret_cast<uv_handle_t *>(self->completion_callback));
+      self->Unref();
+    }
+  }
+
+  if (closed) {
+    verbose("MediaExecutor %p: closed\n", self);
+    self->closer.join();
+    self->workers.clear();
+    std::vector<Napi::Promise::Deferred> waiters;
+    std::swap(waiters, self->close_waiters);
+    for (auto &deferred : waiters)
+      deferred.Resolve(env.Undefined());
+    uv_unref(reinterpret_cast<uv_handle_t *>(self->completion_callback));
+    // Last, this can destroy the executor
+    self->Unref();
+  }
+}
+
+Napi::Value MediaExecutor::Submit(Napi::Env env, ExecutorTask *task, const std::vector<Napi::Value> &args) {
+  for (const auto &arg : args)
+    task->refs.push_back(Napi::Persistent(arg));
+  Napi::Promise promise = task->deferred.Promise();
+  task->submitted = Stats::Now();
+
+  std::unique_lock lk{lock};
+  if (stopping) {
+    lk.unlock();
+    delete task;
+    throw Napi::Error::New(env, "MediaExecutor is closed");
+  }
+  if (pending++ == 0) {
+    // Keep the event loop and the executor alive while there are jobs in flight
+    uv_ref(reinterpret_cast<uv_handle_t *>(completion_callback));
+    Ref();
+  }
+  queued++;
+  Pipeline &pipeline = pipelines[task->pipeline];
+  pipeline.tasks.push(task);
+  if (!pipeline.scheduled) {
+    pipeline.scheduled = true;
+    ready[homes[task->pipeline % HomeSlots]].push_back(task->pipeline);
+  }
+  lk.unlock();
+  cv.notify_all();
+
+  return promise;
+}
+
+Napi::Value MediaExecutor::DecodeVideo(const Napi::CallbackInfo &info) {
+  uint32_t pipeline = PipelineArg(info, 3);
+  auto &decoder = Unwrap<av::VideoDecoderContext>(info[1]);
+  auto &packet = Unwrap<av::Packet>(info[2]);
+  return Submit(info.Env(), new ExecutorCall<av::VideoFrame>(info.Env(), pipeline, [&decoder, &packet]() {
+                  return decoder.decode(packet, av::throws(), true);
+                }),
+                {info[1], info[2]});
+}
+
+Napi::Value MediaExecutor::DecodeAudio(const Napi::CallbackInfo &info) {
+  uint32_t pipeline = PipelineArg(info, 3);
+  auto &decoder = Unwrap<av::AudioDecoderContext>(info[1]);
+  auto &packet = Unwrap<av::Packet>(info[2]);
+  return Submit(info.Env(), new ExecutorCall<av::AudioSamples>(info.Env(), pipeline, [&decoder, &packet]() {
+                  return decoder.decode(packet, av::throws());
+                }),
+                {info[1], info[2]});
+}
+
+Napi::Value MediaExecutor::EncodeVideo(const Napi::CallbackInfo &info) {
+  uint32_t pipeline = PipelineArg(info, 3);
+  auto &encoder = Unwrap<av::VideoEncoderContext>(info[1]);
+  auto &frame = Unwrap<av::VideoFrame>(info[2]);
+  return Submit(info.Env(), new ExecutorCall<av::Packet>(info.Env(), pipeline, [&encoder, &frame]() {
+                  return encoder.encode(frame, av::throws());
+                }),
+                {info[1], info[2]});
+}
+
+Napi::Value MediaExecutor::EncodeAudio(const Napi::CallbackInfo &info) {
+  uint32_t pipeline = PipelineArg(info, 3);
+  auto &encoder = Unwrap<av::AudioEncoderContext>(info[1]);
+  auto &samples = Unwrap<av::AudioSamples>(info[2]);
+  return Submit(info.Env(), new ExecutorCall<av::Packet>(info.Env(), pipeline, [&encoder, &samples]() {
+                  return encoder.encode(samples, av::throws());
+                }),
+                {info[1], info[2]});
+}
+
+Napi::Value MediaExecutor::FinalizeVideo(const Napi::CallbackInfo &info) {
+  uint32_t pipeline = PipelineArg(info, 2);
+  auto &encoder = Unwrap<av::VideoEncoderContext>(info[1]);
+  return Submit(info.Env(),
+                new ExecutorCall<av::Packet>(info.Env(), pipeline, [&encoder]() { return encoder.encode(av::throws()); }),
+                {info[1]});
+}
+
+Napi::Value MediaExecutor::FinalizeAudio(const Napi::CallbackInfo &info) {
+  uint32_t pipeline = PipelineArg(info, 2);
+  auto &encoder = Unwrap<av::AudioEncoderContext>(info[1]);
+  return Submit(info.Env(),
+                new ExecutorCall<av::Packet>(info.Env(), pipeline, [&encoder]() { return encoder.encode(av::throws()); }),
+                {info[1]});
+}
+
+// The frames are copied to the vector in the main thread, this adds new references
+template <typename F> static std::vector<F> UnwrapArray(const Napi::Value &val) {
+  if (!val.IsArray())
+    throw Napi::TypeError::New(val.Env(), "Expected an array of frames");
+  Napi::Array array = val.As<Napi::Array>();
+  std::vector<F> frames;
+  frames.reserve(array.Length());
+  for (uint32_t i = 0; i < array.Length(); i++)
+    frames.push_back(Unwrap<F>(array.Get(i)));
+  return frames;
+}
+
+Napi::Value MediaExecutor::EncodeVideoBatch(const Napi::CallbackInfo &info) {
+  uint32_t pipeline = PipelineArg(info, 3);
+  auto &encoder = Unwrap<av::VideoEncoderContext>(info[1]);
+  auto frames = UnwrapArray<av::VideoFrame>(info[2]);
+  return Submit(info.Env(),
+                new ExecutorCall<std::vector<av::Packet>>(info.Env(), pipeline,
+                                                          [&encoder, frames = std::move(frames)]() {
+                                                            return EncodeBatch(encoder, frames);
+                                                          }),
+                {info[1]});
+}
+
+Napi::Value MediaExecutor::EncodeAudioBatch(const Napi::CallbackInfo &info) {
+  uint32_t pipeline = PipelineArg(info, 3);
+  auto &encoder = Unwrap<av::AudioEncoderContext>(info[1]);
+  auto samples = UnwrapArray<av::AudioSamples>(info[2]);
+  return Submit(info.Env(),
+                new ExecutorCall<std::vector<av::Packet>>(info.Env(), pipeline,
+                                                          [&encoder, samples = std::move(samples)]() {
+                                                            return EncodeBatch(encoder, samples);
+                                                          }),
+                {info[1]});
+}
+
+Napi::Value MediaExecutor::FinalizeVideoBatch(const Napi::CallbackInfo &info) {
+  uint32_t pipeline = PipelineArg(info, 2);
+  auto &encoder = Unwrap<av::VideoEncoderContext>(info[1]);
+  return Submit(info.Env(), new ExecutorCall<std::vector<av::Packet>>(info.Env(), pipeline, [&encoder]() {
+                  return FinalizeBatch(encoder);
+                }),
+                {info[1]});
+}
+
+Napi::Value MediaExecutor::FinalizeAudioBatch(const Napi::CallbackInfo &info) {
+  uint32_t pipeline = PipelineArg(info, 2);
+  auto &encoder = Unwrap<av::AudioEncoderContext>(info[1]);
+  return Submit(info.Env(), new ExecutorCall<std::vector<av::Packet>>(info.Env(), pipeline, [&encoder]() {
+                  return FinalizeBatch(encoder);
+                }),
+                {info[1]});
+}
+
+Napi::Value MediaExecutor::Rescale(const Napi::CallbackInfo &info) {
+  uint32_t pipeline = PipelineArg(info, 3);
+  auto &rescaler = Unwrap<av::VideoRescaler>(info[1]);
+  auto &frame = Unwrap<av::VideoFrame>(info[2]);
+  return Submit(info.Env(), new ExecutorCall<av::VideoFrame>(info.Env(), pipeline, [&rescaler, &frame]() {
+                  return rescaler.rescale(frame, av::throws());
+                }),
+                {info[1], info[2]});
+}
+
+Napi::Value MediaExecutor::RescaleInto(const Napi::CallbackInfo &info) {
+  uint32_t pipeline = PipelineArg(info, 4);
+  auto &rescaler = Unwrap<av::VideoRescaler>(info[1]);
+  auto &dst = Unwrap<av::VideoFrame>(info[2]);
+  auto &src = Unwrap<av::VideoFrame>(info[3]);
+  return Submit(info.Env(), new ExecutorCall<void>(info.Env(), pipeline, [&rescaler, &dst, &src]() {
+                  ::RescaleInto(rescaler, dst, src);
+                }),
+                {info[1], info[2], info[3]});
+}
+
+Napi::Value MediaExecutor::WriteVideoFrame(const Napi::CallbackInfo &info) {
+  uint32_t pipeline = PipelineArg(info, 3);
+  auto &src = Unwrap<av::BufferSrcFilterContext>(info[1]);
+  auto &frame = Unwrap<av::VideoFrame>(info[2]);
+  return Submit(info.Env(), new ExecutorCall<void>(info.Env(), pipeline, [&src, &frame]() {
+                  src.writeVideoFrame(frame, av::throws());
+                }),
+                {info[1], info[2]});
+}
+
+Napi::Value MediaExecutor::WriteAudioSamples(const Napi::CallbackInfo &info) {
+  uint32_t pipeline = PipelineArg(info, 3);
+  auto &src = Unwrap<av::BufferSrcFilterContext>(info[1]);
+  auto &samples = Unwrap<av::AudioSamples>(info[2]);
+  return Submit(info.Env(), new ExecutorCall<void>(info.Env(), pipeline, [&src, &samples]() {
+                  src.writeAudioSamples(samples, av::throws());
+                }),
+                {info[1], info[2]});
+}
+
+Napi::Value MediaExecutor::AddVideoFrame(const Napi::CallbackInfo &info) {
+  uint32_t pipeline = PipelineArg(info, 3);
+  auto &src = Unwrap<av::BufferSrcFilterContext>(info[1]);
+  auto &frame = Unwrap<av::VideoFrame>(info[2]);
+  return Submit(info.Env(), new ExecutorCall<void>(info.Env(), pipeline, [&src, &frame]() {
+                  src.addVideoFrame(frame, av::throws());
+                }),
+                {info[1], info[2]});
+}
+
+Napi::Value MediaExecutor::AddAudioSamples(const Napi::CallbackInfo &info) {
+  uint32_t pipeline = PipelineArg(info, 3);
+  auto &src = Unwrap<av::BufferSrcFilterContext>(info[1]);
+  auto &samples = Unwrap<av::AudioSamples>(info[2]);
+  return Submit(info.Env(), new ExecutorCall<void>(info.Env(), pipeline, [&src, &samples]() {
+                  src.addAudioSamples(samples, av::throws());
+                }),
+                {info[1], info[2]});
+}
+
+Napi::Value MediaExecutor::GetVideoFrames(const Napi::CallbackInfo &info) {
+  uint32_t pipeline = PipelineArg(info, 3);
+  auto &sink = Unwrap<av::BufferSinkFilterContext>(info[1]);
+  size_t max = info[2].ToNumber().Uint32Value();
+  return Submit(info.Env(), new ExecutorCall<SinkFrames<av::VideoFrame>>(info.Env(), pipeline, [&sink, max]() {
+                  return ::GetVideoFrames(sink, max, av::throws());
+                }),
+                {info[1]});
+}
+
+Napi::Value MediaExecutor::GetAudioFrames(const Napi::CallbackInfo &info) {
+  uint32_t pipeline = PipelineArg(info, 3);
+  auto &sink = Unwrap<av::BufferSinkFilterContext>(info[1]);
+  size_t max = info[2].ToNumber().Uint32Value();
+  return Submit(info.Env(), new ExecutorCall<SinkFrames<av::AudioSamples>>(info.Env(), pipeline, [&sink, max]() {
+                  return ::GetAudioFrames(sink, max, av::throws());
+                }),
+                {info[1]});
+}
+
+Napi::Value MediaExecutor::GetStats(const Napi::CallbackInfo &info) {
+  Napi::Env env{info.Env()};
+  Napi::Object stats = Napi::Object::New(env);
+
+  std::unique_lock lk{lock};
+  // Number of jobs waiting in the ready pipelines of each thread
+  Napi::Array depth = Napi::Array::New(env, ready.size());
+  for (size_t i = 0; i < ready.size(); i++) {
+    size_t jobs = 0;
+    for (auto pid : ready[i])
+      jobs += pipelines[pid].tasks.size();
+    depth.Set(i, Napi::Number::New(env, static_cast<double>(jobs)));
+  }
+  stats.Set("threads", Napi::Number::New(env, static_cast<double>(workers.size())));
+  stats.Set("queued", Napi::Number::New(env, static_cast<double>(queued)));
+  stats.Set("running", Napi::Number::New(env, static_cast<double>(running)));
+  stats.Set("executed", Napi::Number::New(env, static_cast<double>(executed)));
+  stats.Set("stolen", Napi::Number::New(env, static_cast<double>(stolen)));
+  stats.Set("runTime", Napi::Number::New(env, static_cast<double>(run_time)));
+  stats.Set("waitTime", Napi::Number::New(env, static_cast<double>(wait_time)));
+  stats.Set("pipelines", Napi::Number::New(env, static_cast<double>(pipelines.size())));
+  stats.Set("queueDepth", depth);
+
+  return stats;
+}
+
+Napi::Value MediaExecutor::Close(const Napi::CallbackInfo &info) {
+  Napi::Env env{info.Env()};
+  verbose("MediaExecutor %p: close\n", this);
+  Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(env);
+  Napi::Promise promise = deferred.Promise();
+
+  std::unique_lock lk{lock};
+  if (stopping) {
+    if (closer.joinable()) {
+      // Already closing
+      close_waiters.push_back(deferred);
+    } else {
+      deferred.Resolve(env.Undefined());
+    }
+    return promise;
+  }
+  stopping = true;
+  close_waiters.push_back(deferred);
+  // The queued jobs are completed and their Promises are resolved before
+  // the one of close(), the workers are joined without blocking the event loop
+  uv_ref(reinterpret_cast<uv_handle_t *>(completion_callback));
+  Ref();
+  closer = std::thread{[this]() {
+    for (auto &worker : workers)
+      worker.join();
+    std::unique_lock lk{lock};
+    joined = true;
+    uv_async_send(completion_callback);
+  }};
+  lk.unlock();
+  cv.notify_all();
+
+  return promise;
+}
+
+Napi::Function MediaExecutor::GetClass(Napi::Env env) {
+  return DefineClass(env, "MediaExecutor",
+                     {InstanceMethod("decodeVideo", &MediaExecutor::DecodeVideo),
+                      InstanceMethod("decodeAudio", &MediaExecutor::DecodeAudio),
+                      InstanceMethod("encodeVideo", &MediaExecutor::EncodeVideo),
+                      InstanceMethod("encodeAudio", &MediaExecutor::EncodeAudio),
+                      InstanceMethod("finalizeVideo", &MediaExecutor::FinalizeVideo),
+                      InstanceMethod("finalizeAudio", &MediaExecutor::FinalizeAudio),
+                      InstanceMethod("encodeVideoBatch", &MediaExecutor::EncodeVideoBatch),
+                      InstanceMethod("encodeAudioBatch", &MediaExecutor::EncodeAudioBatch),
+                      InstanceMethod("finalizeVideoBatch", &MediaExecutor::FinalizeVideoBatch),
+                      InstanceMethod("finalizeAudioBatch", &MediaExecutor::FinalizeAudioBatch),
+                      InstanceMethod("rescale", &MediaExecutor::Rescale),
+                      InstanceMethod("rescaleInto", &MediaExecutor::RescaleInto),
+                      InstanceMethod("writeVideoFrame", &MediaExecutor::WriteVideoFrame),
+                      InstanceMethod("writeAudioSamples", &MediaExecutor::WriteAudioSamples),
+                      InstanceMethod("addVideoFrame", &MediaExecutor::AddVideoFrame),
+                      InstanceMethod("addAudioSamples", &MediaExecutor::AddAudioSamples),
+                      InstanceMethod("getVideoFrames", &MediaExecutor::GetVideoFrames),
+                      InstanceMethod("getAudioFrames", &MediaExecutor::GetAudioFrames),
+                      InstanceMethod("stats", &MediaExecutor::GetStats), InstanceMethod("close", &MediaExecutor::Close)});
+}
+
+const char *MediaExecutorTypeScriptFragment = R"(
+export interface MediaExecutorOptions {
+  /**
+   * Number of worker threads, @default the number of CPU cores
+   */
+  threads?: number;
+  /**
+   * Allow idle threads to pick up the pipelines of the other threads, @default true
+   */
+  workStealing?: boolean;
+}
+export interface MediaExecutorStats {
+  threads: number;
+  queued: number;
+  running: number;
+  executed: number;
+  stolen: number;
+  /** Total time spent running jobs, in nanoseconds */
+  runTime: number;
+  /** Total time jobs spent waiting in the queue, in nanoseconds */
+  waitTime: number;
+  /** Pipelines with queued or running jobs */
+  pipelines: number;
+  queueDepth: number[];
+}
+export class MediaExecutor {
+  constructor(options?: MediaExecutorOptions);
+  decodeVideo(pipeline: number, decoder: VideoDecoderContext, packet: Packet): Promise<VideoFrame>;
+  decodeAudio(pipeline: number, decoder: AudioDecoderContext, packet: Packet): Promise<AudioSamples>;
+  encodeVideo(pipeline: number, encoder: VideoEncoderContext, frame: VideoFrame): Promise<Packet>;
+  encodeAudio(pipeline: number, encoder: AudioEncoderContext, samples: AudioSamples): Promise<Packet>;
+  finalizeVideo(pipeline: number, encoder: VideoEncoderContext): Promise<Packet>;
+  finalizeAudio(pipeline: number, encoder: AudioEncoderContext): Promise<Packet>;
+  encodeVideoBatch(pipeline: number, encoder: VideoEncoderContext, frames: VideoFrame[]): Promise<Packet[]>;
+  encodeAudioBatch(pipeline: number, encoder: AudioEncoderContext, samples: AudioSamples[]): Promise<Packet[]>;
+  finalizeVideoBatch(pipeline: number, encoder: VideoEncoderContext): Promise<Packet[]>;
+  finalizeAudioBatch(pipeline: number, encoder: AudioEncoderContext): Promise<Packet[]>;
+  rescale(pipeline: number, rescaler: VideoRescaler, frame: VideoFrame): Promise<VideoFrame>;
+  rescaleInto(pipeline: number, rescaler: VideoRescaler, dst: VideoFrame, src: VideoFrame): Promise<void>;
+  writeVideoFrame(pipeline: number, src: BufferSrcFilterContext, frame: VideoFrame): Promise<void>;
+  writeAudioSamples(pipeline: number, src: BufferSrcFilterContext, samples: AudioSamples): Promise<void>;
+  /** The frame reference is handed over to the filter graph, the frame is left empty */
+  addVideoFrame(pipeline: number, src: BufferSrcFilterContext, frame: VideoFrame): Promise<void>;
+  addAudioSamples(pipeline: number, src: BufferSrcFilterContext, samples: AudioSamples): Promise<void>;
+  getVideoFrames(pipeline: number, sink: BufferSinkFilterContext, max: number):
+    Promise<{ frames: VideoFrame[], error: Error | null }>;
+  getAudioFrames(pipeline: number, sink: BufferSinkFilterContext, max: number):
+    Promise<{ frames: AudioSamples[], error: Error | null }>;
+  stats(): MediaExecutorStats;
+  /**
+   * Completes the queued jobs and stops the threads,
+   * resolves after all the Promises of the jobs
+   */
+  close(): Promise<void>;
+}
+)";
@@ -0,0 +1,153 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <nobind.h>
+#include <queue>
+#include <string>
+#include <thread>
+#include <uv.h>
+#include <vector>
+
+// A job submitted to the MediaExecutor
+// It is created and destroyed in the main thread, Execute() runs in a worker thread
+struct ExecutorTask {
+  uint32_t pipeline;
+  Napi::Promise::Deferred deferred;
+  // Persistent references to the JS arguments, protect the native objects from the GC
+  std::vector<Napi::Reference<Napi::Value>> refs;
+  // Set by the worker thread if Execute() threw
+  std::string error;
+  // Stats::Now() when it was queued
+  uint64_t submitted;
+
+  ExecutorTask(Napi::Env env, uint32_t pipeline)
+      : pipeline{pipeline}, deferred{Napi::Promise::Deferred::New(env)}, submitted{0} {}
+  virtual ~ExecutorTask() = default;
+
+  // Runs in a worker thread, must not touch JS
+  virtual void Execute() = 0;
+  // Runs in the main thread once the task has completed
+  virtual Napi::Value Result(Napi::Env env) = 0;
+};
+
+// An ExecutorTask that calls a function and converts its return value using the nobind17 typemaps
+template <typename R> struct ExecutorCall : public ExecutorTask {
+  std::function<R()> fn;
+  R result;
+
+  ExecutorCall(Napi::Env env, uint32_t pipeline, std::function<R()> fn)
+      : ExecutorTask{env, pipeline}, fn{std::move(fn)}, result{} {}
+  virtual void Execute() override { result = fn(); }
+  virtual Napi::Value Result(Napi::Env env) override {
+    return Nobind::Typemap::ToJS<R, Nobind::ReturnOwned>(env, std::move(result)).Get();
+  }
+};
+
+template <> struct ExecutorCall<void> : public ExecutorTask {
+  std::function<void()> fn;
+
+  ExecutorCall(Napi::Env env, uint32_t pipeline, std::function<void()> fn)
+      : ExecutorTask{env, pipeline}, fn{std::move(fn)} {}
+  virtual void Execute() override { fn(); }
+  virtual Napi::Value Result(Napi::Env env) override { return env.Undefined(); }
+};
+
+// A dedicated pool of worker threads for the media operations.
+//
+// By default, all *Async methods run on the shared libuv thread pool which
+// also handles fs and dns and is sized by UV_THREADPOOL_SIZE for the whole process.
+// The MediaExecutor has its own threads.
+//
+// Every job belongs to a pipeline (a number chosen by the user). The jobs of
+// the same pipeline are executed one at a time in FIFO order - which is what
+// the codec contexts require - and a pipeline sticks to the last thread that
+// ran it, so that its decoder, filter and encoder stay in the same warm cache.
+// An idle thread will steal pending pipelines from the other threads.
+//
+// This class is implemented manually, the same way as the CustomIO classes.
+// The objects passed to the executor must not be used at the same time with their
+// *Async methods or from another pipeline.
+class MediaExecutor : public Napi::ObjectWrap<MediaExecutor> {
+  // Only the pipelines with queued or running jobs are present in the map,
+  // the thread that ran a pipeline last is remembered in a fixed-size table
+  // indexed by its number, a collision only loses the affinity
+  struct Pipeline {
+    std::queue<ExecutorTask *> tasks;
+    // Present in a ready queue or running
+    bool scheduled;
+  };
+  static constexpr size_t HomeSlots = 1024;
+
+  // Everything is protected by a single lock - the jobs are full codec operations
+  // and the contention on it is negligible
+  std::mutex lock;
+  std::condition_variable cv;
+  std::vector<std::thread> workers;
+  // Per-thread queues of pipelines ready to run
+  std::vector<std::deque<uint32_t>> ready;
+  std::map<uint32_t, Pipeline> pipelines;
+  std::vector<size_t> homes;
+  // Finished jobs waiting for the main thread
+  std::queue<ExecutorTask *> completed;
+  bool work_stealing;
+  bool stopping;
+  // close() joins the workers in this thread and sets joined when it is done,
+  // the Promises returned by close() are resolved by Complete()
+  std::thread closer;
+  bool joined;
+  std::vector<Napi::Promise::Deferred> close_waiters;
+
+  // Statistics
+  size_t queued;
+  size_t running;
+  size_t pending;
+  uint64_t executed;
+  uint64_t stolen;
+  // In nanoseconds
+  uint64_t run_time;
+  uint64_t wait_time;
+
+  // Resolves the finished jobs in the main thread
+  uv_async_t *completion_callback;
+  Napi::AsyncContext async_context;
+
+  void Worker(size_t id);
+  static void Complete(uv_async_t *);
+  void Stop();
+  Napi::Value Submit(Napi::Env env, ExecutorTask *task, const std::vector<Napi::Value> &args);
+
+public:
+  // A JS-convention constructor
+  MediaExecutor(const Napi::CallbackInfo &info);
+
+  virtual ~MediaExecutor() override;
+
+  Napi::Value DecodeVideo(const Napi::CallbackInfo &info);
+  Napi::Value DecodeAudio(const Napi::CallbackInfo &info);
+  Napi::Value EncodeVideo(const Napi::CallbackInfo &info);
+  Napi::Value EncodeAudio(const Napi::CallbackInfo &info);
+  Napi::Value FinalizeVideo(const Napi::CallbackInfo &info);
+  Napi::Value FinalizeAudio(const Napi::CallbackInfo &info);
+  Napi::Value EncodeVideoBatch(const Napi::CallbackInfo &info);
+  Napi::Value EncodeAudioBatch(const Napi::CallbackInfo &info);
+  Napi::Value FinalizeVideoBatch(const Napi::CallbackInfo &info);
+  Napi::Value FinalizeAudioBatch(const Napi::CallbackInfo &info);
+  Napi::Value Rescale(const Napi::CallbackInfo &info);
+  Napi::Value RescaleInto(const Napi::CallbackInfo &info);
+  Napi::Value WriteVideoFrame(const Napi::CallbackInfo &info);
+  Napi::Value WriteAudioSamples(const Napi::CallbackInfo &info);
+  Napi::Value AddVideoFrame(const Napi::CallbackInfo &info);
+  Napi::Value AddAudioSamples(const Napi::CallbackInfo &info);
+  Napi::Value GetVideoFrames(const Napi::CallbackInfo &info);
+  Napi::Value GetAudioFrames(const Napi::CallbackInfo &info);
+  Napi::Value GetStats(const Napi::CallbackInfo &info);
+  Napi::Value Close(const Napi::CallbackInfo &info);
+
+  // The usual Napi GetClass
+  static Napi::Function GetClass(Napi::Env env);
+};
+
+extern const char *MediaExecutorTypeScriptFragment;
@@ -0,0 +1,75 @@
+#include "avcpp-filter.h"
+#include <averror.h>
+
+extern "C" {
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersrc.h>
+}
+
+// RAII wrapper for the parameters which must be freed with av_free
+struct BufferSrcParameters {
+  AVBufferSrcParameters *par;
+  BufferSrcParameters() : par{av_buffersrc_parameters_alloc()} {
+    if (par == nullptr)
+      throw std::bad_alloc{};
+  }
+  ~BufferSrcParameters() {
+    av_channel_layout_uninit(&par->ch_layout);
+    av_free(par);
+  }
+};
+
+void SetVideoSourceParameters(FilterContext &ctx, int width, int height, PixelFormat pixelFormat,
+                              const Rational &timeBase, OptionalErrorCode ec) {
+  clear_if(ec);
+  BufferSrcParameters params;
+  params.par->format = static_cast<AVPixelFormat>(pixelFormat);
+  params.par->width = width;
+  params.par->height = height;
+  params.par->time_base = timeBase.getValue();
+
+  int sts = av_buffersrc_parameters_set(ctx.raw(), params.par);
+  if (sts < 0)
+    throws_if(ec, sts, ffmpeg_category());
+}
+
+void SetAudioSourceParameters(FilterContext &ctx, int sampleRate, SampleFormat sampleFormat, uint64_t channelLayout,
+                              const Rational &timeBase, OptionalErrorCode ec) {
+  clear_if(ec);
+  BufferSrcParameters params;
+  params.par->format = static_cast<AVSampleFormat>(sampleFormat);
+  params.par->sample_rate = sampleRate;
+  params.par->time_base = timeBase.getValue();
+  int sts = av_channel_layout_from_mask(&params.par->ch_layout, channelLayout);
+  if (sts < 0) {
+    throws_if(ec, sts, ffmpeg_category());
+    return;
+  }
+
+  sts = av_buffersrc_parameters_set(ctx.raw(), params.par);
+  if (sts < 0)
+    throws_if(ec, sts, ffmpeg_category());
+}
+
+std::string SendFilterCommand(FilterGraph &graph, const std::string &target, const std::string &cmd,
+                              const std::string &arg, int flags, OptionalErrorCode ec) {
+  clear_if(ec);
+  char response[4096] = {0};
+
+  int sts = avfilter_graph_send_command(graph.raw(), target.c_str(), cmd.c_str(), arg.c_str(), response,
+                                        sizeof(response), flags);
+  if (sts < 0) {
+    throws_if(ec, sts, ffmpeg_category());
+    return {};
+  }
+
+  return response;
+}
+
+void QueueFilterCommand(FilterGraph &graph, const std::string &target, const std::string &cmd, const std::string &arg,
+                        int flags, double ts, OptionalErrorCode ec) {
+  clear_if(ec);
+  int sts = avfilter_graph_queue_command(graph.raw(), target.c_str(), cmd.c_str(), arg.c_str(), flags, ts);
+  if (sts < 0)
+    throws_if(ec, sts, ffmpeg_category());
+}
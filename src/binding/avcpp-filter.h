@@ -0,0 +1,29 @@
+#pragma once
+#include <filters/filtercontext.h>
+#include <filters/filtergraph.h>
+#include <frame.h>
+#include <string>
+
+#include <nobind.h>
+
+using namespace av;
+
+// These extension functions expose the parts of the libavfilter API
+// that allow to reconfigure a running filter graph without rebuilding it,
+// they have no avcpp counterparts
+
+// Change the expected input parameters of a video (buffer) or audio (abuffer) source,
+// this must be called before writing the first frame with the new parameters
+void SetVideoSourceParameters(FilterContext &ctx, int width, int height, PixelFormat pixelFormat,
+                              const Rational &timeBase, OptionalErrorCode ec);
+void SetAudioSourceParameters(FilterContext &ctx, int sampleRate, SampleFormat sampleFormat, uint64_t channelLayout,
+                              const Rational &timeBase, OptionalErrorCode ec);
+
+// avfilter_graph_send_command, returns the response of the filter
+std::string SendFilterCommand(FilterGraph &graph, const std::string &target, const std::string &cmd,
+                              const std::string &arg, int flags, OptionalErrorCode ec);
+
+// avfilter_graph_queue_command, the command will be executed when the frame with the given timestamp (in seconds)
+// reaches the filter
+void QueueFilterCommand(FilterGraph &graph, const std::string &target, const std::string &cmd, const std::string &arg,
+                        int flags, double ts, OptionalErrorCode ec);
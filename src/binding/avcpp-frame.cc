@@ -1,4 +1,5 @@
 #include "avcpp-frame.h"
+#include "avcpp-stats.h"
 
 AudioSamples CreateAudioSamples(Nobind::Typemap::Buffer buffer, SampleFormat sampleFormat, int samplesCount,
                                 uint64_t channelLayout, int sampleRate) {
@@ -11,7 +12,11 @@ VideoFrame CreateVideoFrame(Nobind::Typemap::Buffer buffer, PixelFormat pixelFor
 
 VideoFrameBuffer CopyFrameToBuffer(VideoFrame &frame) {
   auto size = frame.bufferSize();
-  return VideoFrameBuffer{{[&frame, size](uint8_t *data) { frame.copyToBuffer(data, size); }, size}};
+  return VideoFrameBuffer{{[&frame, size](uint8_t *data) {
+                             frame.copyToBuffer(data, size);
+                             Stats::Add(Stats::FrameBytesCopied, size);
+                           },
+                           size}};
 }
 
 VideoFrame *GetVideoFrame(BufferSinkFilterContext &sink, OptionalErrorCode ec) {
@@ -33,3 +38,34 @@ AudioSamples *GetAudioFrame(BufferSinkFilterContext &sink, OptionalErrorCode ec)
 
   return samples;
 }
+
+template <typename T>
+static SinkFrames<T> GetFrames(BufferSinkFilterContext &sink, size_t max, OptionalErrorCode ec,
+                               bool (BufferSinkFilterContext::*get)(T &, OptionalErrorCode)) {
+  SinkFrames<T> r;
+  clear_if(ec);
+
+  while (max == 0 || r.frames.size() < max) {
+    // The buffersink moves its reference into the frame, it must be a new one every time
+    T frame;
+    if (!(sink.*get)(frame, r.error))
+      break;
+    r.frames.push_back(std::move(frame));
+  }
+
+  // The frames already drained must not be lost
+  if (r.error && r.frames.empty()) {
+    throws_if(ec, r.error.value(), r.error.category());
+    r.error.clear();
+  }
+
+  return r;
+}
+
+SinkFrames<VideoFrame> GetVideoFrames(BufferSinkFilterContext &sink, size_t max, OptionalErrorCode ec) {
+  return GetFrames<VideoFrame>(sink, max, ec, &BufferSinkFilterContext::getVideoFrame);
+}
+
+SinkFrames<AudioSamples> GetAudioFrames(BufferSinkFilterContext &sink, size_t max, OptionalErrorCode ec) {
+  return GetFrames<AudioSamples>(sink, max, ec, &BufferSinkFilterContext::getAudioFrame);
+}
@@ -3,6 +3,7 @@
 #include <frame.h>
 #include <functional>
 #include <nooverrides.h>
+#include <vector>
 
 // This is a typemap for the special case of CopyFrameToBuffer
 // The buffer can only be obtained by calling a special function that copies it for us
@@ -13,6 +14,14 @@
 // A VideoFrameBuffer is a function that fills it and a size
 class VideoFrameBuffer : public std::pair<std::function<void(uint8_t *)>, size_t> {};
 
+// The frames drained from a buffersink and the error that stopped the draining
+// The error is returned to JS instead of being thrown when there are frames,
+// the caller raises it once it has consumed them
+template <typename T> struct SinkFrames {
+  std::vector<T> frames;
+  std::error_code error;
+};
+
 namespace Nobind {
 
 namespace Typemap {
@@ -37,6 +46,30 @@ public:
   static const std::string TSType() { return "Buffer<ArrayBuffer>"; };
 };
 
+template <typename T, const ReturnAttribute &RETATTR> class ToJS<SinkFrames<T>, RETATTR> {
+  Napi::Env env_;
+  SinkFrames<T> val_;
+
+public:
+  inline explicit ToJS(Napi::Env env, SinkFrames<T> val) : env_(env), val_(std::move(val)) {}
+  inline Napi::Value Get() {
+    auto r = Napi::Object::New(env_);
+    r.Set("frames", ToJS<std::vector<T>, RETATTR>(env_, std::move(val_.frames)).Get());
+    if (val_.error)
+      r.Set("error", Napi::Error::New(env_, val_.error.message()).Value());
+    else
+      r.Set("error", env_.Null());
+    return r;
+  }
+
+  ToJS(const ToJS &) = delete;
+  ToJS(ToJS &&) = delete;
+
+  static const std::string TSType() {
+    return "{ frames: " + ToJS<std::vector<T>, RETATTR>::TSType() + ", error: Error | null }";
+  };
+};
+
 } // namespace Typemap
 } // namespace Nobind
 
@@ -72,3 +105,9 @@ VideoFrame CreateVideoFrame(Nobind::Typemap::Buffer buffer, PixelFormat pixelFor
 // In JavaScript all C++ objects are heap-allocated objects referenced by a pointer
 VideoFrame *GetVideoFrame(BufferSinkFilterContext &sink, OptionalErrorCode ec);
 AudioSamples *GetAudioFrame(BufferSinkFilterContext &sink, OptionalErrorCode ec);
+
+// Drain up to max frames (0 for everything available) from a sink in a single call
+// This allows reading a whole burst of frames with a single async operation
+// An error is thrown only if no frames were drained, otherwise it is returned with them
+SinkFrames<VideoFrame> GetVideoFrames(BufferSinkFilterContext &sink, size_t max, OptionalErrorCode ec);
+SinkFrames<AudioSamples> GetAudioFrames(BufferSinkFilterContext &sink, size_t max, OptionalErrorCode ec);
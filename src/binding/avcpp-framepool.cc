@@ -0,0 +1,67 @@
+#include "avcpp-framepool.h"
+#include <stdexcept>
+
+extern "C" {
+#include <libavutil/buffer.h>
+#include <libavutil/imgutils.h>
+}
+
+// The alignment of the planes and of the line sizes
+constexpr int align = 64;
+
+VideoFramePool::VideoFramePool(int width, int height, PixelFormat pixelFormat)
+    : pool{nullptr}, width_{width}, height_{height}, format_{pixelFormat} {
+  if (width <= 0 || height <= 0 || format_ == AV_PIX_FMT_NONE)
+    throw std::invalid_argument{"Invalid frame pool parameters"};
+  size_ = av_image_get_buffer_size(format_, width_, height_, align);
+  if (size_ < 0)
+    throw std::invalid_argument{"Unsupported pixel format"};
+  pool = av_buffer_pool_init(static_cast<size_t>(size_), av_buffer_alloc);
+  if (pool == nullptr)
+    throw std::bad_alloc{};
+}
+
+VideoFramePool::~VideoFramePool() {
+  // The pool is freed when the last buffer returns to it
+  av_buffer_pool_uninit(&pool);
+}
+
+VideoFrame VideoFramePool::get() {
+  AVFrame *raw = av_frame_alloc();
+  if (raw == nullptr)
+    throw std::bad_alloc{};
+  raw->buf[0] = av_buffer_pool_get(pool);
+  if (raw->buf[0] == nullptr) {
+    av_frame_free(&raw);
+    throw std::bad_alloc{};
+  }
+  raw->format = format_;
+  raw->width = width_;
+  raw->height = height_;
+  if (av_image_fill_arrays(raw->data, raw->linesize, raw->buf[0]->data, format_, width_, height_, align) < 0) {
+    av_frame_free(&raw);
+    throw std::runtime_error{"Failed filling the frame planes"};
+  }
+
+  // This adds a new reference
+  VideoFrame frame{raw};
+  av_frame_free(&raw);
+  frame.setComplete(true);
+  return frame;
+}
+
+int VideoFramePool::width() const { return width_; }
+int VideoFramePool::height() const { return height_; }
+PixelFormat VideoFramePool::pixelFormat() const { return format_; }
+
+void RescaleInto(VideoRescaler &rescaler, VideoFrame &dst, VideoFrame &src) {
+  AVFrame *raw = dst.raw();
+  if (raw == nullptr || raw->buf[0] == nullptr)
+    throw std::invalid_argument{"Destination frame is not allocated"};
+  if (raw->width != rescaler.dstWidth() || raw->height != rescaler.dstHeight() ||
+      raw->format != rescaler.dstPixelFormat())
+    throw std::invalid_argument{"Destination frame does not match the output of the rescaler"};
+  if (av_frame_make_writable(raw) < 0)
+    throw std::bad_alloc{};
+  rescaler.rescale(dst, src, av::throws());
+}
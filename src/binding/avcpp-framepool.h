@@ -0,0 +1,40 @@
+#pragma once
+#include <frame.h>
+#include <pixelformat.h>
+#include <videorescaler.h>
+
+using namespace av;
+
+struct AVBufferPool;
+
+// A pool of video frames with the same dimensions and pixel format
+//
+// All planes of a frame share one buffer from an AVBufferPool, when the last
+// reference to a frame is dropped - the JS object is collected or the encoder
+// has released it - the buffer returns to the pool instead of being freed.
+// This avoids the allocation churn of creating a new frame for every output.
+// get() can be called from any thread.
+class VideoFramePool {
+  AVBufferPool *pool;
+  int width_;
+  int height_;
+  AVPixelFormat format_;
+  int size_;
+
+public:
+  VideoFramePool(int width, int height, PixelFormat pixelFormat);
+  VideoFramePool(const VideoFramePool &) = delete;
+  VideoFramePool &operator=(const VideoFramePool &) = delete;
+  ~VideoFramePool();
+
+  // A new writable frame, its content is undefined
+  VideoFrame get();
+  int width() const;
+  int height() const;
+  PixelFormat pixelFormat() const;
+};
+
+// Rescales src into an existing frame, dst must have the output dimensions and
+// pixel format of the rescaler. If dst is referenced elsewhere, it is copied
+// before being written.
+void RescaleInto(VideoRescaler &rescaler, VideoFrame &dst, VideoFrame &src);
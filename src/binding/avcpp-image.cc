@@ -0,0 +1,177 @@
+#include "avcpp-image.h"
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+// Number of encoder contexts kept by each thread
+constexpr size_t max_cached_encoders = 4;
+
+struct CachedEncoder {
+  const AVCodec *codec;
+  int width;
+  int height;
+  AVPixelFormat pixelFormat;
+  int quality;
+  AVCodecContext *ctx;
+};
+
+// Everything is per-thread, there is no locking
+struct ImageCache {
+  SwsContext *sws = nullptr;
+  std::vector<CachedEncoder> encoders;
+
+  ~ImageCache() {
+    sws_freeContext(sws);
+    for (auto &e : encoders)
+      avcodec_free_context(&e.ctx);
+  }
+};
+static thread_local ImageCache cache;
+
+struct FreeCodecContext {
+  void operator()(AVCodecContext *ctx) { avcodec_free_context(&ctx); }
+};
+struct FreeFrame {
+  void operator()(AVFrame *frame) { av_frame_free(&frame); }
+};
+struct FreePacket {
+  void operator()(AVPacket *packet) { av_packet_free(&packet); }
+};
+
+static std::string ErrorString(int r) {
+  char msg[AV_ERROR_MAX_STRING_SIZE];
+  av_strerror(r, msg, sizeof(msg));
+  return msg;
+}
+
+static const AVCodec *FindImageCodec(const std::string &format) {
+  const AVCodec *codec;
+  if (format == "jpeg" || format == "jpg")
+    codec = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+  else if (format == "png")
+    codec = avcodec_find_encoder(AV_CODEC_ID_PNG);
+  else if (format == "webp")
+    codec = avcodec_find_encoder(AV_CODEC_ID_WEBP);
+  else
+    codec = avcodec_find_encoder_by_name(format.c_str());
+  if (codec == nullptr || codec->type != AVMEDIA_TYPE_VIDEO)
+    throw std::invalid_argument{"No image encoder for " + format};
+  return codec;
+}
+
+static AVPixelFormat BestPixelFormat(const AVCodec *codec, AVPixelFormat src) {
+  const void *formats = nullptr;
+  int count = 0;
+  if (avcodec_get_supported_config(nullptr, codec, AV_CODEC_CONFIG_PIX_FORMAT, 0, &formats, &count) < 0 ||
+      formats == nullptr)
+    return src;
+  return avcodec_find_best_pix_fmt_of_list(static_cast<const AVPixelFormat *>(formats), src, 0, nullptr);
+}
+
+static std::unique_ptr<AVCodecContext, FreeCodecContext> OpenEncoder(const AVCodec *codec, int width, int height,
+                                                                     AVPixelFormat pixelFormat, int quality) {
+  for (auto it = cache.encoders.begin(); it != cache.encoders.end(); it++) {
+    if (it->codec == codec && it->width == width && it->height == height && it->pixelFormat == pixelFormat &&
+        it->quality == quality) {
+      std::unique_ptr<AVCodecContext, FreeCodecContext> ctx{it->ctx};
+      cache.encoders.erase(it);
+      return ctx;
+    }
+  }
+
+  std::unique_ptr<AVCodecContext, FreeCodecContext> ctx{avcodec_alloc_context3(codec)};
+  if (!ctx)
+    throw std::bad_alloc{};
+  ctx->width = width;
+  ctx->height = height;
+  ctx->pix_fmt = pixelFormat;
+  ctx->time_base = {1, 25};
+  // Allows the limited range YUV formats with MJPEG
+  ctx->strict_std_compliance = FF_COMPLIANCE_UNOFFICIAL;
+  if (quality > 0) {
+    ctx->flags |= AV_CODEC_FLAG_QSCALE;
+    if (codec->id == AV_CODEC_ID_MJPEG)
+      // qscale goes from 2 (best) to 31 (worst)
+      ctx->global_quality = FF_QP2LAMBDA * (2 + (100 - std::min(quality, 100)) * 29 / 99);
+    else
+      ctx->global_quality = FF_QP2LAMBDA * std::min(quality, 100);
+  }
+  int r = avcodec_open2(ctx.get(), codec, nullptr);
+  if (r < 0)
+    throw std::runtime_error{"Failed opening the image encoder: " + ErrorString(r)};
+  return ctx;
+}
+
+static void ReleaseEncoder(std::unique_ptr<AVCodecContext, FreeCodecContext> ctx, int quality) {
+  if (cache.encoders.size() >= max_cached_encoders) {
+    avcodec_free_context(&cache.encoders.front().ctx);
+    cache.encoders.erase(cache.encoders.begin());
+  }
+  AVCodecContext *raw = ctx.release();
+  cache.encoders.push_back({raw->codec, raw->width, raw->height, raw->pix_fmt, quality, raw});
+}
+
+EncodedImage EncodeImage(VideoFrame &frame, const std::string &format, int width, int height, int quality) {
+  const AVFrame *src = frame.raw();
+  if (src == nullptr || src->data[0] == nullptr || src->width <= 0 || src->height <= 0)
+    throw std::invalid_argument{"Cannot encode an empty frame"};
+
+  const AVCodec *codec = FindImageCodec(format);
+  if (width <= 0 && height <= 0) {
+    width = src->width;
+    height = src->height;
+  } else if (width <= 0) {
+    width = std::max(static_cast<int>(av_rescale(src->width, height, src->height)), 1);
+  } else if (height <= 0) {
+    height = std::max(static_cast<int>(av_rescale(src->height, width, src->width)), 1);
+  }
+  AVPixelFormat srcFormat = static_cast<AVPixelFormat>(src->format);
+  AVPixelFormat pixelFormat = BestPixelFormat(codec, srcFormat);
+
+  const AVFrame *input = src;
+  std::unique_ptr<AVFrame, FreeFrame> scaled;
+  if (width != src->width || height != src->height || pixelFormat != srcFormat) {
+    cache.sws = sws_getCachedContext(cache.sws, src->width, src->height, srcFormat, width, height, pixelFormat,
+                                     SWS_BICUBIC, nullptr, nullptr, nullptr);
+    if (cache.sws == nullptr)
+      throw std::runtime_error{"Failed creating the scaler"};
+    scaled.reset(av_frame_alloc());
+    if (!scaled)
+      throw std::bad_alloc{};
+    scaled->format = pixelFormat;
+    scaled->width = width;
+    scaled->height = height;
+    if (av_frame_get_buffer(scaled.get(), 0) < 0)
+      throw std::bad_alloc{};
+    sws_scale(cache.sws, src->data, src->linesize, 0, src->height, scaled->data, scaled->linesize);
+    input = scaled.get();
+  }
+
+  auto ctx = OpenEncoder(codec, width, height, pixelFormat, quality);
+  // The intra-only encoders without delay produce the packet right away and
+  // they can be reused without being drained, the others are used only once
+  bool reusable = !(codec->capabilities & AV_CODEC_CAP_DELAY);
+  int r = avcodec_send_frame(ctx.get(), input);
+  if (r >= 0 && !reusable)
+    r = avcodec_send_frame(ctx.get(), nullptr);
+  if (r < 0)
+    throw std::runtime_error{"Failed encoding the image: " + ErrorString(r)};
+
+  std::unique_ptr<AVPacket, FreePacket> packet{av_packet_alloc()};
+  if (!packet)
+    throw std::bad_alloc{};
+  r = avcodec_receive_packet(ctx.get(), packet.get());
+  if (r < 0)
+    throw std::runtime_error{"Failed encoding the image: " + ErrorString(r)};
+
+  if (reusable)
+    ReleaseEncoder(std::move(ctx), quality);
+  // The packet data is reference counted and it is not reused by the encoder
+  return EncodedImage{packet.release()};
+}
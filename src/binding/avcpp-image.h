@@ -0,0 +1,67 @@
+#pragma once
+#include <frame.h>
+#include <packet.h>
+#include <string>
+#include <utility>
+
+#include <nobind.h>
+
+using namespace av;
+
+// An encoded image, it owns the packet produced by the encoder
+// and it is returned to JS as a Buffer that points to its data without copying
+class EncodedImage {
+  AVPacket *packet_;
+
+public:
+  EncodedImage() : packet_(nullptr) {}
+  explicit EncodedImage(AVPacket *packet) : packet_(packet) {}
+  EncodedImage(const EncodedImage &) = delete;
+  EncodedImage &operator=(const EncodedImage &) = delete;
+  EncodedImage(EncodedImage &&other) : packet_(other.packet_) { other.packet_ = nullptr; }
+  EncodedImage &operator=(EncodedImage &&other) {
+    std::swap(packet_, other.packet_);
+    return *this;
+  }
+  ~EncodedImage() { av_packet_free(&packet_); }
+
+  uint8_t *data() const { return packet_ ? packet_->data : nullptr; }
+  size_t size() const { return packet_ ? static_cast<size_t>(packet_->size) : 0; }
+};
+
+// Scales and encodes a frame to a still image in a single call
+//
+// format is the name of an image encoder or one of jpeg, png and webp
+// width and height are the output size, if only one is set the aspect ratio is preserved,
+// quality is from 1 to 100 for the lossy formats, 0 uses the encoder default
+//
+// The encoder contexts and the scaler are cached per thread and reused
+// by the next image of the same format and size
+EncodedImage EncodeImage(VideoFrame &frame, const std::string &format, int width, int height, int quality);
+
+namespace Nobind {
+namespace Typemap {
+
+template <const ReturnAttribute &RETATTR> class ToJS<EncodedImage, RETATTR> {
+  Napi::Env env_;
+  EncodedImage val_;
+
+public:
+  inline explicit ToJS(Napi::Env env, EncodedImage val) : env_(env), val_(std::move(val)) {}
+  inline Napi::Value Get() {
+    // Some alternative Node-API implementations (Electron for example) disallow external buffers
+#ifdef NODE_API_NO_EXTERNAL_BUFFERS_ALLOWED
+    return Napi::Buffer<uint8_t>::Copy(env_, val_.data(), val_.size());
+#else
+    // The packet is freed when the Buffer is collected
+    auto *image = new EncodedImage{std::move(val_)};
+    return Napi::Buffer<uint8_t>::New(
+        env_, image->data(), image->size(), [](Napi::Env, uint8_t *, EncodedImage *image) { delete image; }, image);
+#endif
+  }
+
+  static const std::string TSType() { return "Buffer"; };
+};
+
+} // namespace Typemap
+} // namespace Nobind
@@ -0,0 +1,89 @@
+#include "avcpp-info.h"
+
+PacketInfo GetPacketInfo(Packet &packet) {
+  const AVPacket *raw = packet.raw();
+  return PacketInfo{packet.isNull(),
+                    packet.isComplete(),
+                    (raw->flags & AV_PKT_FLAG_KEY) != 0,
+                    raw->flags,
+                    static_cast<size_t>(raw->size),
+                    raw->stream_index,
+                    raw->pts,
+                    raw->dts,
+                    raw->duration,
+                    packet.timeBase().getValue()};
+}
+
+VideoFrameInfo GetVideoFrameInfo(VideoFrame &frame) {
+  const AVFrame *raw = frame.raw();
+  return VideoFrameInfo{frame.isNull(),
+                        frame.isComplete(),
+                        frame.isValid(),
+                        frame.isKeyFrame(),
+                        frame.size(),
+                        frame.streamIndex(),
+                        raw->pts,
+                        frame.timeBase().getValue(),
+                        raw->width,
+                        raw->height,
+                        static_cast<AVPixelFormat>(raw->format),
+                        raw->pict_type};
+}
+
+AudioSamplesInfo GetAudioSamplesInfo(AudioSamples &samples) {
+  const AVFrame *raw = samples.raw();
+  return AudioSamplesInfo{samples.isNull(),
+                          samples.isComplete(),
+                          samples.isValid(),
+                          samples.size(),
+                          samples.streamIndex(),
+                          raw->pts,
+                          samples.timeBase().getValue(),
+                          raw->nb_samples,
+                          raw->sample_rate,
+                          static_cast<AVSampleFormat>(raw->format),
+                          raw->ch_layout.nb_channels};
+}
+
+const char *InfoTypeScriptFragment = "export interface PacketInfo {\n"
+                                     "  isNull: boolean;\n"
+                                     "  isComplete: boolean;\n"
+                                     "  isKeyPacket: boolean;\n"
+                                     "  flags: number;\n"
+                                     "  size: number;\n"
+                                     "  streamIndex: number;\n"
+                                     "  pts: number | null;\n"
+                                     "  dts: number | null;\n"
+                                     "  duration: number;\n"
+                                     "  timeBase: [number, number];\n"
+                                     "  seconds: number | null;\n"
+                                     "}\n"
+                                     "export interface VideoFrameInfo {\n"
+                                     "  isNull: boolean;\n"
+                                     "  isComplete: boolean;\n"
+                                     "  isValid: boolean;\n"
+                                     "  isKeyFrame: boolean;\n"
+                                     "  size: number;\n"
+                                     "  streamIndex: number;\n"
+                                     "  pts: number | null;\n"
+                                     "  timeBase: [number, number];\n"
+                                     "  seconds: number | null;\n"
+                                     "  width: number;\n"
+                                     "  height: number;\n"
+                                     "  pixelFormat: AVPixelFormat;\n"
+                                     "  pictureType: AVPictureType;\n"
+                                     "}\n"
+                                     "export interface AudioSamplesInfo {\n"
+                                     "  isNull: boolean;\n"
+                                     "  isComplete: boolean;\n"
+                                     "  isValid: boolean;\n"
+                                     "  size: number;\n"
+                                     "  streamIndex: number;\n"
+                                     "  pts: number | null;\n"
+                                     "  timeBase: [number, number];\n"
+                                     "  seconds: number | null;\n"
+                                     "  samplesCount: number;\n"
+                                     "  sampleRate: number;\n"
+                                     "  sampleFormat: AVSampleFormat;\n"
+                                     "  channelsCount: number;\n"
+                                     "}\n";
@@ -0,0 +1,168 @@
+#pragma once
+#include <frame.h>
+#include <nooverrides.h>
+#include <packet.h>
+
+#include <nobind.h>
+
+using namespace av;
+
+// These are snapshots of the properties of a Packet/VideoFrame/AudioSamples
+// that are retrieved with a single call and are returned to JS as plain objects
+//
+// Retrieving them one by one costs one binding call per property and the
+// Timestamp and Rational properties require creating new wrapped C++ objects
+struct PacketInfo {
+  bool isNull;
+  bool isComplete;
+  bool isKeyPacket;
+  int flags;
+  size_t size;
+  int streamIndex;
+  int64_t pts;
+  int64_t dts;
+  int64_t duration;
+  AVRational timeBase;
+};
+
+struct VideoFrameInfo {
+  bool isNull;
+  bool isComplete;
+  bool isValid;
+  bool isKeyFrame;
+  size_t size;
+  int streamIndex;
+  int64_t pts;
+  AVRational timeBase;
+  int width;
+  int height;
+  AVPixelFormat pixelFormat;
+  AVPictureType pictureType;
+};
+
+struct AudioSamplesInfo {
+  bool isNull;
+  bool isComplete;
+  bool isValid;
+  size_t size;
+  int streamIndex;
+  int64_t pts;
+  AVRational timeBase;
+  int samplesCount;
+  int sampleRate;
+  AVSampleFormat sampleFormat;
+  int channelsCount;
+};
+
+PacketInfo GetPacketInfo(Packet &packet);
+VideoFrameInfo GetVideoFrameInfo(VideoFrame &frame);
+AudioSamplesInfo GetAudioSamplesInfo(AudioSamples &samples);
+
+// The TypeScript definitions of the above objects
+extern const char *InfoTypeScriptFragment;
+
+namespace Nobind {
+namespace Typemap {
+
+namespace Info {
+// AV_NOPTS_VALUE is null
+inline Napi::Value Timestamp(Napi::Env env, int64_t ts) {
+  if (ts == AV_NOPTS_VALUE)
+    return env.Null();
+  return Napi::Number::New(env, static_cast<double>(ts));
+}
+
+inline Napi::Value Seconds(Napi::Env env, int64_t ts, const AVRational &tb) {
+  if (ts == AV_NOPTS_VALUE || tb.den == 0)
+    return env.Null();
+  return Napi::Number::New(env, static_cast<double>(ts) * tb.num / tb.den);
+}
+
+inline Napi::Value TimeBase(Napi::Env env, const AVRational &tb) {
+  auto r = Napi::Array::New(env, 2);
+  r.Set(0u, Napi::Number::New(env, tb.num));
+  r.Set(1u, Napi::Number::New(env, tb.den));
+  return r;
+}
+} // namespace Info
+
+template <const ReturnAttribute &RETATTR> class ToJS<PacketInfo, RETATTR> {
+  Napi::Env env_;
+  PacketInfo val_;
+
+public:
+  inline explicit ToJS(Napi::Env env, const PacketInfo &val) : env_(env), val_(val) {}
+  inline Napi::Value Get() {
+    auto r = Napi::Object::New(env_);
+    r.Set("isNull", Napi::Boolean::New(env_, val_.isNull));
+    r.Set("isComplete", Napi::Boolean::New(env_, val_.isComplete));
+    r.Set("isKeyPacket", Napi::Boolean::New(env_, val_.isKeyPacket));
+    r.Set("flags", Napi::Number::New(env_, val_.flags));
+    r.Set("size", Napi::Number::New(env_, static_cast<double>(val_.size)));
+    r.Set("streamIndex", Napi::Number::New(env_, val_.streamIndex));
+    r.Set("pts", Info::Timestamp(env_, val_.pts));
+    r.Set("dts", Info::Timestamp(env_, val_.dts));
+    r.Set("duration", Napi::Number::New(env_, static_cast<double>(val_.duration)));
+    r.Set("timeBase", Info::TimeBase(env_, val_.timeBase));
+    r.Set("seconds", Info::Seconds(env_, val_.pts, val_.timeBase));
+    return r;
+  }
+
+  static const std::string TSType() { return "PacketInfo"; };
+};
+
+template <const ReturnAttribute &RETATTR> class ToJS<VideoFrameInfo, RETATTR> {
+  Napi::Env env_;
+  VideoFrameInfo val_;
+
+public:
+  inline explicit ToJS(Napi::Env env, const VideoFrameInfo &val) : env_(env), val_(val) {}
+  inline Napi::Value Get() {
+    auto r = Napi::Object::New(env_);
+    r.Set("isNull", Napi::Boolean::New(env_, val_.isNull));
+    r.Set("isComplete", Napi::Boolean::New(env_, val_.isComplete));
+    r.Set("isValid", Napi::Boolean::New(env_, val_.isValid));
+    r.Set("isKeyFrame", Napi::Boolean::New(env_, val_.isKeyFrame));
+    r.Set("size", Napi::Number::New(env_, static_cast<double>(val_.size)));
+    r.Set("streamIndex", Napi::Number::New(env_, val_.streamIndex));
+    r.Set("pts", Info::Timestamp(env_, val_.pts));
+    r.Set("timeBase", Info::TimeBase(env_, val_.timeBase));
+    r.Set("seconds", Info::Seconds(env_, val_.pts, val_.timeBase));
+    r.Set("width", Napi::Number::New(env_, val_.width));
+    r.Set("height", Napi::Number::New(env_, val_.height));
+    r.Set("pixelFormat", Napi::Number::New(env_, val_.pixelFormat));
+    r.Set("pictureType", Napi::Number::New(env_, val_.pictureType));
+    return r;
+  }
+
+  static const std::string TSType() { return "VideoFrameInfo"; };
+};
+
+template <const ReturnAttribute &RETATTR> class ToJS<AudioSamplesInfo, RETATTR> {
+  Napi::Env env_;
+  AudioSamplesInfo val_;
+
+public:
+  inline explicit ToJS(Napi::Env env, const AudioSamplesInfo &val) : env_(env), val_(val) {}
+  inline Napi::Value Get() {
+    auto r = Napi::Object::New(env_);
+    r.Set("isNull", Napi::Boolean::New(env_, val_.isNull));
+    r.Set("isComplete", Napi::Boolean::New(env_, val_.isComplete));
+    r.Set("isValid", Napi::Boolean::New(env_, val_.isValid));
+    r.Set("size", Napi::Number::New(env_, static_cast<double>(val_.size)));
+    r.Set("streamIndex", Napi::Number::New(env_, val_.streamIndex));
+    r.Set("pts", Info::Timestamp(env_, val_.pts));
+    r.Set("timeBase", Info::TimeBase(env_, val_.timeBase));
+    r.Set("seconds", Info::Seconds(env_, val_.pts, val_.timeBase));
+    r.Set("samplesCount", Napi::Number::New(env_, val_.samplesCount));
+    r.Set("sampleRate", Napi::Number::New(env_, val_.sampleRate));
+    r.Set("sampleFormat", Napi::Number::New(env_, val_.sampleFormat));
+    r.Set("channelsCount", Napi::Number::New(env_, val_.channelsCount));
+    return r;
+  }
+
+  static const std::string TSType() { return "AudioSamplesInfo"; };
+};
+
+} // namespace Typemap
+} // namespace Nobind
@@ -0,0 +1,293 @@
+#include "avcpp-loudness.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+extern "C" {
+#include <libavutil/channel_layout.h>
+#include <libavutil/samplefmt.h>
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define LOUDNESS_SSE2
+#include <emmintrin.h>
+#endif
+
+// The samples of one channel converted to float, reused by each thread
+static thread_local std::vector<float> scratch;
+
+template <typename T> static void Convert(const uint8_t *data, int stride, int n, float scale, float offset) {
+  const T *src = reinterpret_cast<const T *>(data);
+  for (int i = 0; i < n; i++)
+    scratch[i] = (static_cast<float>(src[i * stride]) - offset) * scale;
+}
+
+// Converts one channel to float in [-1, 1]
+static const float *ChannelToFloat(const AVFrame *raw, int ch) {
+  AVSampleFormat format = static_cast<AVSampleFormat>(raw->format);
+  bool planar = av_sample_fmt_is_planar(format);
+  int channels = raw->ch_layout.nb_channels;
+  int n = raw->nb_samples;
+  int stride = planar ? 1 : channels;
+  const uint8_t *data =
+      planar ? raw->extended_data[ch] : raw->extended_data[0] + static_cast<size_t>(ch) * av_get_bytes_per_sample(format);
+
+  // Planar float is used as it is
+  if (format == AV_SAMPLE_FMT_FLTP)
+    return reinterpret_cast<const float *>(data);
+
+  scratch.resize(n);
+  switch (av_get_packed_sample_fmt(format)) {
+  case AV_SAMPLE_FMT_U8:
+    Convert<uint8_t>(data, stride, n, 1.0f / 128, 128);
+    break;
+  case AV_SAMPLE_FMT_S16:
+    Convert<int16_t>(data, stride, n, 1.0f / 32768, 0);
+    break;
+  case AV_SAMPLE_FMT_S32:
+    Convert<int32_t>(data, stride, n, 1.0f / 2147483648.0f, 0);
+    break;
+  case AV_SAMPLE_FMT_S64:
+    Convert<int64_t>(data, stride, n, 1.0f / 9223372036854775808.0f, 0);
+    break;
+  case AV_SAMPLE_FMT_FLT:
+    Convert<float>(data, stride, n, 1, 0);
+    break;
+  case AV_SAMPLE_FMT_DBL:
+    Convert<double>(data, stride, n, 1, 0);
+    break;
+  default:
+    throw std::invalid_argument{"Unsupported sample format"};
+  }
+  return scratch.data();
+}
+
+// Peak and sum of squares
+static void PeakAndSquares(const float *p, int n, double &peak, double &squares) {
+  int i = 0;
+  float max = 0;
+  double sum = 0;
+#ifdef LOUDNESS_SSE2
+  const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  __m128 vmax = _mm_setzero_ps();
+  __m128d vsum = _mm_setzero_pd();
+  for (; i + 4 <= n; i += 4) {
+    __m128 v = _mm_loadu_ps(p + i);
+    vmax = _mm_max_ps(vmax, _mm_and_ps(v, abs_mask));
+    __m128 sq = _mm_mul_ps(v, v);
+    // Accumulate in double precision, a long block of float squares loses precision
+    vsum = _mm_add_pd(vsum, _mm_cvtps_pd(sq));
+    vsum = _mm_add_pd(vsum, _mm_cvtps_pd(_mm_movehl_ps(sq, sq)));
+  }
+  float maxes[4];
+  double sums[2];
+  _mm_storeu_ps(maxes, vmax);
+  _mm_storeu_pd(sums, vsum);
+  max = std::max(std::max(maxes[0], maxes[1]), std::max(maxes[2], maxes[3]));
+  sum = sums[0] + sums[1];
+#endif
+  for (; i < n; i++) {
+    max = std::max(max, std::fabs(p[i]));
+    sum += static_cast<double>(p[i]) * p[i];
+  }
+  peak = std::max(peak, static_cast<double>(max));
+  squares += sum;
+}
+
+static const AVFrame *CheckSamples(AudioSamples &samples) {
+  const AVFrame *raw = samples.raw();
+  if (raw == nullptr || raw->extended_data == nullptr || raw->ch_layout.nb_channels <= 0)
+    throw std::invalid_argument{"Empty samples"};
+  return raw;
+}
+
+TypedVector<double> AudioSamplesLevels(AudioSamples &samples) {
+  const AVFrame *raw = CheckSamples(samples);
+  int channels = raw->ch_layout.nb_channels;
+  TypedVector<double> r(2 * channels, 0);
+  for (int ch = 0; ch < channels; ch++) {
+    double peak = 0, squares = 0;
+    if (raw->nb_samples > 0)
+      PeakAndSquares(ChannelToFloat(raw, ch), raw->nb_samples, peak, squares);
+    r[2 * ch] = peak;
+    r[2 * ch + 1] = raw->nb_samples > 0 ? std::sqrt(squares / raw->nb_samples) : 0;
+  }
+  return r;
+}
+
+static double Loudness(double energy) {
+  if (energy <= 0)
+    return -std::numeric_limits<double>::infinity();
+  return -0.691 + 10 * std::log10(energy);
+}
+
+constexpr double pi = 3.14159265358979323846;
+
+LoudnessMeter::LoudnessMeter(int sampleRate, int channels) : sample_rate{sampleRate}, channels{channels} {
+  if (sampleRate <= 0 || channels <= 0)
+    throw std::invalid_argument{"Invalid sample rate or number of channels"};
+
+  // The K-weighting filter for an arbitrary sample rate, ITU BS.1770
+  // The coefficients are computed in the same way as in libebur128
+  double f0 = 1681.974450955533;
+  double G = 3.999843853973347;
+  double Q = 0.7071752369554196;
+  double K = std::tan(pi * f0 / sampleRate);
+  double Vh = std::pow(10.0, G / 20.0);
+  double Vb = std::pow(Vh, 0.4996667741545416);
+  double a0 = 1.0 + K / Q + K * K;
+  shelf = {(Vh + Vb * K / Q + K * K) / a0, 2.0 * (K * K - Vh) / a0, (Vh - Vb * K / Q + K * K) / a0,
+           2.0 * (K * K - 1.0) / a0, (1.0 - K / Q + K * K) / a0};
+
+  f0 = 38.13547087602444;
+  Q = 0.5003270373238773;
+  K = std::tan(pi * f0 / sampleRate);
+  a0 = 1.0 + K / Q + K * K;
+  highpass = {1.0, -2.0, 1.0, 2.0 * (K * K - 1.0) / a0, (1.0 - K / Q + K * K) / a0};
+
+  block_size = sampleRate / 10;
+  reset();
+}
+
+// The LFE channels are not counted and the surround channels have a +1.5dB gain,
+// the channels of an unspecified layout all have the same weight
+static std::vector<double> ChannelWeights(const AVChannelLayout &layout) {
+  std::vector<double> weights(layout.nb_channels, 1.0);
+  for (int ch = 0; ch < layout.nb_channels; ch++) {
+    switch (av_channel_layout_channel_from_index(&layout, ch)) {
+    case AV_CHAN_LOW_FREQUENCY:
+    case AV_CHAN_LOW_FREQUENCY_2:
+      weights[ch] = 0;
+      break;
+    case AV_CHAN_SIDE_LEFT:
+    case AV_CHAN_SIDE_RIGHT:
+    case AV_CHAN_BACK_LEFT:
+    case AV_CHAN_BACK_RIGHT:
+      weights[ch] = 1.41;
+      break;
+    default:
+      break;
+    }
+  }
+  return weights;
+}
+
+void LoudnessMeter::reset() {
+  state.assign(8 * channels, 0);
+  block_energy.assign(channels, 0);
+  block_samples = 0;
+  subblocks.fill(0);
+  subblocks_count = 0;
+  gating_energy.fill(0);
+  gating_count.fill(0);
+  peak = 0;
+}
+
+// The mean energy of the last n sub-blocks
+double LoudnessMeter::Energy(size_t n) const {
+  if (subblocks_count < n)
+    return 0;
+  double sum = 0;
+  for (size_t i = 0; i < n; i++)
+    sum += subblocks[(subblocks_count - 1 - i) % history];
+  return sum / n;
+}
+
+void LoudnessMeter::CloseSubBlock() {
+  double energy = 0;
+  for (int ch = 0; ch < channels; ch++) {
+    energy += weights[ch] * block_energy[ch] / block_samples;
+    block_energy[ch] = 0;
+  }
+  subblocks[subblocks_count % history] = energy;
+  subblocks_count++;
+  block_samples = 0;
+
+  // 400ms gating blocks with 75% overlap
+  double momentary = Energy(4);
+  double loudness = Loudness(momentary);
+  if (loudness >= -70) {
+    size_t bin = std::min(static_cast<size_t>((loudness + 70) * 10), bins - 1);
+    gating_energy[bin] += momentary;
+    gating_count[bin]++;
+  }
+}
+
+void LoudnessMeter::add(AudioSamples &samples) {
+  const AVFrame *raw = CheckSamples(samples);
+  if (raw->ch_layout.nb_channels != channels || raw->sample_rate != sample_rate)
+    throw std::invalid_argument{"The samples do not match the meter"};
+  if (weights.empty())
+    weights = ChannelWeights(raw->ch_layout);
+
+  // The sub-block boundaries within these samples
+  std::vector<int> bounds;
+  for (int pos = 0, filled = static_cast<int>(block_samples); pos < raw->nb_samples;) {
+    int n = std::min(raw->nb_samples - pos, static_cast<int>(block_size) - filled);
+    pos += n;
+    filled = (filled + n) % static_cast<int>(block_size);
+    bounds.push_back(pos);
+  }
+
+  // Each channel is converted once and filtered across all the sub-blocks
+  std::vector<double> energy(bounds.size() * channels, 0);
+  for (int ch = 0; ch < channels; ch++) {
+    const float *p = ChannelToFloat(raw, ch);
+    double *s = &state[8 * ch];
+    int i = 0;
+    for (size_t k = 0; k < bounds.size(); k++) {
+      double e = 0;
+      for (; i < bounds[k]; i++) {
+        double x = p[i];
+        peak = std::max(peak, std::fabs(x));
+        // Two Direct Form I biquads in series
+        double y = shelf.b0 * x + shelf.b1 * s[0] + shelf.b2 * s[1] - shelf.a1 * s[2] - shelf.a2 * s[3];
+        s[1] = s[0];
+        s[0] = x;
+        s[3] = s[2];
+        s[2] = y;
+        double z = highpass.b0 * y + highpass.b1 * s[4] + highpass.b2 * s[5] - highpass.a1 * s[6] - highpass.a2 * s[7];
+        s[5] = s[4];
+        s[4] = y;
+        s[7] = s[6];
+        s[6] = z;
+        e += z * z;
+      }
+      energy[k * channels + ch] = e;
+    }
+  }
+
+  for (size_t k = 0; k < bounds.size(); k++) {
+    for (int ch = 0; ch < channels; ch++)
+      block_energy[ch] += energy[k * channels + ch];
+    block_samples += bounds[k] - (k > 0 ? bounds[k - 1] : 0);
+    if (block_samples == block_size)
+      CloseSubBlock();
+  }
+}
+
+TypedVector<double> LoudnessMeter::result() const {
+  // Absolute gate at -70 LUFS, then relative gate at -10 LU
+  double sum = 0;
+  uint64_t count = 0;
+  for (size_t i = 0; i < bins; i++) {
+    sum += gating_energy[i];
+    count += gating_count[i];
+  }
+  double integrated = -std::numeric_limits<double>::infinity();
+  if (count > 0) {
+    double gate = Loudness(sum / count) - 10;
+    size_t first = gate < -70 ? 0 : std::min(static_cast<size_t>((gate + 70) * 10), bins - 1);
+    sum = 0;
+    count = 0;
+    for (size_t i = first; i < bins; i++) {
+      sum += gating_energy[i];
+      count += gating_count[i];
+    }
+    if (count > 0)
+      integrated = Loudness(sum / count);
+  }
+
+  return TypedVector<double>{Loudness(Energy(4)), Loudness(Energy(30)), integrated, peak};
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "avcpp-analysis.h"
+#include <array>
+#include <frame.h>
+#include <vector>
+
+using namespace av;
+
+// [ peak, RMS ] of each channel, linear with 1.0 being the full scale
+// Supports all sample formats, planar and interleaved
+TypedVector<double> AudioSamplesLevels(AudioSamples &samples);
+
+// A running EBU R128 / ITU BS.1770 loudness meter
+//
+// Momentary (400ms), short-term (3s) and gated integrated loudness
+// The integrated loudness uses a histogram with 0.1 LU bins
+// and its memory use does not grow with the duration of the stream
+class LoudnessMeter {
+  struct Biquad {
+    double b0, b1, b2, a1, a2;
+  };
+  // 100ms sub-blocks
+  static constexpr size_t history = 30;
+  static constexpr size_t bins = 1000;
+
+  int sample_rate;
+  int channels;
+  Biquad shelf, highpass;
+  // The channel weights, set from the channel layout of the first samples
+  std::vector<double> weights;
+  // Filter state, 4 values per channel and per stage
+  std::vector<double> state;
+  // Current sub-block
+  std::vector<double> block_energy;
+  size_t block_samples;
+  size_t block_size;
+  // Ring buffer of the mean weighted energy of the last sub-blocks
+  std::array<double, history> subblocks;
+  size_t subblocks_count;
+  // Gating histogram of the 400ms blocks
+  std::array<double, bins> gating_energy;
+  std::array<uint64_t, bins> gating_count;
+  double peak;
+
+  double Energy(size_t n) const;
+  void CloseSubBlock();
+
+public:
+  LoudnessMeter(int sampleRate, int channels);
+
+  // Add the samples to the meter, their sample rate and number of channels must match
+  // The channel layout of the first samples determines the weights of the channels
+  void add(AudioSamples &samples);
+  // [ momentary LUFS, short-term LUFS, integrated LUFS, sample peak ]
+  // -Infinity when there is not enough data
+  TypedVector<double> result() const;
+  void reset();
+};
@@ -0,0 +1,226 @@
+#include "avcpp-memory.h"
+#include "debug.h"
+#include "instance-data.h"
+#include <nobind.h>
+#include <set>
+
+namespace Memory {
+
+// Bytes held by the tracked frames and packets
+static std::atomic<int64_t> live{0};
+
+// Bytes tracked by one JS thread, each environment (the main thread or a worker)
+// reports only its own bytes to its V8 isolate
+// It is shared with the trackers because the buffers can be freed
+// in another thread after the JS thread has exited
+struct Account {
+  std::atomic<int64_t> bytes{0};
+};
+static thread_local std::shared_ptr<Account> account;
+
+static Account &CurrentAccount() {
+  if (!account)
+    account = std::make_shared<Account>();
+  return *account;
+}
+
+// The opaque of the tracker buffer
+struct Tracker {
+  std::shared_ptr<Account> account;
+  int64_t size;
+};
+// 0 is unlimited
+static std::atomic<int64_t> budget{0};
+
+// The environments that have waiting Promises
+static std::mutex registry_lock;
+static std::set<Waiters *> registry;
+static std::atomic<size_t> waiting{0};
+
+// Recheck interval when waiting
+constexpr uint64_t recheck_interval = 50;
+
+static inline bool OverBudget() {
+  int64_t limit = budget.load(std::memory_order_relaxed);
+  return limit > 0 && live.load(std::memory_order_relaxed) >= limit;
+}
+
+// The free callback of the tracker, it can be called from any thread
+static void Release(void *opaque, uint8_t *) {
+  Tracker *tracker = reinterpret_cast<Tracker *>(opaque);
+  tracker->account->bytes.fetch_sub(tracker->size, std::memory_order_relaxed);
+  live.fetch_sub(tracker->size, std::memory_order_relaxed);
+  delete tracker;
+  if (waiting.load(std::memory_order_relaxed) > 0 && !OverBudget()) {
+    std::lock_guard lk{registry_lock};
+    for (auto *w : registry)
+      uv_async_send(w->release_callback);
+  }
+}
+
+// Called from the JS thread that tracks the object
+static void Attach(AVBufferRef **opaque_ref, size_t size) {
+  if (*opaque_ref != nullptr || size == 0)
+    return;
+  CurrentAccount();
+  Tracker *tracker = new Tracker{account, static_cast<int64_t>(size)};
+  *opaque_ref = av_buffer_create(nullptr, 0, Release, reinterpret_cast<void *>(tracker), 0);
+  if (*opaque_ref == nullptr) {
+    delete tracker;
+    return;
+  }
+  tracker->account->bytes.fetch_add(tracker->size, std::memory_order_relaxed);
+  live.fetch_add(tracker->size, std::memory_order_relaxed);
+}
+
+static size_t FrameSize(const AVFrame *frame) {
+  size_t size = 0;
+  for (size_t i = 0; i < AV_NUM_DATA_POINTERS; i++)
+    if (frame->buf[i] != nullptr)
+      size += frame->buf[i]->size;
+  for (int i = 0; i < frame->nb_extended_buf; i++)
+    size += frame->extended_buf[i]->size;
+  return size;
+}
+
+void TrackVideoFrame(VideoFrame &frame) {
+  AVFrame *raw = frame.raw();
+  if (raw != nullptr)
+    Attach(&raw->opaque_ref, FrameSize(raw));
+}
+
+void TrackAudioSamples(AudioSamples &samples) {
+  AVFrame *raw = samples.raw();
+  if (raw != nullptr)
+    Attach(&raw->opaque_ref, FrameSize(raw));
+}
+
+void TrackPacket(Packet &packet) {
+  AVPacket *raw = packet.raw();
+  if (raw != nullptr && raw->buf != nullptr)
+    Attach(&raw->opaque_ref, raw->buf->size);
+}
+
+// JS thread of the environment only, reports the bytes tracked by this environment
+static void Report(Waiters *w) {
+  int64_t now = CurrentAccount().bytes.load(std::memory_order_relaxed);
+  if (now != w->reported) {
+    Napi::MemoryManagement::AdjustExternalMemory(w->env, now - w->reported);
+    w->reported = now;
+  }
+}
+
+static void Unregister(Waiters *w) {
+  std::lock_guard lk{registry_lock};
+  if (registry.erase(w) > 0) {
+    waiting--;
+    uv_timer_stop(w->timer);
+  }
+}
+
+// Resolves the waiting Promises if the memory has fallen below the budget
+static void Wake(Waiters *w) {
+  Napi::HandleScope scope{w->env};
+  Report(w);
+  if (w->deferred.empty() || OverBudget())
+    return;
+
+  verbose("Memory: %ld bytes used, resolving %lu waiters\n", static_cast<long>(live.load()), w->deferred.size());
+  Unregister(w);
+  // The Promise continuations run when this scope closes
+  Napi::CallbackScope callback_scope{w->env, w->async_context};
+  std::vector<Napi::Promise::Deferred> deferred;
+  std::swap(deferred, w->deferred);
+  for (auto &d : deferred)
+    d.Resolve(w->env.Undefined());
+}
+
+Waiters::Waiters(Napi::Env env) : env{env}, async_context{env, "ffmpeg_Memory"}, reported{0} {
+  uv_loop_t *event_loop;
+  napi_get_uv_event_loop(env, &event_loop);
+
+  release_callback = new uv_async_t;
+  uv_async_init(event_loop, release_callback, [](uv_async_t *async) {
+    if (async->data != nullptr)
+      Wake(reinterpret_cast<Waiters *>(async->data));
+  });
+  release_callback->data = this;
+  uv_unref(reinterpret_cast<uv_handle_t *>(release_callback));
+
+  // The timer keeps the event loop alive while there are waiting Promises
+  timer = new uv_timer_t;
+  uv_timer_init(event_loop, timer);
+  timer->data = this;
+}
+
+Waiters::~Waiters() {
+  Unregister(this);
+  release_callback->data = nullptr;
+  timer->data = nullptr;
+  uv_close(reinterpret_cast<uv_handle_t *>(release_callback),
+           [](uv_handle_t *async) { delete (reinterpret_cast<uv_async_t *>(async)); });
+  uv_close(reinterpret_cast<uv_handle_t *>(timer),
+           [](uv_handle_t *timer) { delete (reinterpret_cast<uv_timer_t *>(timer)); });
+}
+
+static Waiters *Get(Napi::Env env) {
+  auto instance_data = env.GetInstanceData<Nobind::EnvInstanceData<ffmpegInstanceData>>();
+  if (!instance_data->memory)
+    instance_data->memory = std::make_shared<Waiters>(env);
+  return instance_data->memory.get();
+}
+
+Napi::Value Usage(const Napi::CallbackInfo &info) {
+  Report(Get(info.Env()));
+  return Napi::Number::New(info.Env(), static_cast<double>(live.load(std::memory_order_relaxed)));
+}
+
+void SetBudget(const Napi::CallbackInfo &info) {
+  if (info.Length() != 1 || !info[0].IsNumber())
+    throw Napi::TypeError::New(info.Env(), "budget must be a number");
+  int64_t limit = info[0].ToNumber().Int64Value();
+  budget = limit > 0 ? limit : 0;
+  Wake(Get(info.Env()));
+}
+
+Napi::Value WaitForMemory(const Napi::CallbackInfo &info) {
+  Napi::Env env{info.Env()};
+  Waiters *w = Get(env);
+  Report(w);
+  if (!OverBudget())
+    return env.Null();
+
+  verbose("Memory: %ld bytes used, over budget, waiting\n", static_cast<long>(live.load()));
+  w->deferred.push_back(Napi::Promise::Deferred::New(env));
+  Napi::Promise promise = w->deferred.back().Promise();
+  std::lock_guard lk{registry_lock};
+  if (registry.insert(w).second) {
+    waiting++;
+    uv_timer_start(
+        w->timer,
+        [](uv_timer_t *timer) {
+          if (timer->data != nullptr)
+            Wake(reinterpret_cast<Waiters *>(timer->data));
+        },
+        recheck_interval, recheck_interval);
+  }
+  return promise;
+}
+
+const char *TypeScriptFragment = R"(
+/**
+ * Bytes held by the tracked frames and packets in the whole process
+ */
+export function memoryUsage(): number;
+/**
+ * Set a process-wide budget in bytes for the tracked frames and packets, 0 disables it
+ */
+export function setMemoryBudget(bytes: number): void;
+/**
+ * Returns null if the memory usage is below the budget,
+ * otherwise returns a Promise that resolves when it falls below it
+ */
+export function waitForMemory(): Promise<void> | null;
+)";
+
+} // namespace Memory
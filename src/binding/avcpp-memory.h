@@ -0,0 +1,55 @@
+#pragma once
+#include <frame.h>
+#include <napi.h>
+#include <packet.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <uv.h>
+#include <vector>
+
+using namespace av;
+
+// Accounting of the native memory held by the frames and the packets
+//
+// V8 does not see the native buffers and the object-based highWaterMark
+// of the streams does not bound their size - a tracked frame or packet
+// counts its buffer bytes until the last reference to it is freed.
+// The count is process-wide for the budget, every environment reports
+// to V8 only the bytes that it has tracked so that it can take them into
+// account when scheduling the GC.
+//
+// The tracker is an AVBufferRef in opaque_ref that ffmpeg copies along with
+// the other properties, a frame that already has an opaque_ref is not tracked.
+namespace Memory {
+
+void TrackVideoFrame(VideoFrame &frame);
+void TrackAudioSamples(AudioSamples &samples);
+void TrackPacket(Packet &packet);
+
+// The per-environment Promises waiting for memory to be released
+struct Waiters {
+  Napi::Env env;
+  Napi::AsyncContext async_context;
+  std::vector<Napi::Promise::Deferred> deferred;
+  // The memory of this environment last reported to V8
+  int64_t reported;
+  // Wakes up the main thread when memory is released
+  uv_async_t *release_callback;
+  // Rechecks periodically, the memory is freed by the GC which
+  // may not run if the event loop is idle
+  uv_timer_t *timer;
+
+  Waiters(Napi::Env env);
+  ~Waiters();
+};
+
+// The JS functions
+Napi::Value Usage(const Napi::CallbackInfo &info);
+void SetBudget(const Napi::CallbackInfo &info);
+Napi::Value WaitForMemory(const Napi::CallbackInfo &info);
+
+extern const char *TypeScriptFragment;
+
+} // namespace Memory
@@ -14,8 +14,22 @@
 
 #include <nobind.h>
 
+#include "avcpp-abort.h"
+#include "avcpp-analysis.h"
+#include "avcpp-codec.h"
 #include "avcpp-customio.h"
+#include "avcpp-executor.h"
+#include "avcpp-filter.h"
 #include "avcpp-frame.h"
+#include "avcpp-framepool.h"
+#include "avcpp-image.h"
+#include "avcpp-info.h"
+#include "avcpp-loudness.h"
+#include "avcpp-memory.h"
+#include "avcpp-packet.h"
+#include "avcpp-parameters.h"
+#include "avcpp-stats.h"
+#include "avcpp-transfer.h"
 #include "avcpp-types.h"
 #include "instance-data.h"
 
@@ -88,6 +102,8 @@ NOBIND_MODULE_DATA(ffmpeg, m, ffmpegInstanceData) {
   m.typescript_fragment("export type AVMediaType = " + Nobind::Typemap::FromJS<AVMediaType>::TSType() + ";\n");
   m.typescript_fragment("export type AVPixelFormat = " + Nobind::Typemap::FromJS<AVPixelFormat>::TSType() + ";\n");
   m.typescript_fragment("export type AVSampleFormat = " + Nobind::Typemap::FromJS<AVSampleFormat>::TSType() + ";\n");
+  m.typescript_fragment(InfoTypeScriptFragment);
+  m.typescript_fragment(StreamParametersTypeScriptFragment);
 
 // Some important constants
 #include "constants"
@@ -96,6 +112,11 @@ NOBIND_MODULE_DATA(ffmpeg, m, ffmpegInstanceData) {
   m.def<static_cast<Codec (*)(AVCodecID)>(&findEncodingCodec)>(WASYNC("findEncodingCodec"));
   m.def<static_cast<Codec (*)(AVCodecID)>(&findDecodingCodec)>(WASYNC("findDecodingCodec"));
 
+  m.def<AbortToken>("AbortToken")
+      .cons<>()
+      .def<&AbortToken::abort>("abort")
+      .def<&AbortToken::aborted>("aborted");
+
   m.def<FormatContext>("FormatContext")
       .cons<>()
       // Overloaded methods must be cast to be resolved
@@ -106,7 +127,18 @@ NOBIND_MODULE_DATA(ffmpeg, m, ffmpegInstanceData) {
       .def<static_cast<void (FormatContext::*)(CustomIO *, InputFormat, OptionalErrorCode, size_t)>(
                &FormatContext::openInput),
            Nobind::ReturnAsync>("openWritableAsync")
+      // The sync versions can be used only with a synchronous CustomIO
+      .def<static_cast<void (FormatContext::*)(CustomIO *, InputFormat, OptionalErrorCode, size_t)>(
+          &FormatContext::openInput)>("openWritable")
       .def<&FormatContext::close>(WASYNC("close"))
+      .ext<&SetFormatContextOption>("setOption")
+      .ext<&AddInputStreams>("addInputStreams")
+      .ext<&ReadFrame>("readFrame")
+      .typescript_fragment("  readFrameAsync(): Promise<Packet>;\n")
+      .ext<&SeekFormatContext>("seek")
+      .typescript_fragment("  seekAsync(streamIndex: number, timestamp: number): Promise<void>;\n")
+      // Interrupts the blocking I/O once the token is aborted
+      .ext<&SetAbortToken>("setAbortToken")
       .def<static_cast<void (FormatContext::*)(OptionalErrorCode)>(&FormatContext::findStreamInfo)>(
           WASYNC("findStreamInfo"))
       .def<&FormatContext::streamsCount>(WASYNC("streamsCount"))
@@ -122,6 +154,8 @@ NOBIND_MODULE_DATA(ffmpeg, m, ffmpegInstanceData) {
           &FormatContext::openOutput)>(WASYNC("openOutputOptions"))
       .def<static_cast<void (FormatContext::*)(CustomIO *, OptionalErrorCode, size_t)>(&FormatContext::openOutput),
            Nobind::ReturnAsync>("openReadableAsync")
+      .def<static_cast<void (FormatContext::*)(CustomIO *, OptionalErrorCode, size_t)>(&FormatContext::openOutput)>(
+          "openReadable")
       .def<static_cast<Stream (FormatContext::*)(const VideoEncoderContext &, OptionalErrorCode)>(
           &FormatContext::addStream)>(WASYNC("addVideoStream"))
       .def<static_cast<Stream (FormatContext::*)(const AudioEncoderContext &, OptionalErrorCode)>(
@@ -136,6 +170,8 @@ NOBIND_MODULE_DATA(ffmpeg, m, ffmpegInstanceData) {
       .def<static_cast<void (FormatContext::*)(const Packet &, OptionalErrorCode)>(&FormatContext::writePacket)>(
           WASYNC("writePacket"))
       .def<&FormatContext::writeTrailer>(WASYNC("writeTrailer"));
+  m.def<&SeekFormatContext, Nobind::ReturnAsync>("_seekAsync");
+  m.def<&ReadFrame, Nobind::ReturnAsync>("_readFrameAsync");
 
   m.def<VideoDecoderContext, CodecContext2>("VideoDecoderContext")
       .cons<const Stream &>()
@@ -164,7 +200,8 @@ NOBIND_MODULE_DATA(ffmpeg, m, ffmpegInstanceData) {
       .def<static_cast<void (av::CodecContext2::*)(Dictionary &, const Codec &, OptionalErrorCode)>(
           &VideoDecoderContext::open)>(WASYNC("openCodecOptions"))
       .def<static_cast<VideoFrame (VideoDecoderContext::*)(const Packet &, OptionalErrorCode, bool)>(
-          &VideoDecoderContext::decode)>(WASYNC("decode"));
+          &VideoDecoderContext::decode)>(WASYNC("decode"))
+      .ext<&FlushCodecContext<VideoDecoderContext>>("flush");
 
   m.def<VideoEncoderContext, CodecContext2>("VideoEncoderContext")
       .cons<>()
@@ -190,10 +227,18 @@ NOBIND_MODULE_DATA(ffmpeg, m, ffmpegInstanceData) {
           WASYNC("openCodec"))
       .def<static_cast<void (av::CodecContext2::*)(Dictionary &, const Codec &, OptionalErrorCode)>(
           &VideoEncoderContext::open)>(WASYNC("openCodecOptions"))
+      .def<static_cast<void (av::CodecContext2::*)(OptionalErrorCode)>(&VideoEncoderContext::close)>(WASYNC("close"))
       .def<static_cast<Packet (VideoEncoderContext::*)(const VideoFrame &, OptionalErrorCode)>(
           &VideoEncoderContext::encode)>(WASYNC("encode"))
       .def<static_cast<Packet (VideoEncoderContext::*)(OptionalErrorCode)>(&VideoEncoderContext::encode)>(
-          WASYNC("finalize"));
+          WASYNC("finalize"))
+      .ext<&FlushCodecContext<VideoEncoderContext>>("flush")
+      .ext<&EncodeBatch<VideoEncoderContext, VideoFrame>>("encodeBatch")
+      .ext<&FinalizeBatch<VideoEncoderContext>>("finalizeBatch")
+      .typescript_fragment("  encodeBatchAsync(frames: VideoFrame[]): Promise<Packet[]>;\n")
+      .typescript_fragment("  finalizeBatchAsync(): Promise<Packet[]>;\n");
+  m.def<&EncodeBatch<VideoEncoderContext, VideoFrame>, Nobind::ReturnAsync>("_encodeVideoBatchAsync");
+  m.def<&FinalizeBatch<VideoEncoderContext>, Nobind::ReturnAsync>("_finalizeVideoBatchAsync");
 
   m.def<AudioDecoderContext, CodecContext2>("AudioDecoderContext")
       .cons<const Stream &>()
@@ -222,7 +267,8 @@ NOBIND_MODULE_DATA(ffmpeg, m, ffmpegInstanceData) {
       .def<static_cast<void (av::CodecContext2::*)(Dictionary &, const Codec &, OptionalErrorCode)>(
           &AudioDecoderContext::open)>(WASYNC("openCodecOptions"))
       .def<static_cast<AudioSamples (AudioDecoderContext::*)(const Packet &, OptionalErrorCode)>(
-          &AudioDecoderContext::decode)>(WASYNC("decode"));
+          &AudioDecoderContext::decode)>(WASYNC("decode"))
+      .ext<&FlushCodecContext<AudioDecoderContext>>("flush");
 
   m.def<AudioEncoderContext, CodecContext2>("AudioEncoderContext")
       .cons<>()
@@ -250,10 +296,18 @@ NOBIND_MODULE_DATA(ffmpeg, m, ffmpegInstanceData) {
           WASYNC("openCodec"))
       .def<static_cast<void (av::CodecContext2::*)(Dictionary &, const Codec &, OptionalErrorCode)>(
           &AudioEncoderContext::open)>(WASYNC("openCodecOptions"))
+      .def<static_cast<void (av::CodecContext2::*)(OptionalErrorCode)>(&AudioEncoderContext::close)>(WASYNC("close"))
       .def<static_cast<Packet (AudioEncoderContext::*)(const AudioSamples &, OptionalErrorCode)>(
           &AudioEncoderContext::encode)>(WASYNC("encode"))
       .def<static_cast<Packet (AudioEncoderContext::*)(OptionalErrorCode)>(&AudioEncoderContext::encode)>(
-          WASYNC("finalize"));
+          WASYNC("finalize"))
+      .ext<&FlushCodecContext<AudioEncoderContext>>("flush")
+      .ext<&EncodeBatch<AudioEncoderContext, AudioSamples>>("encodeBatch")
+      .ext<&FinalizeBatch<AudioEncoderContext>>("finalizeBatch")
+      .typescript_fragment("  encodeBatchAsync(samples: AudioSamples[]): Promise<Packet[]>;\n")
+      .typescript_fragment("  finalizeBatchAsync(): Promise<Packet[]>;\n");
+  m.def<&EncodeBatch<AudioEncoderContext, AudioSamples>, Nobind::ReturnAsync>("_encodeAudioBatchAsync");
+  m.def<&FinalizeBatch<AudioEncoderContext>, Nobind::ReturnAsync>("_finalizeAudioBatchAsync");
 
   m.def<OutputFormat>("OutputFormat")
       .cons<>()
@@ -321,9 +375,13 @@ NOBIND_MODULE_DATA(ffmpeg, m, ffmpegInstanceData) {
       .def<&Stream::setTimeBase>(WASYNC("setTimeBase"))
       .def<&Stream::mediaType>(WASYNC("mediaType"))
       .def<&Stream::codecParameters>(WASYNC("codecParameters"))
-      .def<&Stream::setCodecParameters>(WASYNC("setCodecParameters"));
+      .def<&Stream::setCodecParameters>(WASYNC("setCodecParameters"))
+      .ext<&GetStreamParameters>("parameters")
+      .ext<&SetStreamParameters>("setParameters");
 
   m.def<Packet>("Packet")
+      // An empty packet flushes the decoders
+      .cons<>()
       .def<&Packet::isNull>(WASYNC("isNull"))
       .def<&Packet::isComplete>(WASYNC("isComplete"))
       .def<&Packet::streamIndex>(WASYNC("streamIndex"))
@@ -333,7 +391,20 @@ NOBIND_MODULE_DATA(ffmpeg, m, ffmpegInstanceData) {
       .def<static_cast<void (Packet::*)(const Timestamp &)>(&Packet::setPts)>(WASYNC("setPts"))
       .def<&Packet::dts>(WASYNC("dts"))
       .def<static_cast<void (Packet::*)(const Timestamp &)>(&Packet::setDts)>(WASYNC("setDts"))
-      .def<&Packet::timeBase, Nobind::ReturnNested>(WASYNC("timeBase"));
+      .def<&Packet::timeBase, Nobind::ReturnNested>(WASYNC("timeBase"))
+      // All of the above in a single call
+      .ext<&GetPacketInfo>("info")
+      .ext<&Memory::TrackPacket>("track")
+      .ext<&TransferPacket>("transfer")
+      .ext<&PacketData>("data")
+      .typescript_fragment("  /**\n"
+                           "   * Creates a packet over a Buffer, it is not copied if it is at the start\n"
+                           "   * of a dedicated ArrayBuffer that ends with AV_INPUT_BUFFER_PADDING_SIZE\n"
+                           "   * zero bytes, such a Buffer must not be modified while the packet exists\n"
+                           "   */\n"
+                           "  static wrap(buffer: Buffer, pts: number | null, dts: number | null, flags: number,\n"
+                           "    streamIndex: number, timeBase?: Rational): Packet;\n")
+      .def<&AdoptPacket>("adopt");
 
   m.def<VideoFrame>("VideoFrame")
       .cons()
@@ -362,7 +433,27 @@ NOBIND_MODULE_DATA(ffmpeg, m, ffmpegInstanceData) {
       .def<&VideoFrame::streamIndex>(WASYNC("streamIndex"))
       .def<&VideoFrame::setStreamIndex>(WASYNC("setStreamIndex"))
       .ext<&CopyFrameToBuffer>("data")
+      .ext<&GetVideoFrameInfo>("info")
+      .ext<&Memory::TrackVideoFrame>("track")
+      .ext<&TransferVideoFrame>("transfer")
+      .def<&AdoptVideoFrame>("adopt")
+      .ext<&FrameHistogram>("histogram")
+      .ext<&FramePlaneStats>("planeStats")
+      .ext<&FramePSNR>("psnr")
+      .ext<&FrameSSIM>("ssim")
+      .ext<&FrameDifference>("difference")
+      .typescript_fragment(AnalysisTypeScriptFragment)
+      .ext<&EncodeImage>("encodeImage")
+      .typescript_fragment(
+          "  encodeImageAsync(format: string, options?: { width?: number, height?: number, quality?: number }):"
+          " Promise<Buffer>;\n")
       .ext<static_cast<ToString_t<VideoFrame>>(&ToString<VideoFrame>)>("toString");
+  m.def<&EncodeImage, Nobind::ReturnAsync>("_encodeImageAsync");
+  m.def<&FrameHistogram, Nobind::ReturnAsync>("_histogramAsync");
+  m.def<&FramePlaneStats, Nobind::ReturnAsync>("_planeStatsAsync");
+  m.def<&FramePSNR, Nobind::ReturnAsync>("_psnrAsync");
+  m.def<&FrameSSIM, Nobind::ReturnAsync>("_ssimAsync");
+  m.def<&FrameDifference, Nobind::ReturnAsync>("_differenceAsync");
 
   m.def<AudioSamples>("AudioSamples")
       .cons<>()
@@ -389,7 +480,20 @@ NOBIND_MODULE_DATA(ffmpeg, m, ffmpegInstanceData) {
       .def<&AudioSamples::streamIndex>(WASYNC("streamIndex"))
       .def<&AudioSamples::setStreamIndex>(WASYNC("setStreamIndex"))
       .ext<static_cast<Nobind::Typemap::Buffer (*)(AudioSamples &, size_t)>(&ReturnBufferPlane<AudioSamples>)>("data")
+      .ext<&GetAudioSamplesInfo>("info")
+      .ext<&Memory::TrackAudioSamples>("track")
+      .ext<&TransferAudioSamples>("transfer")
+      .def<&AdoptAudioSamples>("adopt")
+      .ext<&AudioSamplesLevels>("levels")
+      .typescript_fragment("  levelsAsync(): Promise<Float64Array>;\n")
       .ext<static_cast<ToString_t<AudioSamples>>(&ToString<AudioSamples>)>("toString");
+  m.def<&AudioSamplesLevels, Nobind::ReturnAsync>("_levelsAsync");
+
+  m.def<LoudnessMeter>("LoudnessMeter")
+      .cons<int, int>()
+      .def<&LoudnessMeter::add>(WASYNC("add"))
+      .def<&LoudnessMeter::result>(WASYNC("result"))
+      .def<&LoudnessMeter::reset>(WASYNC("reset"));
 
   m.def<Timestamp>("Timestamp")
       .cons<int64_t, const Rational &>()
@@ -412,7 +516,17 @@ NOBIND_MODULE_DATA(ffmpeg, m, ffmpegInstanceData) {
       .def<&VideoRescaler::dstHeight>(WASYNC("dstHeight"))
       .def<&VideoRescaler::dstPixelFormat>(WASYNC("dstPixelFormat"))
       .def<static_cast<VideoFrame (VideoRescaler::*)(const VideoFrame &, OptionalErrorCode)>(&VideoRescaler::rescale)>(
-          WASYNC("rescale"));
+          WASYNC("rescale"))
+      .ext<&RescaleInto>("rescaleInto")
+      .typescript_fragment("  rescaleIntoAsync(dst: VideoFrame, src: VideoFrame): Promise<void>;\n");
+  m.def<&RescaleInto, Nobind::ReturnAsync>("_rescaleIntoAsync");
+
+  m.def<VideoFramePool>("VideoFramePool")
+      .cons<int, int, PixelFormat>()
+      .def<&VideoFramePool::get>(WASYNC("get"))
+      .def<&VideoFramePool::width>("width")
+      .def<&VideoFramePool::height>("height")
+      .def<&VideoFramePool::pixelFormat>("pixelFormat");
 
   m.def<AudioResampler>("AudioResampler")
       .cons<uint64_t, int, SampleFormat, uint64_t, int, SampleFormat>()
@@ -436,27 +550,37 @@ NOBIND_MODULE_DATA(ffmpeg, m, ffmpegInstanceData) {
           WASYNC("parse"))
       .def<&FilterGraph::config>(WASYNC("config"))
       .def<static_cast<FilterContext (FilterGraph::*)(const std::string &, OptionalErrorCode)>(&FilterGraph::filter)>(
-          WASYNC("filter"));
-
-  m.def<FilterContext>("FilterContext");
-
-  // We only export the safer API that copies frames for now
+          WASYNC("filter"))
+      .ext<&SendFilterCommand>("sendCommand")
+      .ext<&QueueFilterCommand>("queueCommand")
+      .typescript_fragment("  sendCommandAsync(target: string, cmd: string, arg: string, flags: number): Promise<string>;\n");
+  m.def<&SendFilterCommand, Nobind::ReturnAsync>("_sendCommandAsync");
+
+  m.def<FilterContext>("FilterContext")
+      .ext<&SetVideoSourceParameters>("setVideoSourceParameters")
+      .ext<&SetAudioSourceParameters>("setAudioSourceParameters");
+
+  // write* is the safer API that leaves the frame untouched
+  // add* hands over the frame reference to the filter graph without copying,
+  // the JS object is left empty and cannot be used after the call
   m.def<BufferSrcFilterContext>("BufferSrcFilterContext")
       .cons<FilterContext &>()
       .def<static_cast<void (BufferSrcFilterContext::*)(const VideoFrame &, OptionalErrorCode)>(
           &BufferSrcFilterContext::writeVideoFrame)>(WASYNC("writeVideoFrame"))
       .def<static_cast<void (BufferSrcFilterContext::*)(const AudioSamples &, OptionalErrorCode)>(
           &BufferSrcFilterContext::writeAudioSamples)>(WASYNC("writeAudioSamples"))
-      .def<static_cast<void (BufferSrcFilterContext::*)(const VideoFrame &, OptionalErrorCode)>(
-          &BufferSrcFilterContext::writeVideoFrame)>(WASYNC("writeVideoFrame"))
-      .def<static_cast<void (BufferSrcFilterContext::*)(const AudioSamples &, OptionalErrorCode)>(
-          &BufferSrcFilterContext::writeAudioSamples)>(WASYNC("writeAudioSamples"))
+      .def<static_cast<void (BufferSrcFilterContext::*)(VideoFrame &, OptionalErrorCode)>(
+          &BufferSrcFilterContext::addVideoFrame)>(WASYNC("addVideoFrame"))
+      .def<static_cast<void (BufferSrcFilterContext::*)(AudioSamples &, OptionalErrorCode)>(
+          &BufferSrcFilterContext::addAudioSamples)>(WASYNC("addAudioSamples"))
       .def<&BufferSrcFilterContext::checkFilter>(WASYNC("checkFilter"));
 
   m.def<BufferSinkFilterContext>("BufferSinkFilterContext")
       .cons<FilterContext &>()
       .ext<&GetVideoFrame, Nobind::ReturnNullAccept>("getVideoFrame")
       .ext<&GetAudioFrame, Nobind::ReturnNullAccept>("getAudioFrame")
+      .ext<&GetVideoFrames>("getVideoFrames")
+      .ext<&GetAudioFrames>("getAudioFrames")
       .def<&BufferSinkFilterContext::setFrameSize>(WASYNC("setFrameSize"))
       .def<&BufferSinkFilterContext::frameRate>(WASYNC("frameRate"))
       .def<&BufferSinkFilterContext::checkFilter>(WASYNC("checkFilter"))
@@ -464,21 +588,73 @@ NOBIND_MODULE_DATA(ffmpeg, m, ffmpegInstanceData) {
       // which are global because of the limitations of Nobind
       // we patch them at runtime in JS
       .typescript_fragment("  getAudioFrameAsync(): Promise<AudioSamples | null>;\n")
-      .typescript_fragment("  getVideoFrameAsync(): Promise<VideoFrame | null>;\n");
+      .typescript_fragment("  getVideoFrameAsync(): Promise<VideoFrame | null>;\n")
+      .typescript_fragment("  getAudioFramesAsync(max: number): Promise<{ frames: AudioSamples[], error: Error | null }>;\n")
+      .typescript_fragment("  getVideoFramesAsync(max: number): Promise<{ frames: VideoFrame[], error: Error | null }>;\n");
   m.def<&GetAudioFrame, ReturnNullAsync>("_getAudioFrameAsync");
   m.def<&GetVideoFrame, ReturnNullAsync>("_getVideoFrameAsync");
+  m.def<&GetAudioFrames, Nobind::ReturnAsync>("_getAudioFramesAsync");
+  m.def<&GetVideoFrames, Nobind::ReturnAsync>("_getVideoFramesAsync");
 
   REGISTER_ENUM(FilterMediaType, Unknown);
   REGISTER_ENUM(FilterMediaType, Audio);
   REGISTER_ENUM(FilterMediaType, Video);
+  REGISTER_CONSTANT(int64_t, AVFILTER_CMD_FLAG_ONE, "AVFILTER_CMD_FLAG_ONE");
+  REGISTER_CONSTANT(int64_t, AVFILTER_CMD_FLAG_FAST, "AVFILTER_CMD_FLAG_FAST");
+  REGISTER_CONSTANT(int64_t, AV_INPUT_BUFFER_PADDING_SIZE, "AV_INPUT_BUFFER_PADDING_SIZE");
 
   m.typescript_fragment("import { Readable, Writable } from 'stream';\n"
                         "export class CustomIO { }\n"
-                        "export class WritableCustomIO extends Writable implements CustomIO { }\n"
-                        "export class ReadableCustomIO extends Readable implements CustomIO { }\n");
+                        "export class WritableCustomIO extends Writable implements CustomIO {\n"
+                        "  /**\n"
+                        "   * In synchronous mode (`sync` or `pull`) only the sync methods can be used,\n"
+                        "   * the data comes from the pull callback or from the queue filled by enqueue()\n"
+                        "   * or write(), without a pull callback the queue must end with a null\n"
+                        "   */\n"
+                        "  constructor(options?: {\n"
+                        "    sync?: boolean,\n"
+                        "    pull?: (size: number) => Buffer | null,\n"
+                        "    highWaterMark?: number\n"
+                        "  });\n"
+                        "  /** Synchronous mode only, null signals EOF */\n"
+                        "  enqueue(data: Buffer | null): void;\n"
+                        "  /** Wakes up ffmpeg with AVERROR_EXIT and rejects all further writes */\n"
+                        "  abort(): void;\n"
+                        "  /** [ calls, bytes copied, wait time in ns, bytes queued ] */\n"
+                        "  stats(): Float64Array;\n"
+                        "}\n"
+                        "export class ReadableCustomIO extends Readable implements CustomIO {\n"
+                        "  /**\n"
+                        "   * In synchronous mode (`sync` or `sink`) only the sync methods can be used,\n"
+                        "   * the data goes to the sink callback or it is kept until drain()\n"
+                        "   */\n"
+                        "  constructor(options?: { sync?: boolean, sink?: (data: Buffer) => void });\n"
+                        "  /** Synchronous mode without a sink only */\n"
+                        "  drain(): Buffer[];\n"
+                        "  /** Wakes up ffmpeg with AVERROR_EXIT and fails all further writes from ffmpeg */\n"
+                        "  abort(): void;\n"
+                        "  /** [ calls, bytes copied, wait time in ns, bytes queued ] */\n"
+                        "  stats(): Float64Array;\n"
+                        "}\n");
   m.Exports().Set("WritableCustomIO", WritableCustomIO::GetClass(m.Env()));
   m.Exports().Set("ReadableCustomIO", ReadableCustomIO::GetClass(m.Env()));
 
+  m.typescript_fragment(MediaExecutorTypeScriptFragment);
+  m.Exports().Set("MediaExecutor", MediaExecutor::GetClass(m.Env()));
+
+  m.typescript_fragment(Stats::TypeScriptFragment);
+  m.Exports().Set("stats", Napi::Function::New(m.Env(), Stats::Get, "stats"));
+  m.Exports().Set("statsFields", Stats::Fields(m.Env()));
+
+  m.typescript_fragment(Memory::TypeScriptFragment);
+  m.Exports().Set("memoryUsage", Napi::Function::New(m.Env(), Memory::Usage, "memoryUsage"));
+  m.Exports().Set("setMemoryBudget", Napi::Function::New(m.Env(), Memory::SetBudget, "setMemoryBudget"));
+  m.Exports().Set("waitForMemory", Napi::Function::New(m.Env(), Memory::WaitForMemory, "waitForMemory"));
+
+  m.Exports().Set("_wrapPacket", Napi::Function::New(m.Env(), WrappedPackets::Wrap, "wrap"));
+
+  m.def<&ReleaseTransfer>("releaseTransfer");
+
   m.Env().GetInstanceData<Nobind::EnvInstanceData<ffmpegInstanceData>>()->v8_main_thread = std::this_thread::get_id();
 
   m.def<&SetLogLevel>("setLogLevel");
@@ -0,0 +1,152 @@
+#include "avcpp-packet.h"
+#include "avcpp-stats.h"
+#include "instance-data.h"
+#include <cstdint>
+#include <cstring>
+
+PacketPayload PacketData(Packet &packet) {
+  AVPacket *raw = packet.raw();
+  if (raw == nullptr || raw->data == nullptr || raw->size <= 0)
+    return PacketPayload{nullptr, nullptr, 0};
+  // Packets that do not own their data are copied into a new buffer once
+  if (raw->buf == nullptr && av_packet_make_refcounted(raw) < 0)
+    throw std::bad_alloc{};
+  AVBufferRef *ref = av_buffer_ref(raw->buf);
+  if (ref == nullptr)
+    throw std::bad_alloc{};
+  return PacketPayload{ref, raw->data, static_cast<size_t>(raw->size)};
+}
+
+namespace WrappedPackets {
+
+// The opaque of the AVBufferRef
+struct Holder {
+  std::shared_ptr<Releaser> releaser;
+  Napi::Reference<Napi::Value> buffer;
+};
+
+// Main thread only
+static void Release(Releaser *releaser) {
+  std::vector<Holder *> released;
+  {
+    std::lock_guard lk{releaser->lock};
+    std::swap(released, releaser->released);
+  }
+  for (auto *holder : released)
+    delete holder;
+}
+
+// The free callback of the AVBufferRef, it can be called from any thread
+static void Free(void *opaque, uint8_t *) {
+  auto *holder = reinterpret_cast<Holder *>(opaque);
+  // Keeps the Releaser alive until the lock is released
+  std::shared_ptr<Releaser> releaser = holder->releaser;
+
+  std::lock_guard lk{releaser->lock};
+  if (releaser->release_callback == nullptr) {
+    // The environment is gone along with the Buffer
+    holder->buffer.SuppressDestruct();
+    delete holder;
+    return;
+  }
+  releaser->released.push_back(holder);
+  uv_async_send(releaser->release_callback);
+}
+
+Registry::Registry(Napi::Env env) : releaser{std::make_shared<Releaser>()} {
+  uv_loop_t *event_loop;
+  napi_get_uv_event_loop(env, &event_loop);
+
+  releaser->release_callback = new uv_async_t;
+  uv_async_init(event_loop, releaser->release_callback, [](uv_async_t *async) {
+    if (async->data != nullptr)
+      Release(reinterpret_cast<Releaser *>(async->data));
+  });
+  releaser->release_callback->data = releaser.get();
+  uv_unref(reinterpret_cast<uv_handle_t *>(releaser->release_callback));
+}
+
+Registry::~Registry() {
+  Release(releaser.get());
+  std::lock_guard lk{releaser->lock};
+  releaser->release_callback->data = nullptr;
+  uv_close(reinterpret_cast<uv_handle_t *>(releaser->release_callback),
+           [](uv_handle_t *async) { delete (reinterpret_cast<uv_async_t *>(async)); });
+  releaser->release_callback = nullptr;
+}
+
+static std::shared_ptr<Releaser> Get(Napi::Env env) {
+  auto instance_data = env.GetInstanceData<Nobind::EnvInstanceData<ffmpegInstanceData>>();
+  if (!instance_data->wrapped)
+    instance_data->wrapped = std::make_shared<Registry>(env);
+  return instance_data->wrapped->releaser;
+}
+
+static int64_t TimestampArg(const Napi::Value &val) {
+  if (val.IsNull() || val.IsUndefined())
+    return AV_NOPTS_VALUE;
+  if (!val.IsNumber())
+    throw Napi::TypeError::New(val.Env(), "Timestamps must be numbers or null");
+  return val.ToNumber().Int64Value();
+}
+
+// Packet.wrap(buffer, pts, dts, flags, streamIndex, timeBase?)
+//
+// The decoders may read up to AV_INPUT_BUFFER_PADDING_SIZE bytes past the end
+// of the data and these must remain zero while the packet is alive. The Buffer
+// is used without copying only if it is at the start of a dedicated ArrayBuffer
+// that ends with exactly this padding, `Buffer.alloc(size + 64).subarray(0, size)`
+// for example. Small Buffers from `Buffer.from()` or `Buffer.allocUnsafe()` share
+// a pool slab with other Buffers that can overwrite the padding at any time,
+// these are always copied. A Buffer used without copying must not be modified
+// as long as the packet exists.
+Napi::Value Wrap(const Napi::CallbackInfo &info) {
+  Napi::Env env{info.Env()};
+  if (info.Length() < 5 || !info[0].IsBuffer() || !info[3].IsNumber() || !info[4].IsNumber())
+    throw Napi::TypeError::New(env, "Expected a Buffer, pts, dts, flags and a stream index");
+  auto buffer = info[0].As<Napi::Buffer<uint8_t>>();
+  size_t size = buffer.Length();
+  if (size == 0 || size > INT32_MAX - AV_INPUT_BUFFER_PADDING_SIZE)
+    throw Napi::RangeError::New(env, "Invalid packet size");
+
+  AVPacket *raw = av_packet_alloc();
+  if (raw == nullptr)
+    throw std::bad_alloc{};
+
+  bool padded =
+      buffer.ByteOffset() == 0 && buffer.ArrayBuffer().ByteLength() == size + AV_INPUT_BUFFER_PADDING_SIZE;
+  for (size_t i = 0; padded && i < AV_INPUT_BUFFER_PADDING_SIZE; i++)
+    padded = buffer.Data()[size + i] == 0;
+  if (padded) {
+    auto *holder = new Holder{Get(env), Napi::Persistent<Napi::Value>(buffer)};
+    raw->buf = av_buffer_create(buffer.Data(), size, Free, holder, AV_BUFFER_FLAG_READONLY);
+    if (raw->buf == nullptr) {
+      delete holder;
+      av_packet_free(&raw);
+      throw std::bad_alloc{};
+    }
+    raw->data = buffer.Data();
+    raw->size = static_cast<int>(size);
+  } else {
+    if (av_new_packet(raw, static_cast<int>(size)) < 0) {
+      av_packet_free(&raw);
+      throw std::bad_alloc{};
+    }
+    memcpy(raw->data, buffer.Data(), size);
+    Stats::Add(Stats::PacketBytesCopied, size);
+  }
+  raw->pts = TimestampArg(info[1]);
+  raw->dts = TimestampArg(info[2]);
+  raw->flags = info[3].ToNumber().Int32Value();
+  raw->stream_index = info[4].ToNumber().Int32Value();
+
+  // This adds a new reference
+  Packet packet{raw};
+  av_packet_free(&raw);
+  if (info.Length() > 5 && !info[5].IsUndefined())
+    packet.setTimeBase(Nobind::Typemap::FromJS<Rational &>(info[5]).Get());
+  packet.setComplete(true);
+  return Nobind::Typemap::ToJS<Packet, Nobind::ReturnOwned>(env, std::move(packet)).Get();
+}
+
+} // namespace WrappedPackets
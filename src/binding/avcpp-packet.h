@@ -0,0 +1,80 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <napi.h>
+#include <packet.h>
+#include <uv.h>
+#include <vector>
+
+#include <nobind.h>
+
+using namespace av;
+
+// The payload of a packet, it is returned to JS as a Buffer without copying
+// The Buffer holds its own reference to the AVBufferRef of the packet
+class PacketPayload {
+public:
+  AVBufferRef *ref;
+  uint8_t *data;
+  size_t size;
+};
+
+PacketPayload PacketData(Packet &packet);
+
+// Packet.wrap() creates packets over JS Buffers without copying
+//
+// The AVBufferRef of such a packet holds a reference to the Buffer which must
+// be deleted in the main thread, but ffmpeg can free the packet in any thread.
+// The freed references are queued and released by an uv_async_t.
+namespace WrappedPackets {
+
+struct Holder;
+
+struct Releaser {
+  std::mutex lock;
+  std::vector<Holder *> released;
+  // nullptr once the environment has been destroyed
+  uv_async_t *release_callback;
+};
+
+// The per-environment owner of the Releaser, the Releaser
+// itself lives as long as there are wrapped packets
+struct Registry {
+  std::shared_ptr<Releaser> releaser;
+
+  Registry(Napi::Env env);
+  ~Registry();
+};
+
+Napi::Value Wrap(const Napi::CallbackInfo &info);
+
+} // namespace WrappedPackets
+
+namespace Nobind {
+namespace Typemap {
+
+template <const ReturnAttribute &RETATTR> class ToJS<PacketPayload, RETATTR> {
+  Napi::Env env_;
+  PacketPayload val_;
+
+public:
+  inline explicit ToJS(Napi::Env env, PacketPayload val) : env_(env), val_(val) {}
+  inline Napi::Value Get() {
+    if (val_.ref == nullptr)
+      return Napi::Buffer<uint8_t>::New(env_, 0);
+    // Some alternative Node-API implementations (Electron for example) disallow external buffers
+#ifdef NODE_API_NO_EXTERNAL_BUFFERS_ALLOWED
+    auto buffer = Napi::Buffer<uint8_t>::Copy(env_, val_.data, val_.size);
+    av_buffer_unref(&val_.ref);
+    return buffer;
+#else
+    return Napi::Buffer<uint8_t>::New(
+        env_, val_.data, val_.size, [](Napi::Env, uint8_t *, AVBufferRef *ref) { av_buffer_unref(&ref); }, val_.ref);
+#endif
+  }
+
+  static const std::string TSType() { return "Buffer"; };
+};
+
+} // namespace Typemap
+} // namespace Nobind
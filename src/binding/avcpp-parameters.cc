@@ -0,0 +1,329 @@
+#include "avcpp-parameters.h"
+#include <cstring>
+#include <stdexcept>
+
+extern "C" {
+#include <libavutil/base64.h>
+#include <libavutil/opt.h>
+}
+
+StreamParameters GetStreamParameters(Stream &stream) {
+  const AVStream *raw = stream.raw();
+  if (raw == nullptr)
+    throw std::invalid_argument{"Empty stream"};
+  const AVCodecParameters *par = raw->codecpar;
+
+  std::string layout;
+  if (par->ch_layout.nb_channels > 0) {
+    char buf[256];
+    if (av_channel_layout_describe(&par->ch_layout, buf, sizeof(buf)) > 0)
+      layout = buf;
+  }
+
+  return StreamParameters{par->codec_type,
+                          par->codec_id,
+                          par->codec_tag,
+                          par->format,
+                          par->bit_rate,
+                          par->profile,
+                          par->level,
+                          par->width,
+                          par->height,
+                          par->sample_aspect_ratio,
+                          par->field_order,
+                          par->color_range,
+                          par->color_primaries,
+                          par->color_trc,
+                          par->color_space,
+                          par->chroma_location,
+                          par->video_delay,
+                          par->sample_rate,
+                          layout,
+                          par->frame_size,
+                          par->initial_padding,
+                          par->trailing_padding,
+                          par->seek_preroll,
+                          par->bits_per_coded_sample,
+                          par->bits_per_raw_sample,
+                          std::vector<uint8_t>(par->extradata, par->extradata + par->extradata_size),
+                          raw->time_base,
+                          raw->avg_frame_rate};
+}
+
+void SetStreamParameters(Stream &stream, StreamParameters params) {
+  AVStream *raw = stream.raw();
+  if (raw == nullptr)
+    throw std::invalid_argument{"Empty stream"};
+  AVCodecParameters *par = raw->codecpar;
+
+  // Only the fields that have not been set by the demuxer are replaced
+  par->codec_type = params.mediaType;
+  if (par->codec_id == AV_CODEC_ID_NONE)
+    par->codec_id = params.codecId;
+  if (par->codec_tag == 0)
+    par->codec_tag = params.codecTag;
+  if (par->format < 0)
+    par->format = params.format;
+  if (par->bit_rate == 0)
+    par->bit_rate = params.bitRate;
+  if (par->profile < 0)
+    par->profile = params.profile;
+  if (par->level < 0)
+    par->level = params.level;
+  if (par->width == 0)
+    par->width = params.width;
+  if (par->height == 0)
+    par->height = params.height;
+  if (par->sample_aspect_ratio.num == 0)
+    par->sample_aspect_ratio = params.sampleAspectRatio;
+  if (par->field_order == AV_FIELD_UNKNOWN)
+    par->field_order = static_cast<AVFieldOrder>(params.fieldOrder);
+  if (par->color_range == AVCOL_RANGE_UNSPECIFIED)
+    par->color_range = static_cast<AVColorRange>(params.colorRange);
+  if (par->color_primaries == AVCOL_PRI_UNSPECIFIED)
+    par->color_primaries = static_cast<AVColorPrimaries>(params.colorPrimaries);
+  if (par->color_trc == AVCOL_TRC_UNSPECIFIED)
+    par->color_trc = static_cast<AVColorTransferCharacteristic>(params.colorTrc);
+  if (par->color_space == AVCOL_SPC_UNSPECIFIED)
+    par->color_space = static_cast<AVColorSpace>(params.colorSpace);
+  if (par->chroma_location == AVCHROMA_LOC_UNSPECIFIED)
+    par->chroma_location = static_cast<AVChromaLocation>(params.chromaLocation);
+  if (par->video_delay == 0)
+    par->video_delay = params.videoDelay;
+  if (par->sample_rate == 0)
+    par->sample_rate = params.sampleRate;
+  if (par->ch_layout.nb_channels == 0 && !params.channelLayout.empty()) {
+    av_channel_layout_uninit(&par->ch_layout);
+    if (av_channel_layout_from_string(&par->ch_layout, params.channelLayout.c_str()) < 0)
+      throw std::invalid_argument{"Invalid channel layout " + params.channelLayout};
+  }
+  if (par->frame_size == 0)
+    par->frame_size = params.frameSize;
+  if (par->initial_padding == 0)
+    par->initial_padding = params.initialPadding;
+  if (par->trailing_padding == 0)
+    par->trailing_padding = params.trailingPadding;
+  if (par->seek_preroll == 0)
+    par->seek_preroll = params.seekPreroll;
+  if (par->bits_per_coded_sample == 0)
+    par->bits_per_coded_sample = params.bitsPerCodedSample;
+  if (par->bits_per_raw_sample == 0)
+    par->bits_per_raw_sample = params.bitsPerRawSample;
+  if (par->extradata_size == 0 && !params.extradata.empty()) {
+    par->extradata = static_cast<uint8_t *>(av_mallocz(params.extradata.size() + AV_INPUT_BUFFER_PADDING_SIZE));
+    if (par->extradata == nullptr)
+      throw std::bad_alloc{};
+    memcpy(par->extradata, params.extradata.data(), params.extradata.size());
+    par->extradata_size = static_cast<int>(params.extradata.size());
+  }
+  if (raw->time_base.num == 0)
+    raw->time_base = params.timeBase;
+  if (raw->avg_frame_rate.num == 0)
+    raw->avg_frame_rate = params.frameRate;
+  if (raw->r_frame_rate.num == 0)
+    raw->r_frame_rate = params.frameRate;
+}
+
+void SetFormatContextOption(FormatContext &ctx, const std::string &key, const std::string &value) {
+  int r = av_opt_set(ctx.raw(), key.c_str(), value.c_str(), 0);
+  if (r < 0)
+    throw std::invalid_argument{"Invalid format option " + key + "=" + value};
+}
+
+bool AddInputStreams(FormatContext &ctx, int count) {
+  AVFormatContext *raw = ctx.raw();
+  if (raw == nullptr || raw->iformat == nullptr)
+    throw std::logic_error{"The input is not open"};
+  if (raw->nb_streams > 0 || !(raw->ctx_flags & AVFMTCTX_NOHEADER))
+    return false;
+  for (int i = 0; i < count; i++) {
+    AVStream *st = avformat_new_stream(raw, nullptr);
+    if (st == nullptr)
+      throw std::bad_alloc{};
+    st->id = i;
+    // Filled in by the known parameters
+    st->time_base = {0, 1};
+  }
+  return true;
+}
+
+Packet ReadFrame(FormatContext &ctx) {
+  AVFormatContext *raw = ctx.raw();
+  if (raw == nullptr || raw->iformat == nullptr)
+    throw std::logic_error{"The input is not open"};
+
+  Packet packet;
+  int r;
+  do {
+    r = av_read_frame(raw, packet.raw());
+  } while (r == AVERROR(EAGAIN));
+  if (r == AVERROR_EOF)
+    return Packet{};
+  if (r < 0) {
+    char msg[AV_ERROR_MAX_STRING_SIZE];
+    av_strerror(r, msg, sizeof(msg));
+    throw std::runtime_error{std::string{"Failed reading a packet: "} + msg};
+  }
+  if (packet.streamIndex() < 0 || static_cast<unsigned>(packet.streamIndex()) >= raw->nb_streams)
+    throw std::runtime_error{"Packet with an invalid stream index " + std::to_string(packet.streamIndex())};
+  packet.setTimeBase(raw->streams[packet.streamIndex()]->time_base);
+  packet.setComplete(true);
+  return packet;
+}
+
+void SeekFormatContext(FormatContext &ctx, int streamIndex, int64_t timestamp) {
+  AVFormatContext *raw = ctx.raw();
+  if (raw == nullptr)
+    throw std::invalid_argument{"FormatContext is not open"};
+  if (streamIndex < 0 || static_cast<unsigned>(streamIndex) >= raw->nb_streams)
+    throw std::invalid_argument{"Invalid stream index " + std::to_string(streamIndex)};
+  int r = av_seek_frame(raw, streamIndex, timestamp, AVSEEK_FLAG_BACKWARD);
+  if (r < 0)
+    throw std::runtime_error{"Failed seeking to " + std::to_string(timestamp)};
+}
+
+static Napi::Value Rational(Napi::Env env, const AVRational &r) {
+  auto a = Napi::Array::New(env, 2);
+  a.Set(0u, Napi::Number::New(env, r.num));
+  a.Set(1u, Napi::Number::New(env, r.den));
+  return a;
+}
+
+Napi::Value StreamParametersToJS(Napi::Env env, const StreamParameters &p) {
+  auto r = Napi::Object::New(env);
+  r.Set("mediaType", Napi::Number::New(env, p.mediaType));
+  r.Set("codecId", Napi::Number::New(env, p.codecId));
+  r.Set("codecTag", Napi::Number::New(env, p.codecTag));
+  r.Set("format", Napi::Number::New(env, p.format));
+  r.Set("bitRate", Napi::Number::New(env, static_cast<double>(p.bitRate)));
+  r.Set("profile", Napi::Number::New(env, p.profile));
+  r.Set("level", Napi::Number::New(env, p.level));
+  r.Set("width", Napi::Number::New(env, p.width));
+  r.Set("height", Napi::Number::New(env, p.height));
+  r.Set("sampleAspectRatio", Rational(env, p.sampleAspectRatio));
+  r.Set("fieldOrder", Napi::Number::New(env, p.fieldOrder));
+  r.Set("colorRange", Napi::Number::New(env, p.colorRange));
+  r.Set("colorPrimaries", Napi::Number::New(env, p.colorPrimaries));
+  r.Set("colorTrc", Napi::Number::New(env, p.colorTrc));
+  r.Set("colorSpace", Napi::Number::New(env, p.colorSpace));
+  r.Set("chromaLocation", Napi::Number::New(env, p.chromaLocation));
+  r.Set("videoDelay", Napi::Number::New(env, p.videoDelay));
+  r.Set("sampleRate", Napi::Number::New(env, p.sampleRate));
+  r.Set("channelLayout", Napi::String::New(env, p.channelLayout));
+  r.Set("frameSize", Napi::Number::New(env, p.frameSize));
+  r.Set("initialPadding", Napi::Number::New(env, p.initialPadding));
+  r.Set("trailingPadding", Napi::Number::New(env, p.trailingPadding));
+  r.Set("seekPreroll", Napi::Number::New(env, p.seekPreroll));
+  r.Set("bitsPerCodedSample", Napi::Number::New(env, p.bitsPerCodedSample));
+  r.Set("bitsPerRawSample", Napi::Number::New(env, p.bitsPerRawSample));
+
+  std::string extradata;
+  if (!p.extradata.empty()) {
+    extradata.resize(AV_BASE64_SIZE(p.extradata.size()));
+    av_base64_encode(extradata.data(), static_cast<int>(extradata.size()), p.extradata.data(),
+                     static_cast<int>(p.extradata.size()));
+    extradata.resize(strlen(extradata.c_str()));
+  }
+  r.Set("extradata", Napi::String::New(env, extradata));
+  r.Set("timeBase", Rational(env, p.timeBase));
+  r.Set("frameRate", Rational(env, p.frameRate));
+  return r;
+}
+
+static int GetInt(const Napi::Object &obj, const char *name, int def) {
+  Napi::Value v = obj.Get(name);
+  return v.IsNumber() ? v.ToNumber().Int32Value() : def;
+}
+
+static AVRational GetRational(const Napi::Object &obj, const char *name) {
+  Napi::Value v = obj.Get(name);
+  if (!v.IsArray() || v.As<Napi::Array>().Length() != 2)
+    return {0, 1};
+  auto a = v.As<Napi::Array>();
+  return {a.Get(0u).ToNumber().Int32Value(), a.Get(1u).ToNumber().Int32Value()};
+}
+
+StreamParameters StreamParametersFromJS(const Napi::Value &val) {
+  if (!val.IsObject())
+    throw Napi::TypeError::New(val.Env(), "Expected a StreamParameters object");
+  Napi::Object obj = val.ToObject();
+
+  std::vector<uint8_t> extradata;
+  Napi::Value b64 = obj.Get("extradata");
+  if (b64.IsString()) {
+    std::string s = b64.ToString().Utf8Value();
+    extradata.resize(AV_BASE64_DECODE_SIZE(s.size()));
+    int len = av_base64_decode(extradata.data(), s.c_str(), static_cast<int>(extradata.size()));
+    if (len < 0)
+      throw Napi::TypeError::New(val.Env(), "Invalid extradata");
+    extradata.resize(len);
+  }
+  Napi::Value layout = obj.Get("channelLayout");
+  Napi::Value bitRate = obj.Get("bitRate");
+
+  return StreamParameters{static_cast<AVMediaType>(GetInt(obj, "mediaType", AVMEDIA_TYPE_UNKNOWN)),
+                          static_cast<AVCodecID>(GetInt(obj, "codecId", AV_CODEC_ID_NONE)),
+                          static_cast<uint32_t>(GetInt(obj, "codecTag", 0)),
+                          GetInt(obj, "format", -1),
+                          bitRate.IsNumber() ? bitRate.ToNumber().Int64Value() : 0,
+                          GetInt(obj, "profile", AV_PROFILE_UNKNOWN),
+                          GetInt(obj, "level", AV_LEVEL_UNKNOWN),
+                          GetInt(obj, "width", 0),
+                          GetInt(obj, "height", 0),
+                          GetRational(obj, "sampleAspectRatio"),
+                          GetInt(obj, "fieldOrder", AV_FIELD_UNKNOWN),
+                          GetInt(obj, "colorRange", AVCOL_RANGE_UNSPECIFIED),
+                          GetInt(obj, "colorPrimaries", AVCOL_PRI_UNSPECIFIED),
+                          GetInt(obj, "colorTrc", AVCOL_TRC_UNSPECIFIED),
+                          GetInt(obj, "colorSpace", AVCOL_SPC_UNSPECIFIED),
+                          GetInt(obj, "chromaLocation", AVCHROMA_LOC_UNSPECIFIED),
+                          GetInt(obj, "videoDelay", 0),
+                          GetInt(obj, "sampleRate", 0),
+                          layout.IsString() ? layout.ToString().Utf8Value() : std::string{},
+                          GetInt(obj, "frameSize", 0),
+                          GetInt(obj, "initialPadding", 0),
+                          GetInt(obj, "trailingPadding", 0),
+                          GetInt(obj, "seekPreroll", 0),
+                          GetInt(obj, "bitsPerCodedSample", 0),
+                          GetInt(obj, "bitsPerRawSample", 0),
+                          std::move(extradata),
+                          GetRational(obj, "timeBase"),
+                          GetRational(obj, "frameRate")};
+}
+
+const char *StreamParametersTypeScriptFragment = R"(
+/**
+ * The codec parameters of a stream, can be serialized to JSON
+ */
+export interface StreamParameters {
+  mediaType: AVMediaType;
+  codecId: AVCodecID;
+  codecTag: number;
+  format: number;
+  bitRate: number;
+  profile: number;
+  level: number;
+  width: number;
+  height: number;
+  sampleAspectRatio: [number, number];
+  fieldOrder: number;
+  colorRange: number;
+  colorPrimaries: number;
+  colorTrc: number;
+  colorSpace: number;
+  chromaLocation: number;
+  videoDelay: number;
+  sampleRate: number;
+  channelLayout: string;
+  frameSize: number;
+  initialPadding: number;
+  trailingPadding: number;
+  seekPreroll: number;
+  bitsPerCodedSample: number;
+  bitsPerRawSample: number;
+  /** base64 */
+  extradata: string;
+  timeBase: [number, number];
+  frameRate: [number, number];
+}
+)";
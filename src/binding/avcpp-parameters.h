@@ -0,0 +1,96 @@
+#pragma once
+#include <formatcontext.h>
+#include <packet.h>
+#include <stream.h>
+#include <string>
+#include <vector>
+
+#include <nobind.h>
+
+using namespace av;
+
+// The codec parameters of a stream as a plain JS object that can be
+// serialized with JSON and restored in another session - this allows
+// opening an input with known parameters without probing it
+struct StreamParameters {
+  AVMediaType mediaType;
+  AVCodecID codecId;
+  uint32_t codecTag;
+  int format;
+  int64_t bitRate;
+  int profile;
+  int level;
+  int width;
+  int height;
+  AVRational sampleAspectRatio;
+  int fieldOrder;
+  int colorRange;
+  int colorPrimaries;
+  int colorTrc;
+  int colorSpace;
+  int chromaLocation;
+  int videoDelay;
+  int sampleRate;
+  std::string channelLayout;
+  int frameSize;
+  int initialPadding;
+  int trailingPadding;
+  int seekPreroll;
+  int bitsPerCodedSample;
+  int bitsPerRawSample;
+  std::vector<uint8_t> extradata;
+  AVRational timeBase;
+  AVRational frameRate;
+};
+
+StreamParameters GetStreamParameters(Stream &stream);
+void SetStreamParameters(Stream &stream, StreamParameters params);
+
+// Sets an AVFormatContext option such as probesize before opening the input
+void SetFormatContextOption(FormatContext &ctx, const std::string &key, const std::string &value);
+
+// Creates the streams of an opened input without a header such as FLV before reading,
+// its demuxer attaches the packets to the existing streams with the same media type and codec,
+// returns false if the input already has streams or if it has a header
+bool AddInputStreams(FormatContext &ctx, int count);
+
+// Reads the next packet of an opened input, a null packet at the end of the input
+// Unlike FormatContext.readPacket(), it does not require findStreamInfo() and it can
+// read the inputs whose streams have been set up from known parameters
+Packet ReadFrame(FormatContext &ctx);
+
+// Seeks to the last keyframe at or before timestamp, in the time base of the stream
+void SeekFormatContext(FormatContext &ctx, int streamIndex, int64_t timestamp);
+
+// Conversion to and from JS, extradata is a base64 string
+Napi::Value StreamParametersToJS(Napi::Env env, const StreamParameters &params);
+StreamParameters StreamParametersFromJS(const Napi::Value &val);
+
+extern const char *StreamParametersTypeScriptFragment;
+
+namespace Nobind {
+namespace Typemap {
+
+template <const ReturnAttribute &RETATTR> class ToJS<StreamParameters, RETATTR> {
+  Napi::Env env_;
+  StreamParameters val_;
+
+public:
+  inline explicit ToJS(Napi::Env env, StreamParameters val) : env_(env), val_(std::move(val)) {}
+  inline Napi::Value Get() { return StreamParametersToJS(env_, val_); }
+
+  static const std::string TSType() { return "StreamParameters"; };
+};
+
+template <> class FromJS<StreamParameters> {
+  StreamParameters val_;
+
+public:
+  inline explicit FromJS(const Napi::Value &val) : val_(StreamParametersFromJS(val)) {}
+  inline StreamParameters Get() { return std::move(val_); }
+
+  static const std::string TSType() { return "StreamParameters"; };
+};
+
+} // namespace Typemap
+} // namespace Nobind
@@ -3,14 +3,26 @@
 #include <exception>
 
 ReadableCustomIO::ReadableCustomIO(const Napi::CallbackInfo &info)
-    : av::CustomIO{}, Napi::ObjectWrap<ReadableCustomIO>{info}, queue_size{0}, eof{false},
-      async_context{info.Env(), "ffmpeg_Readable_IO"}, flowing{false}, final_callback{} {
+    : av::CustomIO{}, Napi::ObjectWrap<ReadableCustomIO>{info}, queue_size{0}, eof{false}, aborted{false},
+      async_context{info.Env(), "ffmpeg_Readable_IO"}, flowing{false}, final_callback{}, sync{false} {
   Napi::Env env{info.Env()};
 
   instance_data = env.GetInstanceData<Nobind::EnvInstanceData<ffmpegInstanceData>>();
   if (instance_data->js_Readable_ctor.IsEmpty() || instance_data->js_ReadableCustomIO_ctor.IsEmpty())
     throw Napi::Error::New(env, "ReadableCustomIO is not initalized");
 
+  if (info.Length() > 0 && info[0].IsObject()) {
+    Napi::Object options = info[0].ToObject();
+    if (options.Has("sink")) {
+      if (!options.Get("sink").IsFunction())
+        throw Napi::TypeError::New(env, "sink must be a function");
+      sink = Napi::Persistent(options.Get("sink").As<Napi::Function>());
+      sync = true;
+    }
+    if (options.Has("sync"))
+      sync = sync || options.Get("sync").ToBoolean().Value();
+  }
+
   instance_data->js_Readable_ctor.Call(this->Value(), {});
 
   uv_loop_t *event_loop;
@@ -18,6 +30,8 @@ ReadableCustomIO::ReadableCustomIO(const Napi::CallbackInfo &info)
   push_callback = new uv_async_t;
   uv_async_init(event_loop, push_callback, &ReadableCustomIO::PushPendingData);
   push_callback->data = this;
+  if (sync)
+    uv_unref(reinterpret_cast<uv_handle_t *>(push_callback));
 }
 
 ReadableCustomIO::~ReadableCustomIO() {
@@ -52,7 +66,10 @@ Napi::Function ReadableCustomIO::GetClass(Napi::Env env) {
   Napi::Function self =
       DefineClass(env, "ReadableCustomIO",
                   {StaticMethod("init", &ReadableCustomIO::Init), InstanceMethod("_read", &ReadableCustomIO::_Read),
-                   InstanceMethod("_final", &ReadableCustomIO::_Final)});
+                   InstanceMethod("_final", &ReadableCustomIO::_Final),
+                   InstanceMethod("drain", &ReadableCustomIO::Drain),
+                   InstanceMethod("abort", &ReadableCustomIO::Abort),
+                   InstanceMethod("stats", &ReadableCustomIO::GetStats)});
 
   auto instance_data = env.GetInstanceData<Nobind::EnvInstanceData<ffmpegInstanceData>>();
   instance_data->js_ReadableCustomIO_ctor = Napi::Persistent(self);
@@ -62,14 +79,30 @@ Napi::Function ReadableCustomIO::GetClass(Napi::Env env) {
 int ReadableCustomIO::write(const uint8_t *data, size_t size) {
   verbose("ReadableCustomIO: ffmpeg wrote data %lu, queue_size is %lu, %s\n", size, queue_size,
           flowing ? "flowing" : "not flowing");
+  if (sync)
+    return WriteSync(data, size);
   if (std::this_thread::get_id() == instance_data->v8_main_thread)
     throw std::logic_error{"This function cannot be called in sync mode"};
 
   auto *buffer = new BufferReadableItem{new uint8_t[size], size};
   memcpy(buffer->data, data, size);
+  stats.calls++;
+  stats.bytes += size;
+  Stats::Add(Stats::ReadableBytesCopied, size);
 
   std::unique_lock lk{lock};
-  cv.wait(lk, [this, size] { return queue_size < size; });
+  uint64_t start = Stats::Now();
+  cv.wait(lk, [this, size] { return queue_size < size || aborted; });
+  uint64_t wait = Stats::Now() - start;
+  stats.wait_time += wait;
+  Stats::Add(Stats::ReadableWaitTime, wait);
+  if (aborted) {
+    verbose("ReadableCustomIO: aborted, sending an AVERROR_EXIT to ffmpeg\n");
+    lk.unlock();
+    delete[] buffer->data;
+    delete buffer;
+    return AVERROR_EXIT;
+  }
 
   verbose("ReadableCustomIO: write will unblock for ffmpeg\n");
   queue.push(buffer);
@@ -81,6 +114,45 @@ int ReadableCustomIO::write(const uint8_t *data, size_t size) {
   return size;
 }
 
+// Synchronous mode, runs in the JS thread, everything happens in-line
+// and there is no need for locking
+int ReadableCustomIO::WriteSync(const uint8_t *data, size_t size) {
+  if (std::this_thread::get_id() != instance_data->v8_main_thread)
+    throw std::logic_error{"A synchronous ReadableCustomIO can be used only with the sync methods"};
+  if (aborted)
+    return AVERROR_EXIT;
+
+  stats.calls++;
+  stats.bytes += size;
+  Stats::Add(Stats::ReadableBytesCopied, size);
+
+  if (sink.IsEmpty()) {
+    auto *buffer = new BufferReadableItem{new uint8_t[size], size};
+    memcpy(buffer->data, data, size);
+    queue.push(buffer);
+    queue_size += size;
+    return size;
+  }
+
+  Napi::HandleScope scope{Env()};
+  try {
+    sink.Call(Value(), {Napi::Buffer<uint8_t>::Copy(Env(), data, size)});
+  } catch (const Napi::Error &err) {
+    verbose("ReadableCustomIO: sink callback threw: %s\n", err.what());
+    return AVERROR_EXTERNAL;
+  }
+  return size;
+}
+
+// The data already queued can still be read from JS
+void ReadableCustomIO::Abort(const Napi::CallbackInfo &info) {
+  verbose("ReadableCustomIO: JS is aborting\n");
+  std::unique_lock lk{lock};
+  aborted = true;
+  lk.unlock();
+  cv.notify_all();
+}
+
 int64_t ReadableCustomIO::seek(int64_t offset, int whence) {
   verbose("ReadableCustomIO: seek %lld (%d)\n", offset, whence);
   if (offset != 0) {
@@ -173,6 +245,8 @@ void ReadableCustomIO::_Read(const Napi::CallbackInfo &info) {
 
   verbose("ReadableCustomIO %p: JS is reading, queue_size is %lu\n", this, queue_size);
 
+  if (sync)
+    throw Napi::Error::New(env, "A synchronous ReadableCustomIO cannot be read as a stream");
   if (eof)
     throw Napi::Error::New(env, "_read past EOF");
   if (flowing) {
@@ -189,6 +263,13 @@ void ReadableCustomIO::_Read(const Napi::CallbackInfo &info) {
 void ReadableCustomIO::_Final(const Napi::CallbackInfo &info) {
   verbose("ReadableCustomIO: received EOF\n");
 
+  if (sync) {
+    eof = true;
+    if (info[0].IsFunction())
+      info[0].As<Napi::Function>().Call({});
+    return;
+  }
+
   auto *buffer = new BufferReadableItem{nullptr, 0};
 
   if (info[0].IsFunction()) {
@@ -199,3 +280,30 @@ void ReadableCustomIO::_Final(const Napi::CallbackInfo &info) {
   queue.push(buffer);
   uv_async_send(push_callback);
 }
+
+Napi::Value ReadableCustomIO::Drain(const Napi::CallbackInfo &info) {
+  Napi::Env env{info.Env()};
+  if (!sync)
+    throw Napi::Error::New(env, "drain() is supported only in synchronous mode");
+
+  Napi::Array r = Napi::Array::New(env, queue.size());
+  for (uint32_t i = 0; !queue.empty(); i++) {
+    auto buf = queue.front();
+    queue.pop();
+#ifdef NODE_API_NO_EXTERNAL_BUFFERS_ALLOWED
+    r.Set(i, Napi::Buffer<uint8_t>::Copy(env, buf->data, buf->length));
+    delete[] buf->data;
+#else
+    r.Set(i, Napi::Buffer<uint8_t>::New(env, buf->data, buf->length,
+                                        [](Napi::Env, uint8_t *buffer) { delete[] buffer; }));
+#endif
+    delete buf;
+  }
+  queue_size = 0;
+  return r;
+}
+
+Napi::Value ReadableCustomIO::GetStats(const Napi::CallbackInfo &info) {
+  std::unique_lock lk{lock};
+  return Stats::Snapshot(info.Env(), {stats.calls, stats.bytes, stats.wait_time, queue_size});
+}
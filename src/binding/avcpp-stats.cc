@@ -0,0 +1,44 @@
+#include "avcpp-stats.h"
+
+namespace Stats {
+
+std::atomic<uint64_t> counters[Count] = {};
+
+static const char *names[Count] = {"frameBytesCopied", "readableBytesCopied", "writableBytesCopied",
+                                   "readableWaitTime", "writableWaitTime",    "executorJobs",
+                                   "executorRunTime",  "executorWaitTime",    "packetBytesCopied"};
+
+Napi::Float64Array Snapshot(Napi::Env env, std::initializer_list<uint64_t> values) {
+  Napi::Float64Array r = Napi::Float64Array::New(env, values.size());
+  size_t i = 0;
+  for (auto v : values)
+    r[i++] = static_cast<double>(v);
+  return r;
+}
+
+Napi::Value Get(const Napi::CallbackInfo &info) {
+  Napi::Float64Array r = Napi::Float64Array::New(info.Env(), Count);
+  for (size_t i = 0; i < Count; i++)
+    r[i] = static_cast<double>(counters[i].load(std::memory_order_relaxed));
+  return r;
+}
+
+Napi::Array Fields(Napi::Env env) {
+  Napi::Array r = Napi::Array::New(env, Count);
+  for (size_t i = 0; i < Count; i++)
+    r.Set(i, Napi::String::New(env, names[i]));
+  return r;
+}
+
+const char *TypeScriptFragment = R"(
+/**
+ * Snapshot of the process-wide native counters, the fields are named in statsFields.
+ * All times are in nanoseconds.
+ */
+export function stats(): Float64Array;
+export const statsFields: readonly ('frameBytesCopied' | 'readableBytesCopied' | 'writableBytesCopied' |
+  'readableWaitTime' | 'writableWaitTime' | 'executorJobs' | 'executorRunTime' | 'executorWaitTime' |
+  'packetBytesCopied')[];
+)";
+
+} // namespace Stats
@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <napi.h>
+
+// Process-wide counters of the native side
+//
+// They are updated with relaxed atomics from any thread and they are
+// read from JS as a single Float64Array snapshot by ffmpeg.stats(),
+// the names of the fields are in ffmpeg.statsFields
+// All times are in nanoseconds
+namespace Stats {
+
+enum Counter : size_t {
+  // Bytes copied by VideoFrame.data()
+  FrameBytesCopied,
+  // Bytes copied by ReadableCustomIO::write and WritableCustomIO::read
+  ReadableBytesCopied,
+  WritableBytesCopied,
+  // Time ffmpeg spent blocked waiting for JS in the CustomIO
+  ReadableWaitTime,
+  WritableWaitTime,
+  // MediaExecutor jobs, time spent running them and time spent in the queue
+  ExecutorJobs,
+  ExecutorRunTime,
+  ExecutorWaitTime,
+  // Bytes copied by Packet.wrap() when the Buffer cannot be used without copying
+  PacketBytesCopied,
+  Count
+};
+
+extern std::atomic<uint64_t> counters[Count];
+
+inline void Add(Counter counter, uint64_t value) { counters[counter].fetch_add(value, std::memory_order_relaxed); }
+
+// Monotonic time in nanoseconds
+inline uint64_t Now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// A new Float64Array with a copy of the values
+Napi::Float64Array Snapshot(Napi::Env env, std::initializer_list<uint64_t> values);
+
+// The JS ffmpeg.stats()
+Napi::Value Get(const Napi::CallbackInfo &info);
+
+// The JS ffmpeg.statsFields
+Napi::Array Fields(Napi::Env env);
+
+extern const char *TypeScriptFragment;
+
+} // namespace Stats
@@ -0,0 +1,111 @@
+#include "avcpp-transfer.h"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+struct FrameDeleter {
+  void operator()(AVFrame *frame) const { av_frame_free(&frame); }
+};
+struct PacketDeleter {
+  void operator()(AVPacket *packet) const { av_packet_free(&packet); }
+};
+
+// The avcpp objects keep the time base and the stream index outside
+// of the AVFrame/AVPacket, they are transferred along with the reference
+// It owns the reference and it can only be moved
+struct Transferred {
+  std::unique_ptr<AVFrame, FrameDeleter> frame;
+  std::unique_ptr<AVPacket, PacketDeleter> packet;
+  Rational timeBase;
+  int streamIndex;
+
+  Transferred(AVFrame *frame, AVPacket *packet, const Rational &timeBase, int streamIndex)
+      : frame{frame}, packet{packet}, timeBase{timeBase}, streamIndex{streamIndex} {}
+  Transferred(Transferred &&) = default;
+  Transferred &operator=(Transferred &&) = default;
+  Transferred(const Transferred &) = delete;
+  Transferred &operator=(const Transferred &) = delete;
+};
+
+// Shared by all environments of the process
+static std::mutex registry_lock;
+static std::map<int64_t, Transferred> registry;
+// Remains a safe integer in JS
+static std::atomic<int64_t> last_id{0};
+
+static int64_t Store(AVFrame *frame, AVPacket *packet, const Rational &timeBase, int streamIndex) {
+  int64_t id = ++last_id;
+  std::lock_guard lk{registry_lock};
+  registry.try_emplace(id, frame, packet, timeBase, streamIndex);
+  return id;
+}
+
+template <typename T> static int64_t TransferFrame(T &frame) {
+  if (frame.isNull())
+    throw std::invalid_argument{"Cannot transfer an empty frame"};
+  AVFrame *ref = av_frame_alloc();
+  if (ref == nullptr)
+    throw std::bad_alloc{};
+  int r = av_frame_ref(ref, frame.raw());
+  if (r < 0) {
+    av_frame_free(&ref);
+    throw std::runtime_error{"Failed referencing the frame"};
+  }
+  return Store(ref, nullptr, frame.timeBase(), frame.streamIndex());
+}
+
+// Removes the entry and hands over its ownership to the caller
+static Transferred Take(int64_t id) {
+  std::lock_guard lk{registry_lock};
+  auto it = registry.find(id);
+  if (it == registry.end())
+    throw std::invalid_argument{"Transfer " + std::to_string(id) + " does not exist or it has already been adopted"};
+  Transferred r{std::move(it->second)};
+  registry.erase(it);
+  return r;
+}
+
+template <typename T> static T AdoptFrame(int64_t id) {
+  Transferred t = Take(id);
+  if (!t.frame)
+    throw std::invalid_argument{"Transfer " + std::to_string(id) + " is not a frame"};
+  // This adds a new reference, the one from the registry is freed with t
+  T frame{t.frame.get()};
+  frame.setTimeBase(t.timeBase);
+  frame.setStreamIndex(t.streamIndex);
+  return frame;
+}
+
+int64_t TransferVideoFrame(VideoFrame &frame) { return TransferFrame(frame); }
+int64_t TransferAudioSamples(AudioSamples &samples) { return TransferFrame(samples); }
+
+int64_t TransferPacket(Packet &packet) {
+  if (packet.isNull())
+    throw std::invalid_argument{"Cannot transfer an empty packet"};
+  AVPacket *ref = av_packet_clone(packet.raw());
+  if (ref == nullptr)
+    throw std::runtime_error{"Failed referencing the packet"};
+  return Store(nullptr, ref, packet.timeBase(), packet.streamIndex());
+}
+
+VideoFrame AdoptVideoFrame(int64_t id) { return AdoptFrame<VideoFrame>(id); }
+AudioSamples AdoptAudioSamples(int64_t id) { return AdoptFrame<AudioSamples>(id); }
+
+Packet AdoptPacket(int64_t id) {
+  Transferred t = Take(id);
+  if (!t.packet)
+    throw std::invalid_argument{"Transfer " + std::to_string(id) + " is not a packet"};
+  // Same as the frames, this adds a new reference
+  Packet packet{t.packet.get()};
+  packet.setTimeBase(t.timeBase);
+  packet.setStreamIndex(t.streamIndex);
+  return packet;
+}
+
+bool ReleaseTransfer(int64_t id) {
+  std::lock_guard lk{registry_lock};
+  return registry.erase(id) > 0;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <frame.h>
+#include <packet.h>
+#include <rational.h>
+
+using namespace av;
+
+// Frames and packets cannot be shared between worker_threads - every
+// isolate has its own JS objects - but the underlying ffmpeg buffers are
+// reference counted and can be used by any thread.
+//
+// transfer() stores a new reference to the buffers in a process-wide
+// registry and returns a numeric id that can be posted to another thread
+// where adopt() creates a new object that takes over the reference.
+// No data is copied. Each id can be adopted only once, unclaimed ids must be
+// freed by releaseTransfer().
+int64_t TransferVideoFrame(VideoFrame &frame);
+int64_t TransferAudioSamples(AudioSamples &samples);
+int64_t TransferPacket(Packet &packet);
+
+VideoFrame AdoptVideoFrame(int64_t id);
+AudioSamples AdoptAudioSamples(int64_t id);
+Packet AdoptPacket(int64_t id);
+
+// Returns false if the id has already been adopted or released
+bool ReleaseTransfer(int64_t id);
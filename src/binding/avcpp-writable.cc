@@ -1,19 +1,44 @@
 #include "avcpp-customio.h"
 #include "debug.h"
+#include <algorithm>
 #include <exception>
 
 WritableCustomIO::WritableCustomIO(const Napi::CallbackInfo &info)
-    : av::CustomIO(), Napi::ObjectWrap<WritableCustomIO>(info), eof(false) {
+    : av::CustomIO(), Napi::ObjectWrap<WritableCustomIO>(info), queue_size(0), eof(false), aborted(false), sync(false) {
   Napi::Env env{info.Env()};
 
   instance_data = env.GetInstanceData<Nobind::EnvInstanceData<ffmpegInstanceData>>();
   if (instance_data->js_Writable_ctor.IsEmpty() || instance_data->js_WritableCustomIO_ctor.IsEmpty())
     throw Napi::Error::New(env, "ReadableCustomIO is not initalized");
 
-  instance_data->js_Writable_ctor.Call(this->Value(), {});
+  Napi::Object writable_options = Napi::Object::New(env);
+  if (info.Length() > 0 && info[0].IsObject()) {
+    Napi::Object options = info[0].ToObject();
+    if (options.Has("pull")) {
+      if (!options.Get("pull").IsFunction())
+        throw Napi::TypeError::New(env, "pull must be a function");
+      pull = Napi::Persistent(options.Get("pull").As<Napi::Function>());
+      sync = true;
+    }
+    if (options.Has("sync"))
+      sync = sync || options.Get("sync").ToBoolean().Value();
+    if (options.Has("highWaterMark"))
+      writable_options.Set("highWaterMark", options.Get("highWaterMark"));
+  }
+
+  instance_data->js_Writable_ctor.Call(this->Value(), {writable_options});
+  // In synchronous mode the native queue is limited to the high-water mark of the Writable
+  high_water_mark = this->Value().Get("writableHighWaterMark").ToNumber().Int64Value();
 }
 
-WritableCustomIO::~WritableCustomIO() { verbose("WritableCustomIO: destroy\n"); }
+WritableCustomIO::~WritableCustomIO() {
+  verbose("WritableCustomIO: destroy\n");
+  // In async mode the items are freed by their callbacks
+  while (sync && !queue.empty()) {
+    delete queue.front();
+    queue.pop();
+  }
+}
 
 void WritableCustomIO::Init(const Napi::CallbackInfo &info) {
   Napi::Env env{info.Env()};
@@ -29,15 +54,27 @@ Napi::Function WritableCustomIO::GetClass(Napi::Env env) {
   Napi::Function self =
       DefineClass(env, "WritableCustomIO",
                   {StaticMethod("init", &WritableCustomIO::Init), InstanceMethod("_write", &WritableCustomIO::_Write),
-                   InstanceMethod("_final", &WritableCustomIO::_Final)});
+                   InstanceMethod("_final", &WritableCustomIO::_Final),
+                   InstanceMethod("enqueue", &WritableCustomIO::Enqueue),
+                   InstanceMethod("abort", &WritableCustomIO::Abort),
+                   InstanceMethod("stats", &WritableCustomIO::GetStats)});
 
   auto instance_data = env.GetInstanceData<Nobind::EnvInstanceData<ffmpegInstanceData>>();
   instance_data->js_WritableCustomIO_ctor = Napi::Persistent(self);
   return self;
 }
 
+void WritableCustomIO::CountRead(size_t bytes, uint64_t wait) {
+  stats.bytes += bytes;
+  stats.wait_time += wait;
+  Stats::Add(Stats::WritableBytesCopied, bytes);
+  Stats::Add(Stats::WritableWaitTime, wait);
+}
+
 int WritableCustomIO::read(uint8_t *data, size_t size) {
   verbose("WritableCustomIO: ffmpeg asked for data %lu\n", (long unsigned)size);
+  if (sync)
+    return ReadSync(data, size);
   if (std::this_thread::get_id() == instance_data->v8_main_thread)
     throw std::logic_error{"This function cannot be called in sync mode"};
   if (eof) {
@@ -45,8 +82,15 @@ int WritableCustomIO::read(uint8_t *data, size_t size) {
     return AVERROR_EOF;
   }
 
+  stats.calls++;
   std::unique_lock lk{lock};
-  cv.wait(lk, [this] { return !queue.empty(); });
+  uint64_t wait = Stats::Now();
+  cv.wait(lk, [this] { return !queue.empty() || aborted; });
+  wait = Stats::Now() - wait;
+  if (aborted) {
+    verbose("WritableCustomIO: aborted, sending an AVERROR_EXIT to ffmpeg\n");
+    return AVERROR_EXIT;
+  }
 
   verbose("WritableCustomIO: will send data to ffmpeg\n");
   size_t remaining = size;
@@ -59,6 +103,7 @@ int WritableCustomIO::read(uint8_t *data, size_t size) {
       buf->callback.NonBlockingCall();
       buf->callback.Release();
       eof = true;
+      CountRead(size - remaining, wait);
       return size - remaining;
     }
     size_t buf_remaining = buf->length - (buf->current - buf->data);
@@ -68,6 +113,7 @@ int WritableCustomIO::read(uint8_t *data, size_t size) {
       // The current BufferWritableItem has more data than we need
       memcpy(dst, buf->current, remaining);
       buf->current += remaining;
+      queue_size -= remaining;
       dst += remaining;
       remaining = 0;
     } else {
@@ -75,6 +121,7 @@ int WritableCustomIO::read(uint8_t *data, size_t size) {
       verbose("WritableCustomIO: will consume BufferWritableItem %p %lu, need %lu\n", buf->current, buf_remaining,
               remaining);
       memcpy(dst, buf->current, buf_remaining);
+      queue_size -= buf_remaining;
       dst += buf_remaining;
       remaining -= buf_remaining;
       buf->callback.NonBlockingCall();
@@ -83,14 +130,128 @@ int WritableCustomIO::read(uint8_t *data, size_t size) {
       queue.pop();
       if (queue.empty() && remaining > 0) {
         verbose("WritableCustomIO: ate everything, still need more, will go back to sleep\n");
-        cv.wait(lk, [this] { return !queue.empty(); });
+        uint64_t start = Stats::Now();
+        cv.wait(lk, [this] { return !queue.empty() || aborted; });
+        wait += Stats::Now() - start;
+        if (aborted) {
+          // The next read will return AVERROR_EXIT
+          CountRead(size - remaining, wait);
+          return size - remaining;
+        }
       }
     }
   }
   verbose("WritableCustomIO: returning data to ffmpeg\n");
+  CountRead(size, wait);
   return size;
 }
 
+// Synchronous mode, runs in the JS thread, everything happens in-line
+// and there is no need for locking
+int WritableCustomIO::ReadSync(uint8_t *data, size_t size) {
+  if (std::this_thread::get_id() != instance_data->v8_main_thread)
+    throw std::logic_error{"A synchronous WritableCustomIO can be used only with the sync methods"};
+  if (aborted)
+    return AVERROR_EXIT;
+
+  stats.calls++;
+  size_t copied = 0;
+  while (copied < size) {
+    if (queue.empty() && !eof && copied == 0) {
+      // ffmpeg accepts short reads, the pull callback is called only when there is nothing to return
+      if (pull.IsEmpty()) {
+        verbose("WritableCustomIO: the queue of a synchronous WritableCustomIO without a pull callback ran dry\n");
+        Fail("WritableCustomIO ran out of data before the end of the input, enqueue() more data "
+             "with a null at the end or use a pull callback");
+        return AVERROR_EXTERNAL;
+      }
+      Napi::HandleScope scope{Env()};
+      try {
+        Append(pull.Call(Value(), {Napi::Number::New(Env(), static_cast<double>(size))}));
+        if (queue.empty())
+          throw Napi::TypeError::New(Env(), "pull returned an empty Buffer, null signals EOF");
+      } catch (const Napi::Error &err) {
+        verbose("WritableCustomIO: pull callback threw: %s\n", err.what());
+        return AVERROR_EXTERNAL;
+      }
+    }
+    if (queue.empty())
+      break;
+
+    auto *buf = queue.front();
+    if (buf->data == nullptr) {
+      verbose("WritableCustomIO: reached EOF in sync mode\n");
+      eof = true;
+      queue.pop();
+      delete buf;
+      break;
+    }
+    size_t len = std::min(size - copied, static_cast<size_t>(buf->length - (buf->current - buf->data)));
+    memcpy(data + copied, buf->current, len);
+    buf->current += len;
+    queue_size -= len;
+    copied += len;
+    if (buf->current == buf->data + buf->length) {
+      queue.pop();
+      delete buf;
+    }
+  }
+  CountRead(copied, 0);
+  ReleasePendingWrite();
+
+  if (copied > 0)
+    return copied;
+  verbose("WritableCustomIO: sending an EOF to ffmpeg\n");
+  return AVERROR_EOF;
+}
+
+// A synchronous _write() that has filled the queue above the high-water mark keeps its callback
+// until ffmpeg has consumed enough data, the Writable buffers the following writes meanwhile
+void WritableCustomIO::ReleasePendingWrite() {
+  if (pending_write.IsEmpty() || queue_size >= high_water_mark)
+    return;
+  Napi::HandleScope scope{Env()};
+  Napi::Function callback = pending_write.Value();
+  pending_write.Reset();
+  try {
+    callback.Call({});
+  } catch (const Napi::Error &err) {
+    verbose("WritableCustomIO: write callback threw: %s\n", err.what());
+  }
+}
+
+// ffmpeg receives only an error code, the explanation goes to the 'error' event of the Writable
+void WritableCustomIO::Fail(const char *msg) {
+  Napi::HandleScope scope{Env()};
+  try {
+    Value().Get("destroy").As<Napi::Function>().Call(Value(), {Napi::Error::New(Env(), msg).Value()});
+  } catch (const Napi::Error &err) {
+    verbose("WritableCustomIO: destroy threw: %s\n", err.what());
+  }
+}
+
+// Adds a Buffer or an EOF (null or undefined) to the queue of a synchronous WritableCustomIO
+void WritableCustomIO::Append(const Napi::Value &data) {
+  if (data.IsNull() || data.IsUndefined()) {
+    queue.push(new BufferWritableItem{nullptr, nullptr, 0, {}, {}});
+    return;
+  }
+  if (!data.IsBuffer())
+    throw Napi::TypeError::New(data.Env(), "Expected a Buffer or null");
+  auto buffer = data.As<Napi::Buffer<uint8_t>>();
+  if (buffer.Length() == 0)
+    return;
+  queue.push(
+      new BufferWritableItem{buffer.Data(), buffer.Data(), buffer.Length(), Napi::Persistent<Napi::Object>(buffer), {}});
+  queue_size += buffer.Length();
+}
+
+void WritableCustomIO::Enqueue(const Napi::CallbackInfo &info) {
+  if (!sync)
+    throw Napi::Error::New(info.Env(), "enqueue() is supported only in synchronous mode");
+  Append(info[0]);
+}
+
 int64_t WritableCustomIO::seek(int64_t offset, int whence) {
   if (offset != 0) {
     fprintf(stderr, "ffmpeg tried to seek in a ReadStream\n");
@@ -113,6 +274,21 @@ void WritableCustomIO::_Write(const Napi::CallbackInfo &info) {
   auto buffer = info[0].As<Napi::Buffer<uint8_t>>();
   verbose("WritableCustomIO: buffer %p length %lu\n", buffer.Data(), (unsigned long)buffer.Length());
 
+  if (aborted) {
+    callback.Call({Napi::Error::New(env, "WritableCustomIO has been aborted").Value()});
+    return;
+  }
+
+  if (sync) {
+    // Nothing will consume it asynchronously, the data is simply queued
+    Append(buffer);
+    if (queue_size < high_water_mark)
+      callback.Call({});
+    else
+      pending_write = Napi::Persistent(callback);
+    return;
+  }
+
   std::unique_lock lk(lock);
   auto item =
       new BufferWritableItem{buffer.Data(), buffer.Data(), buffer.Length(), Napi::Persistent<Napi::Object>(buffer), {}};
@@ -121,6 +297,7 @@ void WritableCustomIO::_Write(const Napi::CallbackInfo &info) {
     delete item;
   });
   queue.push(item);
+  queue_size += buffer.Length();
 
   lk.unlock();
   cv.notify_one();
@@ -134,6 +311,17 @@ void WritableCustomIO::_Final(const Napi::CallbackInfo &info) {
     throw Napi::Error::New(env, "Readable did not provide a callback");
   Napi::Function callback = info[0].As<Napi::Function>();
 
+  if (aborted) {
+    callback.Call({Napi::Error::New(env, "WritableCustomIO has been aborted").Value()});
+    return;
+  }
+
+  if (sync) {
+    Append(env.Null());
+    callback.Call({});
+    return;
+  }
+
   std::unique_lock lk(lock);
   auto item = new BufferWritableItem{nullptr, nullptr, 0, {}, {}};
   item->callback = Napi::ThreadSafeFunction::New(env, callback, "ffmpeg_Writable_IO", 0, 1, [item](Napi::Env) {
@@ -145,3 +333,38 @@ void WritableCustomIO::_Final(const Napi::CallbackInfo &info) {
   lk.unlock();
   cv.notify_one();
 }
+
+// aborted is written only by the main thread, the lock protects it from the readers
+void WritableCustomIO::Abort(const Napi::CallbackInfo &info) {
+  verbose("WritableCustomIO: JS is aborting\n");
+  std::unique_lock lk{lock};
+  aborted = true;
+  // The pending writes will never be consumed, in async mode their callbacks
+  // fail the Writable and releasing them frees the items and the Buffers
+  while (!queue.empty()) {
+    auto *buf = queue.front();
+    queue.pop();
+    queue_size -= buf->length - (buf->current - buf->data);
+    if (sync) {
+      delete buf;
+    } else {
+      buf->callback.NonBlockingCall([](Napi::Env env, Napi::Function callback) {
+        callback.Call({Napi::Error::New(env, "WritableCustomIO has been aborted").Value()});
+      });
+      buf->callback.Release();
+    }
+  }
+  lk.unlock();
+  cv.notify_all();
+
+  if (!pending_write.IsEmpty()) {
+    Napi::Function callback = pending_write.Value();
+    pending_write.Reset();
+    callback.Call({Napi::Error::New(info.Env(), "WritableCustomIO has been aborted").Value()});
+  }
+}
+
+Napi::Value WritableCustomIO::GetStats(const Napi::CallbackInfo &info) {
+  std::unique_lock lk{lock};
+  return Stats::Snapshot(info.Env(), {stats.calls, stats.bytes, stats.wait_time, queue_size});
+}
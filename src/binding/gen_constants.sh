@@ -19,6 +19,7 @@ ${SED} -nr 's/^[^\s]*\s+AV_PICTURE_TYPE_([_A-Z0-9]+)[, ].*/AVPictureType AV_PICT
 ${SED} -nr 's/^[^\s]*\s+AV_CH_LAYOUT_([_A-Z0-9]+)[, ].*/int64_t AV_CH_LAYOUT_\1 AV_CH_LAYOUT_\1/p' ${FFMPEG}/src/libavutil/channel_layout.h
 ${SED} -nr 's/^[^\s]*\s+AV_PIX_FMT_([_A-Z0-9]+)[, ].*/AVPixelFormat AV_PIX_FMT_\1 AV_PIX_FMT_\1/p' ${FFMPEG}/src/libavutil/pixfmt.h | sort | uniq
 ${SED} -nr 's/^[^\s]*\s+AV_SAMPLE_FMT_([_A-Z0-9]+)[, ].*/AVSampleFormat AV_SAMPLE_FMT_\1 AV_SAMPLE_FMT_\1/p' ${FFMPEG}/src/libavutil/samplefmt.h | sort | uniq
+${SED} -nr 's/^[^\s]*\s+AV_PKT_FLAG_([_A-Z0-9]+)[, ].*/int64_t AV_PKT_FLAG_\1 AV_PKT_FLAG_\1/p' ${FFMPEG}/src/libavcodec/packet.h | sort | uniq
 ${SED} -nr 's/^[^\s]*\s+AVFMT_([_A-Z0-9]+)[, ].*/int64_t AVFMT_\1 AV_FMT_\1/p' ${FFMPEG}/src/libavformat/avformat.h | sort | uniq
 ${SED} -nr 's/^[^\s]*\s+AV_LOG_([_A-Z0-9]+)[, ].*/int64_t AV_LOG_\1 AV_LOG_\1/p' ${FFMPEG}/src/libavutil/log.h | sort | uniq
 ${SED} -nr 's/^[^\s]*\s+SWS_([_A-Z0-9]+)[, ].*/int64_t SWS_\1 SWS_\1/p' ${FFMPEG}/src/libswscale/swscale.h | sort | uniq
@@ -1,11 +1,23 @@
 #pragma once
+#include <memory>
 #include <napi.h>
 #include <thread>
 
+namespace Memory {
+struct Waiters;
+}
+namespace WrappedPackets {
+struct Registry;
+}
+
 struct ffmpegInstanceData {
   std::thread::id v8_main_thread;
   Napi::FunctionReference js_Writable_ctor;
   Napi::FunctionReference js_Readable_ctor;
   Napi::FunctionReference js_ReadableCustomIO_ctor;
   Napi::FunctionReference js_WritableCustomIO_ctor;
+  // Created when the memory accounting is first used
+  std::shared_ptr<Memory::Waiters> memory;
+  // Created by the first Packet.wrap()
+  std::shared_ptr<WrappedPackets::Registry> wrapped;
 };
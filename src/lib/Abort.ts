@@ -0,0 +1,115 @@
+import ffmpeg from '@mmomtchev/ffmpeg';
+
+export interface AbortOptions {
+  /**
+   * Aborts the pending and all future I/O operations
+   */
+  signal?: AbortSignal;
+  /**
+   * Maximum duration in milliseconds of a single blocking I/O operation -
+   * opening, reading or writing a packet - before it is aborted, @default unlimited
+   */
+  timeout?: number;
+}
+
+function abortError(reason?: unknown): Error {
+  if (reason instanceof Error) return reason;
+  const err = new Error(reason !== undefined ? String(reason) : 'The operation was aborted');
+  err.name = 'AbortError';
+  return err;
+}
+
+/**
+ * Ties the blocking native I/O of a FormatContext and its CustomIO to
+ * an AbortSignal and a timeout.
+ *
+ * Aborting wakes up the worker thread stuck in ffmpeg - through the interrupt
+ * callback of the context and the abort() of the CustomIO - and every pending
+ * or future operation run through the guard rejects with the abort reason.
+ * `onAbort` is called synchronously, the owner must deliver the error itself
+ * only if it is not running an operation.
+ */
+export class IOGuard {
+  readonly token: ffmpeg.AbortToken;
+  protected timeout: number | undefined;
+  protected signal: AbortSignal | undefined;
+  protected listener: (() => void) | undefined;
+  protected io: ffmpeg.WritableCustomIO | ffmpeg.ReadableCustomIO | undefined;
+  protected onAbort: (reason: Error) => void;
+  reason: Error | undefined;
+
+  constructor(options: AbortOptions | undefined, onAbort: (reason: Error) => void) {
+    this.token = new ffmpeg.AbortToken;
+    this.timeout = options?.timeout;
+    this.onAbort = onAbort;
+    this.signal = options?.signal;
+    if (this.signal) {
+      const signal = this.signal;
+      if (signal.aborted) {
+        // Let the constructor of the owner return first
+        process.nextTick(() => this.abort(abortError(signal.reason)));
+      } else {
+        this.listener = () => this.abort(abortError(signal.reason));
+        signal.addEventListener('abort', this.listener, { once: true });
+      }
+    }
+  }
+
+  /**
+   * Attach the guard to a context, must be called before it is opened
+   */
+  attach(context: ffmpeg.FormatContext, io?: ffmpeg.WritableCustomIO | ffmpeg.ReadableCustomIO): void {
+    context.setAbortToken(this.token);
+    this.io = io;
+  }
+
+  get aborted(): boolean {
+    return this.reason !== undefined;
+  }
+
+  abort(reason?: Error): void {
+    if (this.reason) return;
+    this.reason = reason ?? abortError();
+    this.token.abort();
+    this.io?.abort();
+    this.dispose();
+    this.onAbort(this.reason);
+  }
+
+  /**
+   * Run a native I/O operation, it is aborted if it does not complete within the timeout
+   */
+  async run<T>(op: Promise<T>, what: string): Promise<T> {
+    if (this.reason) {
+      // It will fail immediately with AVERROR_EXIT
+      op.catch(() => undefined);
+      throw this.reason;
+    }
+    let timer: NodeJS.Timeout | undefined;
+    if (this.timeout !== undefined) {
+      timer = setTimeout(() => {
+        const err = new Error(`${what} timed out after ${this.timeout}ms`);
+        err.name = 'TimeoutError';
+        this.abort(err);
+      }, this.timeout);
+    }
+    try {
+      const r = await op;
+      if (this.reason) throw this.reason;
+      return r;
+    } catch (err) {
+      throw this.reason ?? err;
+    } finally {
+      clearTimeout(timer);
+    }
+  }
+
+  /**
+   * Stop listening to the signal, to be called when the I/O is finished
+   */
+  dispose(): void {
+    if (this.signal && this.listener)
+      this.signal.removeEventListener('abort', this.listener);
+    this.listener = undefined;
+  }
+}
@@ -1,6 +1,9 @@
 import ffmpeg, { AudioDecoderContext, Codec } from '@mmomtchev/ffmpeg';
-import { AudioReadable, AudioStreamDefinition, EncodedMediaWritable, MediaDecoder, MediaTransform } from './MediaStream';
+import { AudioReadable, AudioStreamDefinition, EncodedMediaWritable, ExecutorOptions, MediaDecoder, MediaTransform } from './MediaStream';
 import { TransformCallback } from 'stream';
+import { once } from 'node:events';
+import { prefetch, PrefetchOptions } from './Prefetch';
+import { StageStats } from './Stats';
 
 export const verbose = (process.env.DEBUG_AUDIO_DECODER || process.env.DEBUG_ALL) ? console.debug.bind(console) : () => undefined;
 
@@ -12,9 +15,13 @@ export const verbose = (process.env.DEBUG_AUDIO_DECODER || process.env.DEBUG_ALL
 export class AudioDecoder extends MediaTransform implements MediaDecoder, EncodedMediaWritable, AudioReadable {
   protected decoder: ffmpeg.AudioDecoderContext;
   protected busy: boolean;
+  protected executor: ffmpeg.MediaExecutor | undefined;
+  protected pipeline: number;
   ready: boolean;
+  // Per-stage counters
+  readonly stats = new StageStats;
 
-  constructor(options: { stream?: ffmpeg.Stream; }) {
+  constructor(options: { stream?: ffmpeg.Stream; } & ExecutorOptions) {
     super();
     if (!options.stream) {
       throw new Error('Input is not a demuxed stream');
@@ -24,6 +31,8 @@ export class AudioDecoder extends MediaTransform implements MediaDecoder, Encode
     }
     this.decoder = new AudioDecoderContext(options.stream);
     this.decoder.setRefCountedFrames(true);
+    this.executor = options.executor;
+    this.pipeline = options.pipeline ?? 0;
     this.busy = false;
     this.ready = false;
   }
@@ -42,24 +51,101 @@ export class AudioDecoder extends MediaTransform implements MediaDecoder, Encode
       .catch(callback);
   }
 
-  _transform(packet: ffmpeg.Packet, encoding: BufferEncoding, callback: TransformCallback): void {
+  /**
+   * Decode a single packet
+   */
+  protected async decode(packet: ffmpeg.Packet): Promise<ffmpeg.AudioSamples | null> {
+    // Do not produce more frames while over the memory budget (ffmpeg.setMemoryBudget)
+    const memory = ffmpeg.waitForMemory();
+    if (memory) {
+      verbose('AudioDecoder: waiting for memory');
+      await memory;
+    }
+    const samples = await this.stats.measure(this.executor ?
+      this.executor.decodeAudio(this.pipeline, this.decoder, packet) :
+      this.decoder!.decodeAsync(packet));
+    const info = samples.info();
+    if (info.isComplete) {
+      samples.track();
+      this.stats.frames++;
+      verbose(`AudioDecoder: Decoded samples: pts=${info.pts} / ${info.seconds} / ${info.timeBase.join('/')} / ${info.sampleFormat}@${info.sampleRate}, size=${info.size} / channels: ${info.channelsCount} }`);
+      return samples;
+    }
+    verbose('AudioDecoder: empty frame');
+    return null;
+  }
+
+  /**
+   * Decode a packet and yield the resulting samples, `null` marks the end
+   * of the input and flushes the samples still held by the decoder.
+   * This is the primitive shared by the Transform stream and the async iterator.
+   */
+  protected async *decodePacket(packet: ffmpeg.Packet | null): AsyncGenerator<ffmpeg.AudioSamples, void, undefined> {
+    if (packet) {
+      const samples = await this.decode(packet);
+      if (samples) yield samples;
+      return;
+    }
+    verbose('AudioDecoder: flushing the decoder');
+    // An empty packet flushes the decoder, it returns one frame of samples per call
+    for (;;) {
+      const samples = await this.decode(new ffmpeg.Packet);
+      if (!samples) return;
+      yield samples;
+    }
+  }
+
+  protected async *decodeAll(source: AsyncIterable<ffmpeg.Packet>): AsyncGenerator<ffmpeg.AudioSamples, void, undefined> {
+    for await (const packet of source)
+      yield* this.decodePacket(packet);
+    yield* this.decodePacket(null);
+  }
+
+  protected decodeChunk(packet: ffmpeg.Packet | null, callback: TransformCallback): void {
     if (this.busy) return void callback(new Error('Decoder called while busy'));
-    verbose('AudioDecoder: decoding chunk');
     (async () => {
       this.busy = true;
-      const samples = await this.decoder!.decodeAsync(packet);
-      if (samples.isComplete()) {
-        verbose(`AudioDecoder: Decoded samples: pts=${samples.pts()} / ${samples.pts().seconds()} / ${samples.timeBase()} / ${samples.sampleFormat()}@${samples.sampleRate()}, size=${samples.size()}, ref=${samples.isReferenced()}:${samples.refCount()} / layout: ${samples.channelsLayoutString()} }`);
+      for await (const samples of this.decodePacket(packet))
         this.push(samples);
-      } else {
-        verbose('AudioDecoder: empty frame');
-      }
       this.busy = false;
       callback();
     })()
       .catch(callback);
   }
 
+  _transform(packet: ffmpeg.Packet, encoding: BufferEncoding, callback: TransformCallback): void {
+    verbose('AudioDecoder: decoding chunk');
+    this.decodeChunk(packet, callback);
+  }
+
+  _flush(callback: TransformCallback): void {
+    this.decodeChunk(null, callback);
+  }
+
+  /**
+   * Pull-based alternative to piping, decodes the packets
+   * coming from `source` and yields the decoded samples.
+   * Cannot be used at the same time as the stream interface.
+   *
+   * @example
+   * for await (const samples of decoder.frames(demuxer.packets({ streams: [0] })))
+   *   process(samples);
+   */
+  async *frames(source: AsyncIterable<ffmpeg.Packet>, options?: PrefetchOptions): AsyncGenerator<ffmpeg.AudioSamples, void, undefined> {
+    if (!this.ready) await once(this, 'ready');
+    const decoded = this.decodeAll(source);
+    this.busy = true;
+    try {
+      yield* prefetch(async () => {
+        const r = await decoded.next();
+        return r.done ? null : r.value;
+      }, options?.prefetch);
+    } finally {
+      this.busy = false;
+      await decoded.return();
+    }
+  }
+
   context() {
     return this.decoder;
   }
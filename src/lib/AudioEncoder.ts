@@ -1,6 +1,8 @@
-import ffmpeg, { AudioEncoderContext, AudioSamples } from '@mmomtchev/ffmpeg';
+import ffmpeg, { AudioSamples } from '@mmomtchev/ffmpeg';
 import { AudioStreamDefinition, AudioWritable, EncodedAudioReadable, MediaEncoder, MediaTransform } from './MediaStream';
 import { TransformCallback } from 'stream';
+import { StageStats } from './Stats';
+import { EncoderOptions, EncoderPool, createEncoderContext, findEncoderCodec } from './EncoderPool';
 
 export const verbose = (process.env.DEBUG_AUDIO_ENCODER || process.env.DEBUG_ALL) ? console.debug.bind(console) : () => undefined;
 
@@ -15,27 +17,31 @@ export class AudioEncoder extends MediaTransform implements MediaEncoder, Encode
   protected codec_: ffmpeg.Codec;
   stream_: ffmpeg.Stream;
   protected busy: boolean;
+  // The time base is fixed once the codec has been opened
+  protected timeBase: ffmpeg.Rational | undefined;
+  protected executor: ffmpeg.MediaExecutor | undefined;
+  protected pipeline: number;
+  protected pool: EncoderPool | undefined;
+  // Set when the encoder context comes from the pool
+  protected opened: boolean;
+  // The callback of a _writev() whose packets have filled the readable side
+  protected pending: ((error?: Error | null) => void) | undefined;
   type = 'Audio' as const;
   ready: boolean;
+  // Per-stage counters
+  readonly stats = new StageStats;
 
-  constructor(def: AudioStreamDefinition) {
+  constructor(def: AudioStreamDefinition, options?: EncoderOptions) {
     super();
     this.def = { ...def };
-    if (this.def.codec instanceof ffmpeg.Codec) {
-      this.codec_ = ffmpeg.findDecodingCodec(this.def.codec.id());
-    } else {
-      this.codec_ = ffmpeg.findEncodingCodec(this.def.codec);
-    }
+    this.executor = options?.executor;
+    this.pipeline = options?.pipeline ?? 0;
+    this.pool = options?.pool;
+    this.codec_ = findEncoderCodec(this.def);
     verbose(`AudioEncoder: using ${this.codec_.name()}`);
-    this.encoder = new AudioEncoderContext(this.codec_);
-    if (this.def.timeBase)
-      this.encoder.setTimeBase(this.def.timeBase);
-    else
-      this.encoder.setTimeBase(new ffmpeg.Rational(1, 1000));
-    this.encoder.setBitRate(this.def.bitRate);
-    this.encoder.setChannelLayout(this.def.channelLayout);
-    this.encoder.setSampleFormat(this.def.sampleFormat);
-    this.encoder.setSampleRate(this.def.sampleRate);
+    const pooled = this.pool?.take(this.def);
+    this.opened = !!pooled;
+    this.encoder = pooled ?? createEncoderContext(this.def, this.codec_);
     this.busy = false;
     this.ready = false;
     this.stream_ = this.encoder.stream();
@@ -44,13 +50,16 @@ export class AudioEncoder extends MediaTransform implements MediaEncoder, Encode
   _construct(callback: (error?: Error | null | undefined) => void): void {
     (async () => {
       this.busy = true;
-      verbose('AudioEncoder: priming the encoder', this.def.codecOptions);
-      await this.encoder.openCodecOptionsAsync(this.def.codecOptions ?? {}, this.codec_);
+      verbose(`AudioEncoder: priming the encoder, ${this.opened ? 'reusing a pooled encoder' : 'opening'}`,
+        this.def.codecOptions);
+      if (!this.opened)
+        await this.encoder.openCodecOptionsAsync(this.def.codecOptions ?? {}, this.codec_);
       verbose(`AudioEncoder: encoder primed, codec ${this.codec_.name()}, ` +
         `bitRate: ${this.encoder.bitRate()}, sampleFormat: ${this.encoder.sampleFormat()}@${this.encoder.sampleRate()}, ` +
         `timeBase: ${this.encoder.timeBase()}, frameSize: ${this.encoder.frameSize()}`
       );
       this.def.frameSize = this.encoder.frameSize();
+      this.timeBase = await this.encoder.timeBaseAsync();
       this.busy = false;
       callback();
       this.ready = true;
@@ -70,12 +79,16 @@ export class AudioEncoder extends MediaTransform implements MediaEncoder, Encode
       if (!(samples instanceof AudioSamples)) {
         return void callback(new Error('Input is not a raw audio'));
       }
-      if (!samples.isComplete()) {
+      const info = samples.info();
+      if (!info.isComplete) {
         return void callback(new Error('Received incomplete frame'));
       }
-      await samples.setTimeBaseAsync(await this.encoder.timeBaseAsync());
-      const packet = await this.encoder.encodeAsync(samples);
-      verbose(`AudioEncoder: Encoded samples: pts=${samples.pts()} / ${samples.pts().seconds()} / ${samples.timeBase()} / ${samples.sampleFormat()}@${samples.sampleRate()}, size=${samples.size()}, ref=${samples.isReferenced()}:${samples.refCount()} / layout: ${samples.channelsLayoutString()} }`);
+      await samples.setTimeBaseAsync(this.timeBase!);
+      const packet = await this.stats.measure(this.executor ?
+        this.executor.encodeAudio(this.pipeline, this.encoder, samples) :
+        this.encoder.encodeAsync(samples));
+      this.stats.frames++;
+      verbose(`AudioEncoder: Encoded samples: pts=${info.pts} / ${info.seconds} / ${info.timeBase.join('/')} / ${info.sampleFormat}@${info.sampleRate}, size=${info.size} / channels: ${info.channelsCount} }`);
       this.push(packet);
       this.busy = false;
       callback();
@@ -83,18 +96,75 @@ export class AudioEncoder extends MediaTransform implements MediaEncoder, Encode
       .catch(callback);
   }
 
+  /**
+   * Called by Writable with all the samples that have been buffered while the
+   * previous operation was running, they are encoded in a single native call
+   */
+  _writev(chunks: { chunk: ffmpeg.AudioSamples, encoding: BufferEncoding; }[], callback: (error?: Error | null) => void): void {
+    verbose(`AudioEncoder: received ${chunks.length} frames`);
+    if (this.busy) return void callback(new Error('AudioEncoder called while busy, use proper writing semantics'));
+    (async () => {
+      this.busy = true;
+      if (!this.encoder) {
+        return void callback(new Error('AudioEncoder is not primed'));
+      }
+      const samples = chunks.map((c) => c.chunk);
+      for (const s of samples) {
+        if (!(s instanceof AudioSamples)) {
+          return void callback(new Error('Input is not a raw audio'));
+        }
+        if (!s.info().isComplete) {
+          return void callback(new Error('Received incomplete frame'));
+        }
+        s.setTimeBase(this.timeBase!);
+      }
+      const packets = await this.stats.measure(this.executor ?
+        this.executor.encodeAudioBatch(this.pipeline, this.encoder, samples) :
+        this.encoder.encodeBatchAsync(samples));
+      this.stats.frames += samples.length;
+      verbose(`AudioEncoder: encoded ${samples.length} frames into ${packets.length} packets`);
+      let more = true;
+      for (const packet of packets)
+        more = this.push(packet) && more;
+      this.busy = false;
+      this.afterBatch(more, callback);
+    })()
+      .catch(callback);
+  }
+
+  /**
+   * Transform defers the callback of _transform() while the readable side
+   * is full, the same is done here for the batches of _writev()
+   */
+  protected afterBatch(more: boolean, callback: (error?: Error | null) => void): void {
+    if (more) {
+      callback();
+    } else {
+      verbose('AudioEncoder: the readable side is full, waiting for the consumer');
+      this.pending = callback;
+    }
+  }
+
+  _read(size: number): void {
+    const pending = this.pending;
+    this.pending = undefined;
+    pending?.();
+    super._read(size);
+  }
+
   _flush(callback: TransformCallback): void {
     verbose('AudioEncoder: flushing');
     if (this.busy) return void callback(new Error('AudioEncoder called while busy, use proper writing semantics'));
-    let packet: ffmpeg.Packet;
-    let packetIsComplete: boolean = false;
     (async () => {
-      do {
-        packet = await this.encoder.finalizeAsync();
-        // Don't touch packet after pushing for async handling
-        packetIsComplete = !!packet && packet.isComplete();
+      // Drain the encoder in a single call
+      const packets = await this.stats.measure(this.executor ?
+        this.executor.finalizeAudioBatch(this.pipeline, this.encoder) :
+        this.encoder.finalizeBatchAsync());
+      // Don't touch the packets after pushing for async handling
+      for (const packet of packets)
         this.push(packet);
-      } while (packetIsComplete);
+      if (this.pool)
+        this.pool.release(this.def, this.encoder);
       callback();
     })()
       .catch(callback);
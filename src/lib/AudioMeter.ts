@@ -0,0 +1,83 @@
+import { TransformCallback } from 'node:stream';
+import ffmpeg from '@mmomtchev/ffmpeg';
+import { AudioReadable, AudioWritable, MediaTransform, MediaTransformOptions } from './MediaStream';
+import { StageStats } from './Stats';
+
+export const verbose = (process.env.DEBUG_AUDIO_METER || process.env.DEBUG_ALL) ? console.debug.bind(console) : () => undefined;
+
+export interface AudioMeterReading {
+  /**
+   * Position in seconds of the samples, null if unknown
+   */
+  seconds: number | null;
+  /**
+   * [ peak, RMS ] of each channel of the last samples, linear with 1.0 being the full scale
+   */
+  levels: Float64Array;
+  /**
+   * EBU R128 momentary loudness (400ms) in LUFS
+   */
+  momentary: number;
+  /**
+   * EBU R128 short-term loudness (3s) in LUFS
+   */
+  shortTerm: number;
+  /**
+   * EBU R128 gated integrated loudness since the beginning in LUFS
+   */
+  integrated: number;
+  /**
+   * Sample peak since the beginning, linear
+   */
+  peak: number;
+}
+
+/**
+ * A pass-through stream Transform that meters the audio samples.
+ * The metering runs in native code without copying the samples into JS
+ * and it emits 'meter' with an `AudioMeterReading` for every chunk.
+ *
+ * @example
+ * const meter = new AudioMeter;
+ * meter.on('meter', (reading: AudioMeterReading) => console.log(reading.momentary));
+ * audioInput.pipe(meter).pipe(audioOutput);
+ */
+export class AudioMeter extends MediaTransform implements AudioReadable, AudioWritable {
+  protected meter: ffmpeg.LoudnessMeter | undefined;
+  // The last reading
+  reading: AudioMeterReading | undefined;
+  // Per-stage counters
+  readonly stats = new StageStats;
+
+  constructor(options?: MediaTransformOptions) {
+    super(options);
+  }
+
+  _transform(samples: ffmpeg.AudioSamples, encoding: BufferEncoding, callback: TransformCallback): void {
+    (async () => {
+      if (!(samples instanceof ffmpeg.AudioSamples)) {
+        return void callback(new Error('Input is not a raw audio'));
+      }
+      const info = samples.info();
+      if (!this.meter) {
+        verbose(`AudioMeter: metering ${info.channelsCount} channels @${info.sampleRate}`);
+        this.meter = new ffmpeg.LoudnessMeter(info.sampleRate, info.channelsCount);
+      }
+      const [levels] = await this.stats.measure(Promise.all([samples.levelsAsync(), this.meter.addAsync(samples)]));
+      const loudness = this.meter.result();
+      this.stats.frames++;
+      this.reading = {
+        seconds: info.seconds,
+        levels,
+        momentary: loudness[0],
+        shortTerm: loudness[1],
+        integrated: loudness[2],
+        peak: loudness[3]
+      };
+      this.emit('meter', this.reading);
+      this.push(samples);
+      callback();
+    })()
+      .catch(callback);
+  }
+}
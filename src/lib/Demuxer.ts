@@ -1,14 +1,25 @@
 import { EventEmitter, ReadableOptions, Writable } from 'node:stream';
+import { once } from 'node:events';
 import ffmpeg, { FormatContext } from '@mmomtchev/ffmpeg';
 import { EncodedMediaReadable } from './MediaStream';
+import { prefetch, PrefetchOptions } from './Prefetch';
+import { StageStats } from './Stats';
+import { LatencyTracer } from './LatencyTracer';
+import { AbortOptions, IOGuard } from './Abort';
 
 export const verbose = (process.env.DEBUG_DEMUXER || process.env.DEBUG_ALL) ? console.debug.bind(console) : () => undefined;
 
-export interface DemuxerOptions extends ReadableOptions {
+export interface DemuxerOptions extends ReadableOptions, AbortOptions {
   /**
    * The name of the input file, null for reading from a ReadStream
    */
   inputFile?: string;
+  /**
+   * A file descriptor to read from, a pipe, a socket or `process.stdin.fd`.
+   * It is read by ffmpeg's own I/O in the background thread without going through
+   * a JS stream. Node.js must not be reading from it at the same time.
+   */
+  inputFd?: number;
   /**
    * Amount of data to buffer, only when reading from a ReadStream, @default 64Kb
    */
@@ -17,6 +28,69 @@ export interface DemuxerOptions extends ReadableOptions {
    * Open options
    */
   openOptions?: Record<string, string>;
+  /**
+   * Maximum number of bytes read while probing the streams, ffmpeg's default is 5MB
+   */
+  probeSize?: number;
+  /**
+   * Maximum duration in microseconds analyzed while probing the streams, ffmpeg's default is 5s
+   */
+  analyzeDuration?: number;
+  /**
+   * Number of frames used to probe the frame rate
+   */
+  fpsProbeSize?: number;
+  /**
+   * The `Demuxer.parameters()` of a previous session with the same input,
+   * when all the streams are known after opening, the probing is skipped.
+   * The inputs without a header, such as FLV and RTMP, get their streams
+   * from the parameters. The parameters must match the input.
+   */
+  knownParameters?: ffmpeg.StreamParameters[];
+  /**
+   * Minimize the buffering for live streams: disables the buffering of the packets
+   * during probing (`fflags nobuffer`), reduces the probing and the AVIO buffering -
+   * the size of the buffer when reading from a ReadStream, the URL inputs are read
+   * without going through the buffer (`avioflags direct`).
+   * Explicit options take precedence.
+   */
+  lowLatency?: boolean;
+  /**
+   * Stamp the video packets as they enter the pipeline
+   */
+  tracer?: LatencyTracer;
+  /**
+   * Maximum number of bytes queued in a single stream, @default 8MB
+   */
+  streamBufferSize?: number;
+  /**
+   * Maximum number of bytes queued in all streams, @default 32MB
+   */
+  totalBufferSize?: number;
+}
+
+export interface DemuxerBufferStats {
+  streamBufferSize: number;
+  totalBufferSize: number;
+  /**
+   * Bytes currently queued in each stream
+   */
+  queued: number[];
+  /**
+   * Highest number of bytes queued in each stream
+   */
+  peak: number[];
+  /**
+   * Number of times the reading has been paused because a stream was full
+   */
+  stalls: number;
+}
+
+export interface DemuxerIteratorOptions extends PrefetchOptions {
+  /**
+   * Only return the packets of these streams, @default all
+   */
+  streams?: number[];
 }
 
 /**
@@ -45,6 +119,19 @@ export interface DemuxerOptions extends ReadableOptions {
  *  const videoInput = new VideoDecoder(input.video[0]);
  * });
  * instream.pipe(demuxer.input);
+ *
+ * @example
+ * // Reading directly from stdin
+ * const input = new Demuxer({ inputFd: process.stdin.fd });
+ *
+ * The packets are read ahead for all streams at the same time as they are interleaved
+ * in the input. The reading is paused while any stream is holding more than
+ * `streamBufferSize` bytes or all streams together more than `totalBufferSize` bytes -
+ * all streams must be consumed, the unused ones can be piped to a `Discarder`.
+ *
+ * @example
+ * // Giving up on a stalled network input after 5s
+ * const input = new Demuxer({ inputFile: 'rtmp://server/live', timeout: 5000, signal: controller.signal });
  */
 export class Demuxer extends EventEmitter {
   protected inputFile: string | undefined;
@@ -52,44 +139,118 @@ export class Demuxer extends EventEmitter {
   protected formatContext: ffmpeg.FormatContext | undefined;
   protected rawStreams: ffmpeg.Stream[];
   protected openOptions: Record<string, string>;
+  protected probeOptions: Record<string, string>;
+  protected knownParameters: ffmpeg.StreamParameters[] | undefined;
+  protected tracer: LatencyTracer | undefined;
+  protected guard: IOGuard;
+  protected streamBufferSize: number;
+  protected totalBufferSize: number;
+  // Number of packets requested by each stream
+  protected demand: number[];
+  // Paused because a stream is full
+  protected stalled: boolean;
+  protected bufferStats_: { peak: number[], stalls: number; };
   streams: EncodedMediaReadable[];
   video: EncodedMediaReadable[];
   audio: EncodedMediaReadable[];
   input?: Writable;
   reading: boolean;
+  primed: boolean;
+  // Set when the streams had to be probed with findStreamInfo()
+  probed: boolean;
+  // Per-stage counters
+  readonly stats = new StageStats;
 
   constructor(options?: DemuxerOptions) {
     super();
     // Built-in ffmpeg I/O (generally faster)
     this.inputFile = options?.inputFile;
+    // Built-in ffmpeg I/O from a file descriptor
+    if (options?.inputFd !== undefined) {
+      this.inputFile = `pipe:${options.inputFd}`;
+    }
     // Reading from a ReadStream
     if (!this.inputFile) {
       this.input = new ffmpeg.WritableCustomIO;
     }
-    this.highWaterMark = options?.highWaterMark ?? (64 * 1024);
+    const lowLatency = options?.lowLatency ?? false;
+    this.highWaterMark = options?.highWaterMark ?? (lowLatency ? 4096 : (64 * 1024));
     this.openOptions = options?.openOptions ?? {};
+    this.probeOptions = lowLatency ? {
+      fflags: '+nobuffer',
+      probesize: '32768',
+      analyzeduration: '500000'
+    } : {};
+    // Local files are always read through the buffer
+    if (lowLatency && this.inputFile && /^[a-z][a-z0-9+.-]*:\/\//i.test(this.inputFile) &&
+      !this.inputFile.startsWith('file:'))
+      this.probeOptions.avioflags = 'direct';
+    if (options?.probeSize !== undefined)
+      this.probeOptions.probesize = options.probeSize.toString();
+    if (options?.analyzeDuration !== undefined)
+      this.probeOptions.analyzeduration = options.analyzeDuration.toString();
+    if (options?.fpsProbeSize !== undefined)
+      this.probeOptions.fpsprobesize = options.fpsProbeSize.toString();
+    this.knownParameters = options?.knownParameters;
+    this.tracer = options?.tracer;
+    this.streamBufferSize = options?.streamBufferSize ?? (8 * 1024 * 1024);
+    this.totalBufferSize = options?.totalBufferSize ?? (32 * 1024 * 1024);
+    this.demand = [];
+    this.stalled = false;
+    this.bufferStats_ = { peak: [], stalls: 0 };
     this.rawStreams = [];
     this.streams = [];
     this.video = [];
     this.audio = [];
     this.reading = false;
+    this.primed = false;
+    this.probed = false;
+    this.guard = new IOGuard(options, (reason) => {
+      verbose(`Demuxer: aborted: ${reason}`);
+      this.input?.destroy(reason);
+      // Otherwise the error will come from the interrupted operation
+      if (this.primed && !this.reading) {
+        for (const s of this.streams) s.destroy(reason);
+        this.emit('error', reason);
+      }
+    });
     this.prime();
   }
 
   protected async prime(): Promise<void> {
     try {
       this.formatContext = new FormatContext;
+      this.guard.attach(this.formatContext, this.input as ffmpeg.WritableCustomIO | undefined);
+      // These must be set on the context as the CustomIO cannot receive options
+      for (const opt of Object.keys(this.probeOptions))
+        this.formatContext.setOption(opt, this.probeOptions[opt]);
       if (this.inputFile) {
         verbose(`Demuxer: opening ${this.inputFile}`, this.openOptions);
-        await this.formatContext.openInputOptionsAsync(this.inputFile, this.openOptions);
+        await this.guard.run(this.formatContext.openInputOptionsAsync(this.inputFile, this.openOptions),
+          `Opening ${this.inputFile}`);
       } else if (this.input) {
         verbose('Demuxer: reading from ReadStream');
         const format = new ffmpeg.InputFormat;
-        await this.formatContext.openWritableAsync(this.input, format, this.highWaterMark);
+        await this.guard.run(this.formatContext.openWritableAsync(this.input, format, this.highWaterMark),
+          'Opening the ReadStream');
       } else {
         throw new Error('No filename nor a stream provided');
       }
-      await this.formatContext.findStreamInfoAsync();
+      // The inputs without a header, such as FLV, do not have any streams
+      // until they are probed, the demuxer will use the ones created in advance
+      if (this.knownParameters && this.formatContext.addInputStreams(this.knownParameters.length))
+        verbose(`Demuxer: created ${this.knownParameters.length} streams for an input without a header`);
+      if (this.knownParameters && this.formatContext.streamsCount() === this.knownParameters.length) {
+        verbose('Demuxer: using known parameters, skip probing');
+        for (let i = 0; i < this.knownParameters.length; i++)
+          this.formatContext.stream(i).setParameters(this.knownParameters[i]);
+      } else {
+        if (this.knownParameters)
+          verbose(`Demuxer: found ${this.formatContext.streamsCount()} streams, ` +
+            `expected ${this.knownParameters.length}, probing`);
+        await this.guard.run(this.formatContext.findStreamInfoAsync(), 'Probing');
+        this.probed = true;
+      }
 
       for (let i = 0; i < this.formatContext.streamsCount(); i++) {
         const stream = this.formatContext.stream(i);
@@ -101,52 +262,137 @@ export class Demuxer extends EventEmitter {
           read: (size: number) => {
             this.read(i, size);
           },
+          consumed: () => {
+            if (this.stalled && !this.reading && !this.full()) {
+              verbose(`Demuxer: stream ${i} has been consumed, resume reading`);
+              this.read(i, 0);
+            }
+          },
           stream: stream
         });
         this.rawStreams[i] = stream;
+        this.demand[i] = 0;
+        this.bufferStats_.peak[i] = 0;
         if (stream.isVideo()) this.video.push(this.streams[i]);
         if (stream.isAudio()) this.audio.push(this.streams[i]);
       }
+      this.primed = true;
       this.emit('ready');
     } catch (e) {
       this.emit('error', e);
     }
   }
 
+  /**
+   * Abort all pending and future I/O, the streams are destroyed with `reason`
+   */
+  abort(reason?: Error): void {
+    this.guard.abort(reason);
+  }
+
+  /**
+   * The codec parameters of all streams, can be saved and passed as
+   * `knownParameters` to skip the probing when opening the same input again
+   */
+  parameters(): ffmpeg.StreamParameters[] {
+    return this.rawStreams.map((s) => s.parameters());
+  }
+
+  /**
+   * Read the next packet, this is the pull primitive shared by the
+   * Readable streams and the async iterator.
+   * Returns null at the end of the stream.
+   */
+  protected async readPacket(): Promise<{ packet: ffmpeg.Packet, info: ffmpeg.PacketInfo; } | null> {
+    // Do not read more data while over the memory budget (ffmpeg.setMemoryBudget)
+    const memory = ffmpeg.waitForMemory();
+    if (memory) {
+      verbose('Demuxer: waiting for memory');
+      await memory;
+    }
+    // avcpp reads packets only after findStreamInfo()
+    const packet = await this.stats.measure(this.guard.run(this.probed ?
+      this.formatContext!.readPacketAsync() : this.formatContext!.readFrameAsync(), 'Reading'));
+    // retrieving all of the packet properties in a single call is much faster
+    const info = packet.info();
+    verbose(`Demuxer: Read packet: pts=${info.pts}, dts=${info.dts} / ${info.seconds} / ${info.timeBase.join('/')} / stream ${info.streamIndex}`);
+    if (info.isNull) {
+      verbose('Demuxer: End of stream');
+      this.guard.dispose();
+      return null;
+    }
+    if (!this.rawStreams[info.streamIndex]) {
+      throw new Error(`Received packet for unknown stream ${info.streamIndex}`);
+    }
+    packet.track();
+    this.stats.frames++;
+    if (this.tracer && this.streams[info.streamIndex].type === 'Video')
+      this.tracer.stamp('demuxer', info.seconds);
+    return { packet, info };
+  }
+
+  /**
+   * Is any stream over its buffer size or all of them over the total buffer size
+   */
+  protected full(): boolean {
+    let total = 0;
+    let full = false;
+    for (let i = 0; i < this.streams.length; i++) {
+      const queued = this.streams[i].queuedBytes;
+      if (queued > this.bufferStats_.peak[i]) this.bufferStats_.peak[i] = queued;
+      if (queued >= this.streamBufferSize) full = true;
+      total += queued;
+    }
+    return full || total >= this.totalBufferSize;
+  }
+
+  /**
+   * The current state of the buffering of the streams
+   */
+  bufferStats(): DemuxerBufferStats {
+    return {
+      streamBufferSize: this.streamBufferSize,
+      totalBufferSize: this.totalBufferSize,
+      queued: this.streams.map((s) => s.queuedBytes),
+      peak: [...this.bufferStats_.peak],
+      stalls: this.bufferStats_.stalls
+    };
+  }
+
   /**
    * All demuxed streams share the same read function.
    * When it is called for one of those streams, it will read and
-   * push data to all of them - until the one that requested data
-   * has enough
+   * push data to all of them - until all the streams that requested
+   * data have enough or one of the streams is full
    */
   protected async read(idx: number, size: number): Promise<void> {
+    this.demand[idx] = Math.max(this.demand[idx], size);
     if (this.reading) return;
     (async () => {
       this.reading = true;
+      this.stalled = false;
       verbose(`Demuxer: start of _read (called on stream ${idx} for ${size} packets`);
-      let pkt;
-      let pktIsNull: boolean;
-      do {
-        pkt = await this.formatContext!.readPacketAsync();
-        verbose(`Demuxer: Read packet: pts=${pkt.pts()}, dts=${pkt.dts()} / ${pkt.pts().seconds()} / ${pkt.timeBase()} / stream ${pkt.streamIndex()}`);
-        if (pkt.isNull()) {
-          verbose('Demuxer: End of stream');
+      while (this.demand.some((d) => d > 0)) {
+        if (this.full()) {
+          // Resumed by the consumed callback of the streams
+          verbose('Demuxer: stream buffers are full, pausing');
+          this.bufferStats_.stalls++;
+          this.stalled = true;
+          break;
+        }
+        const r = await this.readPacket();
+        if (!r) {
           for (const s of this.streams) s.push(null);
           this.emit('close');
           return;
         }
-        if (!this.streams[pkt.streamIndex()]) {
-          for (const s of this.streams)
-            s.destroy(new Error(`Received packet for unknown stream ${pkt.streamIndex()}`));
-          return;
-        }
-        // Decrement only if this is going to the stream that requested data
-        if (idx === pkt.streamIndex()) size--;
-        // pkt should not be accessed after being pushed for async handling
-        pktIsNull = pkt.isNull();
-        // But always push to whoever the packet was for
-        this.streams[pkt.streamIndex()].push(pkt);
-      } while (!pktIsNull && size > 0);
+        const i = r.info.streamIndex;
+        if (this.demand[i] > 0) this.demand[i]--;
+        // Always push to whoever the packet was for
+        // (pkt should not be accessed after being pushed for async handling)
+        if (!this.streams[i].pushPacket(r.packet, r.info.size))
+          this.demand[i] = 0;
+      }
       verbose('Demuxer: end of _read');
     })()
       .catch((err) => {
@@ -158,5 +404,36 @@ export class Demuxer extends EventEmitter {
         this.reading = false;
       });
   }
-}
 
+  /**
+   * Pull-based alternative to the Readable streams - it yields the
+   * demuxed packets without going through the object mode streams.
+   * Cannot be used at the same time as the `streams`.
+   *
+   * @example
+   * const input = new Demuxer({ inputFile: 'input.mp4' });
+   * for await (const packet of input.packets({ streams: [0] }))
+   *   process(packet);
+   */
+  async *packets(options?: DemuxerIteratorOptions): AsyncGenerator<ffmpeg.Packet, void, undefined> {
+    if (!this.primed) await once(this, 'ready');
+    if (this.reading) throw new Error('Demuxer is already being read');
+    const streams = options?.streams;
+    this.reading = true;
+    try {
+      yield* prefetch(async () => {
+        for (;;) {
+          const r = await this.readPacket();
+          if (!r) return null;
+          if (!streams || streams.includes(r.info.streamIndex)) return r.packet;
+        }
+      }, options?.prefetch);
+    } finally {
+      this.reading = false;
+    }
+  }
+
+  [Symbol.asyncIterator](): AsyncGenerator<ffmpeg.Packet, void, undefined> {
+    return this.packets();
+  }
+}
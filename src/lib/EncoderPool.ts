@@ -0,0 +1,224 @@
+import ffmpeg from '@mmomtchev/ffmpeg';
+import { AudioStreamDefinition, ExecutorOptions, VideoStreamDefinition } from './MediaStream';
+
+export const verbose = (process.env.DEBUG_ENCODER_POOL || process.env.DEBUG_ALL) ? console.debug.bind(console) : () => undefined;
+
+type EncoderContext = ffmpeg.VideoEncoderContext | ffmpeg.AudioEncoderContext;
+type StreamDefinition = VideoStreamDefinition | AudioStreamDefinition;
+
+export interface EncoderPoolOptions {
+  /**
+   * Maximum number of idle encoders kept for each definition, @default 4
+   */
+  maxIdle?: number;
+}
+
+/**
+ * Finds the encoding codec of a stream definition
+ */
+export function findEncoderCodec(def: StreamDefinition): ffmpeg.Codec {
+  return def.codec instanceof ffmpeg.Codec ?
+    ffmpeg.findDecodingCodec(def.codec.id()) :
+    ffmpeg.findEncodingCodec(def.codec);
+}
+
+/**
+ * Creates the codec context described by a stream definition without opening it
+ */
+export function createEncoderContext(def: VideoStreamDefinition, codec?: ffmpeg.Codec): ffmpeg.VideoEncoderContext;
+export function createEncoderContext(def: AudioStreamDefinition, codec?: ffmpeg.Codec): ffmpeg.AudioEncoderContext;
+export function createEncoderContext(def: StreamDefinition, codec?: ffmpeg.Codec): EncoderContext;
+export function createEncoderContext(def: StreamDefinition, codec?: ffmpeg.Codec): EncoderContext {
+  codec = codec ?? findEncoderCodec(def);
+  const encoder = def.type === 'Video' ?
+    new ffmpeg.VideoEncoderContext(codec) :
+    new ffmpeg.AudioEncoderContext(codec);
+  encoder.setTimeBase(def.timeBase ?? new ffmpeg.Rational(1, 1000));
+  encoder.setBitRate(def.bitRate);
+  if (def.type === 'Video') {
+    const video = encoder as ffmpeg.VideoEncoderContext;
+    video.setWidth(def.width);
+    video.setHeight(def.height);
+    video.setPixelFormat(def.pixelFormat);
+    if (def.flags)
+      video.addFlags(def.flags);
+  } else {
+    const audio = encoder as ffmpeg.AudioEncoderContext;
+    audio.setChannelLayout(def.channelLayout);
+    audio.setSampleFormat(def.sampleFormat);
+    audio.setSampleRate(def.sampleRate);
+  }
+  return encoder;
+}
+
+/**
+ * Opens the codec context described by a stream definition
+ */
+export function openEncoderContext(def: VideoStreamDefinition): Promise<ffmpeg.VideoEncoderContext>;
+export function openEncoderContext(def: AudioStreamDefinition): Promise<ffmpeg.AudioEncoderContext>;
+export function openEncoderContext(def: StreamDefinition): Promise<EncoderContext>;
+export async function openEncoderContext(def: StreamDefinition): Promise<EncoderContext> {
+  const codec = findEncoderCodec(def);
+  const encoder = createEncoderContext(def, codec);
+  await encoder.openCodecOptionsAsync(def.codecOptions ?? {}, codec);
+  return encoder;
+}
+
+/**
+ * A pool of opened encoder contexts that can be shared by
+ * the `VideoEncoder` and `AudioEncoder` streams through their `pool` option.
+ *
+ * Opening an encoder such as x264 spawns threads and allocates its lookahead
+ * buffers and it can take longer than encoding a short clip. When the encoder
+ * stream ends, its context is flushed and returned to the pool where it can
+ * be picked up by the next encoder with an identical definition.
+ *
+ * The codecs that support flushing (`AV_CODEC_CAP_ENCODER_FLUSH`) are reset and reused,
+ * the others (x264, x265) are closed and a fresh context is opened in the background
+ * to take their place - `settled()` waits for these. The flags of a pooled encoder cannot be changed once
+ * it has been opened, `AV_CODEC_FLAG_GLOBAL_HEADER` must be included in the definition
+ * when muxing to a format that requires it.
+ *
+ * @example
+ * const pool = new EncoderPool;
+ * await pool.warm(videoDefinition, 2);
+ * const videoOutput = new VideoEncoder(videoDefinition, { pool });
+ */
+export class EncoderPool {
+  protected idle: Map<string, EncoderContext[]>;
+  // Number of contexts being opened in the background for each key
+  protected opening: Map<string, number>;
+  protected pending: Set<Promise<void>>;
+  protected maxIdle: number;
+  /**
+   * Number of encoders that were reused
+   */
+  hits: number;
+  /**
+   * Number of encoders that had to be opened
+   */
+  misses: number;
+  /**
+   * Number of encoders that could not be flushed and were replaced by a new one
+   */
+  reopened: number;
+
+  constructor(options?: EncoderPoolOptions) {
+    this.idle = new Map;
+    this.opening = new Map;
+    this.pending = new Set;
+    this.maxIdle = options?.maxIdle ?? 4;
+    this.hits = 0;
+    this.misses = 0;
+    this.reopened = 0;
+  }
+
+  /**
+   * The pool key of a stream definition, two definitions with the same key
+   * produce identical encoders
+   */
+  static key(def: StreamDefinition): string {
+    const codec = def.codec instanceof ffmpeg.Codec ? def.codec.name() : def.codec;
+    const options = Object.keys(def.codecOptions ?? {}).sort()
+      .map((k) => `${k}=${def.codecOptions![k]}`).join(',');
+    const common = `${def.type}:${codec}:${def.bitRate}:${def.timeBase?.toString() ?? ''}:${options}`;
+    if (def.type === 'Video')
+      return `${common}:${def.width}x${def.height}:${def.pixelFormat.toString()}:${def.flags ?? 0}`;
+    return `${common}:${def.channelLayout.toString()}:${def.sampleFormat.toString()}:${def.sampleRate}`;
+  }
+
+  /**
+   * Retrieve an opened encoder context, returns undefined if there is none available
+   */
+  take(def: VideoStreamDefinition): ffmpeg.VideoEncoderContext | undefined;
+  take(def: AudioStreamDefinition): ffmpeg.AudioEncoderContext | undefined;
+  take(def: StreamDefinition): EncoderContext | undefined {
+    const encoder = this.idle.get(EncoderPool.key(def))?.pop();
+    if (encoder) {
+      this.hits++;
+    } else {
+      this.misses++;
+    }
+    verbose(`EncoderPool: ${encoder ? 'reusing' : 'no'} encoder for ${EncoderPool.key(def)}`);
+    return encoder;
+  }
+
+  /**
+   * Return a drained encoder context to the pool, returns false if it cannot be reused
+   * in which case a new one is opened in the background
+   */
+  release(def: StreamDefinition, encoder: EncoderContext): boolean {
+    const key = EncoderPool.key(def);
+    const idle = this.idle.get(key) ?? [];
+    if (idle.length + (this.opening.get(key) ?? 0) >= this.maxIdle) {
+      verbose(`EncoderPool: discarding encoder for ${key}`);
+      return false;
+    }
+    if (!encoder.flush()) {
+      verbose(`EncoderPool: encoder for ${key} cannot be flushed, reopening`);
+      this.reopen(def);
+      return false;
+    }
+    idle.push(encoder);
+    this.idle.set(key, idle);
+    verbose(`EncoderPool: ${idle.length} idle encoders for ${key}`);
+    return true;
+  }
+
+  /**
+   * Open a replacement for an encoder that cannot be flushed
+   */
+  protected reopen(def: StreamDefinition): void {
+    const key = EncoderPool.key(def);
+    this.opening.set(key, (this.opening.get(key) ?? 0) + 1);
+    const job = openEncoderContext(def)
+      .then((encoder) => {
+        const idle = this.idle.get(key) ?? [];
+        idle.push(encoder);
+        this.idle.set(key, idle);
+        this.reopened++;
+        verbose(`EncoderPool: reopened, ${idle.length} idle encoders for ${key}`);
+      })
+      .catch((e) => verbose(`EncoderPool: failed reopening encoder for ${key}`, e))
+      .finally(() => {
+        this.opening.set(key, this.opening.get(key)! - 1);
+        this.pending.delete(job);
+      });
+    this.pending.add(job);
+  }
+
+  /**
+   * Wait for the encoders that are being opened in the background
+   */
+  async settled(): Promise<void> {
+    while (this.pending.size > 0)
+      await Promise.all(this.pending);
+  }
+
+  /**
+   * Open encoder contexts in advance
+   */
+  async warm(def: StreamDefinition, count: number): Promise<void> {
+    const key = EncoderPool.key(def);
+    const idle = this.idle.get(key) ?? [];
+    this.idle.set(key, idle);
+    const opened = await Promise.all(Array.from({ length: Math.max(count - idle.length, 0) },
+      () => openEncoderContext(def)));
+    idle.push(...opened.slice(0, this.maxIdle - idle.length));
+  }
+
+  /**
+   * Drop all idle encoders, they will be closed by the GC,
+   * the ones being opened in the background are still added
+   */
+  clear(): void {
+    this.idle.clear();
+  }
+}
+
+export interface EncoderOptions extends ExecutorOptions {
+  /**
+   * Reuse the opened encoders of this pool
+   */
+  pool?: EncoderPool;
+}
@@ -1,10 +1,12 @@
 import { EventEmitter, Writable, Readable } from 'node:stream';
 import ffmpeg from '@mmomtchev/ffmpeg';
-import { MediaStreamDefinition, isAudioDefinition, isVideoDefinition } from './MediaStream';
+import { ExecutorOptions, MediaStreamDefinition, isAudioDefinition, isVideoDefinition } from './MediaStream';
+import { prefetch, PrefetchOptions } from './Prefetch';
+import { StageStats } from './Stats';
 
 export const verbose = (process.env.DEBUG_FILTER || process.env.DEBUG_ALL) ? console.debug.bind(console) : () => undefined;
 
-export interface FilterOptions {
+export interface FilterOptions extends ExecutorOptions {
   // Filter sources definitions
   inputs: Record<string, MediaStreamDefinition>;
   // Filter sinks definitions
@@ -13,6 +15,10 @@ export interface FilterOptions {
   graph: string;
   // A filter must have a single time base
   timeBase: ffmpeg.Rational;
+  // Hand over the frame references to the filter graph instead of copying them,
+  // frames written to the sources cannot be reused after being written
+  // (this includes frames shared with other streams), @default false
+  zeroCopy?: boolean;
 }
 
 /**
@@ -26,6 +32,7 @@ export class Filter extends EventEmitter {
   protected bufferSrc: Record<string, {
     type: 'Audio' | 'Video';
     buffer: ffmpeg.BufferSrcFilterContext;
+    filter: ffmpeg.FilterContext;
     busy: boolean;
     nullFrame: ffmpeg.VideoFrame | ffmpeg.AudioSamples;
     id: string;
@@ -33,20 +40,36 @@ export class Filter extends EventEmitter {
   protected bufferSink: Record<string, {
     type: 'Audio' | 'Video';
     buffer: ffmpeg.BufferSinkFilterContext;
+    // Frames produced under the previous parameters of a reconfigured source
+    drained: (ffmpeg.VideoFrame | ffmpeg.AudioSamples)[];
+    // An error that stopped a batch after some frames, raised by the next read
+    error: Error | null;
     waitingToRead: number;
     busy: boolean;
     id: string;
   }>;
   protected timeBase: ffmpeg.Rational;
+  protected zeroCopy: boolean;
+  protected executor: ffmpeg.MediaExecutor | undefined;
+  protected pipeline: number;
   protected stillStreamingSources: number;
+  // Writes in progress and the iterators waiting for one to complete
+  protected pendingWrites: number;
+  protected writeCount: number;
+  protected writeWaiters: (() => void)[];
   protected destroyed: boolean;
   src: Record<string, Writable>;
   sink: Record<string, Readable>;
+  // Per-stage counters
+  readonly stats = new StageStats;
 
   constructor(options: FilterOptions) {
     super();
     this.filterGraph = new ffmpeg.FilterGraph;
     this.timeBase = options.timeBase;
+    this.zeroCopy = !!options.zeroCopy;
+    this.executor = options.executor;
+    this.pipeline = options.pipeline ?? 0;
 
     // construct inputs
     let filterDescriptor = '';
@@ -78,6 +101,9 @@ export class Filter extends EventEmitter {
     this.filterGraph.config();
 
     this.stillStreamingSources = 0;
+    this.pendingWrites = 0;
+    this.writeCount = 0;
+    this.writeWaiters = [];
     this.destroyed = false;
     this.src = {};
     this.bufferSrc = {};
@@ -97,10 +123,12 @@ export class Filter extends EventEmitter {
       } else {
         throw new Error('Only Video and Audio filtering is supported');
       }
+      const filter = this.filterGraph.filter(id);
       this.bufferSrc[inp] = {
         type,
         id,
-        buffer: new ffmpeg.BufferSrcFilterContext(this.filterGraph.filter(id)),
+        filter,
+        buffer: new ffmpeg.BufferSrcFilterContext(filter),
         busy: false,
         nullFrame
       };
@@ -155,6 +183,8 @@ export class Filter extends EventEmitter {
         type,
         id,
         buffer: new ffmpeg.BufferSinkFilterContext(this.filterGraph.filter(id)),
+        drained: [],
+        error: null,
         busy: false,
         waitingToRead: 0
       };
@@ -180,9 +210,78 @@ export class Filter extends EventEmitter {
     for (const s of Object.keys(this.bufferSink)) {
       this.sink[s].destroy(error);
     }
+    this.wakeUpIterators();
     this.emit('error', error);
   }
 
+  protected wakeUpIterators() {
+    const waiters = this.writeWaiters;
+    this.writeWaiters = [];
+    for (const resolve of waiters) resolve();
+  }
+
+  /**
+   * Change the parameters of a running source without rebuilding the graph,
+   * for example when a live input switches its resolution.
+   * Frames with the new parameters can be written once the returned Promise resolves.
+   * The frames already written are drained from the graph before the switch.
+   * The filters downstream must support the change (scale does).
+   */
+  async reconfigure(id: string, def: MediaStreamDefinition): Promise<void> {
+    const src = this.bufferSrc[id];
+    if (!src) {
+      throw new Error(`Invalid buffer src [${id}]`);
+    }
+    // Parameters cannot be changed while the filter graph is running in the background
+    while (this.filterGraphOp) await this.filterGraphOp;
+    // Flush the frames queued under the old parameters to the sinks, they are
+    // delivered before any frame produced with the new ones
+    for (const sink of Object.keys(this.bufferSink)) {
+      const frames = await this.getFrames(sink, 0);
+      verbose(`Filter: reconfigure source [${id}]: drained ${frames.length} frames from sink [${sink}]`);
+      this.bufferSink[sink].drained.push(...frames);
+    }
+    while (this.filterGraphOp) await this.filterGraphOp;
+    if (src.type === 'Video' && isVideoDefinition(def)) {
+      if (!def.pixelFormat)
+        throw new Error('pixelFormat is mandatory for filter sources');
+      verbose(`Filter: reconfigure source [${id}]: ${def.width}x${def.height}, ${def.pixelFormat.toString()}`);
+      src.filter.setVideoSourceParameters(def.width, def.height, def.pixelFormat, def.timeBase ?? this.timeBase);
+    } else if (src.type === 'Audio' && isAudioDefinition(def)) {
+      verbose(`Filter: reconfigure source [${id}]: ${def.sampleFormat.toString()}@${def.sampleRate}`);
+      src.filter.setAudioSourceParameters(def.sampleRate, def.sampleFormat, def.channelLayout.layout(),
+        def.timeBase ?? this.timeBase);
+    } else {
+      throw new Error(`Source [${id}] cannot be reconfigured to a different media type`);
+    }
+    this.wakeUpIterators();
+    for (const sink of Object.keys(this.bufferSink)) {
+      if (this.bufferSink[sink].waitingToRead && !this.bufferSink[sink].busy)
+        this.read(sink, 0);
+    }
+  }
+
+  /**
+   * Send a command to a filter of the running graph (avfilter_graph_send_command).
+   * `target` can be a filter instance name, a filter name or 'all'.
+   * Resolves with the response of the filter.
+   *
+   * @example
+   * // Move an overlay
+   * await filter.sendCommand('overlay', 'x', '100');
+   */
+  async sendCommand(target: string, cmd: string, arg: string, flags?: number): Promise<string> {
+    verbose(`Filter: send command ${target}: ${cmd} ${arg}`);
+    while (this.filterGraphOp) await this.filterGraphOp;
+    const op = this.filterGraph.sendCommandAsync(target, cmd, arg, flags ?? 0);
+    this.filterGraphOp = op;
+    try {
+      return await op;
+    } finally {
+      this.filterGraphOp = false;
+    }
+  }
+
   protected async write(id: string, frame: ffmpeg.VideoFrame | ffmpeg.AudioSamples, callback: (error?: Error | null | undefined) => void) {
     const src = this.bufferSrc[id];
     if (!src) {
@@ -194,6 +293,7 @@ export class Filter extends EventEmitter {
       return void callback(new Error(`Writing is not reentrant on [${id}]!`));
     }
     src.busy = true;
+    this.pendingWrites++;
 
     verbose(`Filter: write source [${id}]: received data`);
 
@@ -205,24 +305,41 @@ export class Filter extends EventEmitter {
         await frame.setTimeBaseAsync(this.timeBase);
         await frame.setStreamIndexAsync(0);
         while (this.filterGraphOp) await this.filterGraphOp;
-        this.filterGraphOp = src.buffer.writeVideoFrameAsync(frame);
+        if (this.zeroCopy && frame !== src.nullFrame)
+          this.filterGraphOp = this.executor ?
+            this.executor.addVideoFrame(this.pipeline, src.buffer, frame) :
+            src.buffer.addVideoFrameAsync(frame);
+        else if (this.executor)
+          this.filterGraphOp = this.executor.writeVideoFrame(this.pipeline, src.buffer, frame);
+        else
+          this.filterGraphOp = src.buffer.writeVideoFrameAsync(frame);
       } else if (src.type === 'Audio') {
         if (!(frame instanceof ffmpeg.AudioSamples))
           return void callback(new Error('Filter source audio input must be a stream of AudioSamples'));
         await frame.setTimeBaseAsync(this.timeBase);
         await frame.setStreamIndexAsync(0);
         while (this.filterGraphOp) await this.filterGraphOp;
-        this.filterGraphOp = src.buffer.writeAudioSamplesAsync(frame);
+        if (this.zeroCopy && frame !== src.nullFrame)
+          this.filterGraphOp = this.executor ?
+            this.executor.addAudioSamples(this.pipeline, src.buffer, frame) :
+            src.buffer.addAudioSamplesAsync(frame);
+        else if (this.executor)
+          this.filterGraphOp = this.executor.writeAudioSamples(this.pipeline, src.buffer, frame);
+        else
+          this.filterGraphOp = src.buffer.writeAudioSamplesAsync(frame);
       } else {
         return void callback(new Error('Only Video and Audio filtering is supported'));
       }
 
       try {
-        await this.filterGraphOp;
+        await this.stats.measure(this.filterGraphOp);
         this.filterGraphOp = false;
 
         src.busy = false;
-        verbose(`Filter: write source [${id}]: wrote, pts=${frame.pts().toString()}`);
+        this.pendingWrites--;
+        this.writeCount++;
+        this.wakeUpIterators();
+        verbose(`Filter: write source [${id}]: wrote${this.zeroCopy ? '' : `, pts=${frame.pts().toString()}`}`);
         // Now that we pushed more data, try reading again if there were waiting reads
         for (const sink of Object.keys(this.bufferSink)) {
           if (this.bufferSink[sink].waitingToRead && !this.bufferSink[sink].busy) {
@@ -239,6 +356,63 @@ export class Filter extends EventEmitter {
     }
   }
 
+  /**
+   * Retrieve up to `max` frames from a sink, this is the pull primitive shared
+   * by the Readable streams and the async iterator
+   */
+  protected async pull(id: string, max: number): Promise<(ffmpeg.VideoFrame | ffmpeg.AudioSamples)[]> {
+    const sink = this.bufferSink[id];
+    if (sink.drained.length)
+      return sink.drained.splice(0, max || sink.drained.length);
+    return this.getFrames(id, max);
+  }
+
+  /**
+   * Retrieve up to `max` frames (0 for all available) from the filter graph
+   */
+  protected async getFrames(id: string, max: number): Promise<(ffmpeg.VideoFrame | ffmpeg.AudioSamples)[]> {
+    const sink = this.bufferSink[id];
+    let get: (max: number) => Promise<{ frames: (ffmpeg.VideoFrame | ffmpeg.AudioSamples)[], error: Error | null }>;
+    const executor = this.executor;
+    if (sink.type === 'Video') {
+      get = executor ? (max) => executor.getVideoFrames(this.pipeline, sink.buffer, max) :
+        sink.buffer.getVideoFramesAsync.bind(sink.buffer);
+    } else if (sink.type === 'Audio') {
+      get = executor ? (max) => executor.getAudioFrames(this.pipeline, sink.buffer, max) :
+        sink.buffer.getAudioFramesAsync.bind(sink.buffer);
+    } else {
+      throw new Error('Only Video and Audio filtering is supported');
+    }
+    while (this.filterGraphOp) await this.filterGraphOp;
+    // A reconfiguration has drained the graph while we were waiting
+    if (sink.drained.length)
+      return sink.drained.splice(0, max || sink.drained.length);
+    if (sink.error) {
+      const error = sink.error;
+      sink.error = null;
+      throw error;
+    }
+    this.filterGraphOp = get(max);
+    let frames: (ffmpeg.VideoFrame | ffmpeg.AudioSamples)[];
+    try {
+      ({ frames, error: sink.error } = await this.stats.measure(this.filterGraphOp) as
+        { frames: (ffmpeg.VideoFrame | ffmpeg.AudioSamples)[], error: Error | null });
+    } finally {
+      this.filterGraphOp = false;
+    }
+    this.stats.frames += frames.length;
+    verbose(`Filter: read sink [${id}] received: ${frames.length} frames (max ${max})`);
+    for (const frame of frames) {
+      verbose(`Filter: read sink [${id}] received: data, pts=${frame.pts().toString()}`);
+      if (sink.type === 'Video') {
+        (frame as ffmpeg.VideoFrame).setPictureType(ffmpeg.AV_PICTURE_TYPE_NONE);
+      }
+      frame.setTimeBase(this.timeBase);
+      frame.setStreamIndex(0);
+    }
+    return frames;
+  }
+
   protected async read(id: string, size: number) {
     const sink = this.bufferSink[id];
     // We may stop streaming exactly during the getFrame()
@@ -256,41 +430,68 @@ export class Filter extends EventEmitter {
     }
     sink.busy = true;
 
-    let getFrame: () => Promise<ffmpeg.VideoFrame | ffmpeg.AudioSamples | null>;
-    if (sink.type === 'Video') {
-      getFrame = sink.buffer.getVideoFrameAsync.bind(sink.buffer);
-    } else if (sink.type === 'Audio') {
-      getFrame = sink.buffer.getAudioFrameAsync.bind(sink.buffer);
-    } else {
-      throw new Error('Only Video and Audio filtering is supported');
-    }
-    let frame: ffmpeg.VideoFrame | ffmpeg.AudioSamples;
+    let frames: (ffmpeg.VideoFrame | ffmpeg.AudioSamples)[];
     let more = true;
     do {
-      while (this.filterGraphOp) await this.filterGraphOp;
-      this.filterGraphOp = getFrame();
-      frame = await this.filterGraphOp as ffmpeg.VideoFrame | ffmpeg.AudioSamples;
-      this.filterGraphOp = false;
-      if (frame) {
-        verbose(`Filter: read sink [${id}] received: data, pts=${frame.pts().toString()}`);
-        if (sink.type === 'Video') {
-          (frame as ffmpeg.VideoFrame).setPictureType(ffmpeg.AV_PICTURE_TYPE_NONE);
-        }
-        frame.setTimeBase(this.timeBase);
-        frame.setStreamIndex(0);
+      // Drain as many frames as the Readable can accept in a single async call
+      const max = Math.max(this.sink[id].readableHighWaterMark - this.sink[id].readableLength, 1);
+      frames = await this.pull(id, max);
+      for (const frame of frames) {
         more = this.sink[id].push(frame);
         sink.waitingToRead++;
-      } else {
+      }
+      if (!frames.length) {
         verbose(`Filter: read sink [${id}]: no more frames available`);
       }
-    } while (frame && sink.waitingToRead > 0 && more);
+    } while (frames.length && sink.waitingToRead > 0 && more);
 
-    if (!stillStreaming && frame === null) {
+    if (!stillStreaming && !frames.length) {
       verbose(`Filter: read sink [${id}]: sending null for EOF`);
       this.sink[id].push(null);
       return;
     }
-    verbose(`Filter: read sink [${id}]: cycle for [${id}] end, more: ${more}, last: ${frame && frame.pts().toString()}, waiting: ${sink.waitingToRead}`);
+    verbose(`Filter: read sink [${id}]: cycle for [${id}] end, more: ${more}, last: ${frames.length ? frames[frames.length - 1].pts().toString() : 'none'}, waiting: ${sink.waitingToRead}`);
     sink.busy = false;
   }
+
+  /**
+   * Pull-based alternative to the `sink` Readables, yields the frames
+   * produced by the sink `id` until all sources have ended.
+   * Cannot be used at the same time as `sink[id]`.
+   *
+   * @example
+   * for await (const frame of filter.frames('out'))
+   *   process(frame);
+   */
+  async *frames(id: string, options?: PrefetchOptions): AsyncGenerator<ffmpeg.VideoFrame | ffmpeg.AudioSamples, void, undefined> {
+    const sink = this.bufferSink[id];
+    if (!sink) {
+      throw new Error(`Invalid buffer sink [${id}]`);
+    }
+    if (sink.busy) {
+      throw new Error(`Sink [${id}] is already being read`);
+    }
+    sink.busy = true;
+    const depth = Math.max(options?.prefetch ?? 4, 1);
+    const pending: (ffmpeg.VideoFrame | ffmpeg.AudioSamples)[] = [];
+    try {
+      yield* prefetch(async () => {
+        for (;;) {
+          if (pending.length) return pending.shift()!;
+          if (this.destroyed) throw new Error('Filter has been destroyed');
+          // Same as read(), the state must be sampled before retrieving the frames
+          const stillStreaming = !!this.stillStreamingSources || !!this.pendingWrites;
+          const writeCount = this.writeCount;
+          pending.push(...await this.pull(id, depth));
+          if (pending.length) continue;
+          if (!stillStreaming) return null;
+          // Nothing available, wait for the sources to push more data
+          if (writeCount === this.writeCount)
+            await new Promise<void>((resolve) => this.writeWaiters.push(resolve));
+        }
+      }, depth);
+    } finally {
+      sink.busy = false;
+    }
+  }
 }
@@ -0,0 +1,105 @@
+import { performance } from 'node:perf_hooks';
+
+export interface LatencyTracerOptions {
+  /**
+   * Maximum number of frames followed at the same time, @default 256
+   */
+  maxPending?: number;
+  /**
+   * The stage where the frames leave the pipeline, their entries are
+   * removed once they have passed it, @default 'muxer'
+   */
+  lastStage?: string;
+}
+
+export interface LatencyStageReport {
+  /**
+   * Number of frames that have passed this stage
+   */
+  count: number;
+  /**
+   * Mean, maximum and last delay since the entry, in milliseconds
+   */
+  mean: number;
+  max: number;
+  last: number;
+}
+
+/**
+ * End-to-end latency tracing of a video pipeline.
+ *
+ * The same tracer is passed in the `tracer` option of the `Demuxer`, the
+ * `VideoDecoder`, the `VideoEncoder` and the `Muxer`. A frame is stamped when
+ * it enters the pipeline - usually when its packet is read by the Demuxer -
+ * and then every time it leaves one of the stages. Frames are identified by
+ * their timestamp in milliseconds which is preserved by the decoders
+ * and the encoders. A frame is forgotten once it has passed `lastStage`,
+ * a pipeline that does not end with a `Muxer` must set it.
+ *
+ * @example
+ * const tracer = new LatencyTracer;
+ * const input = new Demuxer({ inputFile: 'rtmp://server/live', lowLatency: true, tracer });
+ * const decoder = new VideoDecoder({ stream: input.video[0].stream, lowLatency: true, tracer });
+ * ...
+ * setInterval(() => console.log(tracer.report()), 1000);
+ */
+export class LatencyTracer {
+  // Entry time of the frames currently in the pipeline
+  protected pending: Map<number, number>;
+  protected maxPending: number;
+  protected lastStage: string;
+  protected stages: Record<string, LatencyStageReport>;
+
+  constructor(options?: LatencyTracerOptions) {
+    this.pending = new Map;
+    this.maxPending = options?.maxPending ?? 256;
+    this.lastStage = options?.lastStage ?? 'muxer';
+    this.stages = {};
+  }
+
+  /**
+   * Stamp a frame leaving a stage, the first stamp of a frame is its entry
+   */
+  stamp(stage: string, seconds: number | null): void {
+    if (seconds === null || !isFinite(seconds)) return;
+    const now = performance.now();
+    let key = Math.round(seconds * 1000);
+    // Rescaling between time bases can round to the next millisecond
+    if (!this.pending.has(key)) {
+      if (this.pending.has(key - 1)) key--;
+      else if (this.pending.has(key + 1)) key++;
+    }
+    let entry = this.pending.get(key);
+    if (entry === undefined) {
+      entry = now;
+      this.pending.set(key, now);
+      if (this.pending.size > this.maxPending)
+        this.pending.delete(this.pending.keys().next().value!);
+    }
+    // A stale entry would be matched by a later frame with the same timestamp
+    if (stage === this.lastStage)
+      this.pending.delete(key);
+
+    const delay = now - entry;
+    const s = this.stages[stage] ?? (this.stages[stage] = { count: 0, mean: 0, max: 0, last: 0 });
+    s.count++;
+    s.mean += (delay - s.mean) / s.count;
+    s.max = Math.max(s.max, delay);
+    s.last = delay;
+  }
+
+  /**
+   * The delays of every stage
+   */
+  report(): Record<string, LatencyStageReport> {
+    const r: Record<string, LatencyStageReport> = {};
+    for (const stage of Object.keys(this.stages))
+      r[stage] = { ...this.stages[stage] };
+    return r;
+  }
+
+  reset(): void {
+    this.pending.clear();
+    this.stages = {};
+  }
+}
@@ -43,6 +43,19 @@ export function isAudioDefinition(def: MediaStreamDefinition): def is AudioStrea
   return def.type === 'Audio';
 }
 
+export interface ExecutorOptions {
+  /**
+   * Run the codec operations on a dedicated MediaExecutor instead
+   * of the shared libuv thread pool
+   */
+  executor?: ffmpeg.MediaExecutor;
+  /**
+   * The executor pipeline, the operations of the same pipeline are executed
+   * sequentially and preferably on the same thread, @default 0
+   */
+  pipeline?: number;
+}
+
 export interface MediaTransformOptions extends TransformOptions {
   objectMode?: never;
 }
@@ -84,6 +97,10 @@ export interface MediaDecoder extends MediaStream { }
 
 export interface EncodedMediaReadableOptions extends ReadableOptions {
   stream: ffmpeg.Stream;
+  /**
+   * Called every time a packet is read from the stream
+   */
+  consumed?: () => void;
 }
 
 /**
@@ -92,10 +109,17 @@ export interface EncodedMediaReadableOptions extends ReadableOptions {
 export class EncodedMediaReadable extends Readable {
   stream_: ffmpeg.Stream;
   type: 'Audio' | 'Video';
+  // Sizes of the packets pushed with pushPacket() in the order of the Readable buffer
+  protected sizes: number[];
+  protected queued: number;
+  protected consumed: (() => void) | undefined;
 
   constructor(options: EncodedMediaReadableOptions) {
     super({ ...options, objectMode: true });
     this.stream_ = options.stream;
+    this.sizes = [];
+    this.queued = 0;
+    this.consumed = options.consumed;
     if (this.stream_.isAudio())
       this.type = 'Audio';
     else if (this.stream_.isVideo())
@@ -108,6 +132,32 @@ export class EncodedMediaReadable extends Readable {
     return true;
   }
 
+  /**
+   * Push a packet and account for its size in `queuedBytes`
+   */
+  pushPacket(packet: ffmpeg.Packet, size: number): boolean {
+    this.sizes.push(size);
+    this.queued += size;
+    return this.push(packet);
+  }
+
+  /**
+   * Bytes of the packets waiting in the buffer of the stream
+   */
+  get queuedBytes(): number {
+    // The buffer is a FIFO, the packets still in it are the last ones pushed -
+    // the ones delivered directly to a flowing stream never enter it
+    while (this.sizes.length > this.readableLength)
+      this.queued -= this.sizes.shift()!;
+    return this.queued;
+  }
+
+  read(size?: number): ffmpeg.Packet | null {
+    const r = super.read(size);
+    if (this.consumed) this.consumed();
+    return r;
+  }
+
   get stream(): ffmpeg.Stream {
     return this.stream_;
   }
@@ -1,16 +1,25 @@
 import { EventEmitter, Readable, Writable, WritableOptions } from 'node:stream';
 import { EncodedMediaReadable, EncodedMediaWritable } from './MediaStream';
 import ffmpeg from '@mmomtchev/ffmpeg';
+import { StageStats } from './Stats';
+import { LatencyTracer } from './LatencyTracer';
+import { AbortOptions, IOGuard } from './Abort';
 
 const { FormatContext, OutputFormat } = ffmpeg;
 
 export const verbose = (process.env.DEBUG_MUXER || process.env.DEBUG_ALL) ? console.debug.bind(console) : () => undefined;
 
-export interface MuxerOptions extends WritableOptions {
+export interface MuxerOptions extends WritableOptions, AbortOptions {
   /**
    * The name of the output file, null for exposing a ReadStream
    */
   outputFile?: string;
+  /**
+   * A file descriptor to write to, a pipe, a socket or `process.stdout.fd`.
+   * It is written by ffmpeg's own I/O in the background thread without going through
+   * a JS stream, `outputFormat` is mandatory.
+   */
+  outputFd?: number;
   /**
    * Amount of data to buffer, only when writing to a WriteStream, @default 64Kb
    */
@@ -31,6 +40,14 @@ export interface MuxerOptions extends WritableOptions {
    * Open options
    */
   openOptions?: Record<string, string>;
+  /**
+   * Flush the I/O after every packet and reduce the WriteStream buffering
+   */
+  lowLatency?: boolean;
+  /**
+   * Stamp the video packets leaving the pipeline
+   */
+  tracer?: LatencyTracer;
 }
 
 /**
@@ -51,6 +68,9 @@ export interface MuxerOptions extends WritableOptions {
  * @example
  * const muxer = new Muxer({ highWaterMark: 16 * 1024, outputFormat: 'mp4', streams: [videoOutput, audioOutput] });
  * output.output.pipe(writable);
+ *
+ * @example
+ * const muxer = new Muxer({ outputFd: process.stdout.fd, outputFormat: 'matroska', streams: [videoOutput, audioOutput] });
  */
 export class Muxer extends EventEmitter {
   protected outputFile: string;
@@ -67,21 +87,29 @@ export class Muxer extends EventEmitter {
   protected writingQueue: { idx: number, packet: ffmpeg.Packet, callback: (error?: Error | null | undefined) => void; }[];
   protected ready: Promise<void>[];
   protected delayedDestroy: Error | null;
+  protected tracer: LatencyTracer | undefined;
+  protected guard: IOGuard;
   streams: EncodedMediaWritable[];
   video: EncodedMediaWritable[];
   audio: EncodedMediaWritable[];
   output?: Readable;
   destroyed: boolean;
+  // Per-stage counters
+  readonly stats = new StageStats;
 
   constructor(options: MuxerOptions) {
     super();
     if (options.outputFile) {
       this.outputFile = options.outputFile;
+    } else if (options.outputFd !== undefined) {
+      if (!options.outputFormat)
+        throw new Error('outputFormat is required when writing to a file descriptor');
+      this.outputFile = `pipe:${options.outputFd}`;
     } else {
       this.output = new ffmpeg.ReadableCustomIO;
       this.outputFile = 'WriteStream';
     }
-    this.highWaterMark = options.highWaterMark ?? (64 * 1024);
+    this.highWaterMark = options.highWaterMark ?? (options.lowLatency ? 4096 : (64 * 1024));
     this.outputFormatName = options.outputFormat ?? '';
     this.outputFormatOptions = options.outputFormatOptions ?? {};
     this.openOptions = options.openOptions ?? {};
@@ -96,11 +124,20 @@ export class Muxer extends EventEmitter {
     this.ready = [];
     this.destroyed = false;
     this.delayedDestroy = null;
+    this.tracer = options.tracer;
 
     this.outputFormat = new OutputFormat;
     this.outputFormat.setFormat(this.outputFormatName, this.outputFile, '');
     this.formatContext = new FormatContext;
     this.formatContext.setOutputFormat(this.outputFormat);
+    if (options.lowLatency)
+      this.formatContext.setOption('fflags', '+flush_packets');
+    this.guard = new IOGuard(options, (reason) => {
+      verbose(`Muxer: aborted: ${reason}`);
+      // If writing, it is delayed until the interrupted operation returns
+      this.destroy(reason);
+    });
+    this.guard.attach(this.formatContext, this.output as ffmpeg.ReadableCustomIO | undefined);
 
     // Collect all the async events that must
     // happen for the Muxer to be ready
@@ -138,9 +175,13 @@ export class Muxer extends EventEmitter {
           this.ended++;
           if (this.ended === this.streams.length) {
             verbose('Muxer: All streams ended, writing trailer');
-            this.formatContext.writeTrailerAsync()
+            // Delay an abort until the trailer has been written
+            this.writing = true;
+            this.guard.run(this.formatContext.writeTrailerAsync(), 'Writing the trailer')
               .then(() => this.formatContext.closeAsync())
               .then(() => {
+                this.writing = false;
+                this.guard.dispose();
                 if (this.output) {
                   verbose('Muxer: closing ReadableStream');
                   (this.output as any)._final(() => {
@@ -152,7 +193,10 @@ export class Muxer extends EventEmitter {
                 callback(null);
                 this.emit('finish');
               })
-              .catch(callback);
+              .catch((err) => {
+                this.writing = false;
+                callback(err);
+              });
           } else {
             callback(null);
           }
@@ -171,6 +215,13 @@ export class Muxer extends EventEmitter {
     }
   }
 
+  /**
+   * Abort all pending and future I/O, the streams are destroyed with `reason`
+   */
+  abort(reason?: Error): void {
+    this.guard.abort(reason);
+  }
+
   protected async destroy(e: Error) {
     if (this.writing) {
       // Delayed destroy
@@ -234,13 +285,15 @@ export class Muxer extends EventEmitter {
       }
 
       if (!this.output) {
-        await this.formatContext.openOutputOptionsAsync(this.outputFile, this.openOptions);
+        await this.guard.run(this.formatContext.openOutputOptionsAsync(this.outputFile, this.openOptions),
+          `Opening ${this.outputFile}`);
       } else {
-        await this.formatContext.openReadableAsync(this.output, this.highWaterMark);
+        await this.guard.run(this.formatContext.openReadableAsync(this.output, this.highWaterMark),
+          'Opening the WriteStream');
       }
       await this.formatContext.dumpAsync();
-      await this.formatContext.writeHeaderOptionsAsync(this.outputFormatOptions);
-      await this.formatContext.flushAsync();
+      await this.guard.run(this.formatContext.writeHeaderOptionsAsync(this.outputFormatOptions), 'Writing the header');
+      await this.guard.run(this.formatContext.flushAsync(), 'Writing the header');
       this.primed = true;
       this.emit('ready');
       verbose('Muxer: ready');
@@ -254,7 +307,8 @@ export class Muxer extends EventEmitter {
       verbose('Muxer: already destroyed');
       return void callback(this.delayedDestroy);
     }
-    if (!packet.isComplete()) {
+    const info = packet.info();
+    if (!info.isComplete) {
       verbose('Muxer: skipping empty packet');
       callback();
       return;
@@ -262,7 +316,7 @@ export class Muxer extends EventEmitter {
 
     this.writingQueue.push({ idx, packet, callback });
     if (this.writing) {
-      verbose(`Muxer: enqueuing for writing on #${idx}, pts=${packet.pts()}, queue length ${this.writingQueue.length}`);
+      verbose(`Muxer: enqueuing for writing on #${idx}, pts=${info.pts}, queue length ${this.writingQueue.length}`);
       return;
     }
 
@@ -282,7 +336,11 @@ export class Muxer extends EventEmitter {
         try {
           job.packet.setStreamIndex(job.idx);
           verbose(`Muxer: packet #${job.idx}: pts=${job.packet.pts()}, dts=${job.packet.dts()} / ${job.packet.pts().seconds()} / ${job.packet.timeBase()} / stream ${job.packet.streamIndex()}, size: ${job.packet.size()}`);
-          await this.formatContext.writePacketAsync(job.packet);
+          const seconds = job.packet.pts().seconds();
+          await this.stats.measure(this.guard.run(this.formatContext.writePacketAsync(job.packet), 'Writing'));
+          this.stats.frames++;
+          if (this.tracer && this.rawStreams[job.idx].isVideo())
+            this.tracer.stamp('muxer', seconds);
           if (this.delayedDestroy) {
             verbose('Muxer: destroyed while writing, resuming destroy');
             this.writing = false;
@@ -292,8 +350,10 @@ export class Muxer extends EventEmitter {
           job.callback();
         } catch (err) {
           verbose(`Muxer: ${err}`);
+          this.writing = false;
+          this.writingQueue = [];
           job.callback(err as Error);
-          this.destroy(err as Error);
+          return void this.destroy(err as Error);
         }
       }
       this.writing = false;
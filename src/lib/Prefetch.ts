@@ -0,0 +1,51 @@
+export interface PrefetchOptions {
+  /**
+   * Number of elements to read ahead of the consumer, @default 4
+   */
+  prefetch?: number;
+}
+
+/**
+ * Pull-based iteration over a native source with read-ahead.
+ * `next` is always called sequentially - never concurrently - and
+ * it is kept running up to `depth` elements ahead of the consumer.
+ * `null` marks the end of the data.
+ *
+ * This is the lightweight alternative to the object mode streams -
+ * there is no buffering besides the read-ahead and no events.
+ */
+export async function* prefetch<T>(next: () => Promise<T | null>, depth?: number): AsyncGenerator<T, void, undefined> {
+  const queue: Promise<T | null>[] = [];
+  let ended = false;
+  let last: Promise<unknown> = Promise.resolve();
+
+  const schedule = () => {
+    const p = last
+      .then(() => ended ? null : next())
+      .then((r) => {
+        if (r === null) ended = true;
+        return r;
+      }, (err) => {
+        ended = true;
+        throw err;
+      });
+    // Errors are delivered to the consumer through the queue
+    last = p.catch(() => undefined);
+    queue.push(p);
+  };
+
+  for (let i = 0; i < Math.max(depth ?? 4, 1); i++) schedule();
+  try {
+    for (;;) {
+      const r = await queue.shift()!;
+      if (r === null) return;
+      schedule();
+      yield r;
+    }
+  } finally {
+    // The consumer has stopped early, the read-ahead must complete before
+    // anyone else can use the underlying native object
+    ended = true;
+    await Promise.all(queue.map((p) => p.catch(() => undefined)));
+  }
+}
@@ -0,0 +1,431 @@
+import ffmpeg from '@mmomtchev/ffmpeg';
+import { ExecutorOptions, VideoStreamDefinition } from './MediaStream';
+import { EncoderPool, openEncoderContext } from './EncoderPool';
+import { StageStats } from './Stats';
+
+const { FormatContext, VideoDecoderContext, Codec, Packet, OutputFormat } = ffmpeg;
+
+export const verbose = (process.env.DEBUG_SEGMENT_CACHE || process.env.DEBUG_ALL) ? console.debug.bind(console) : () => undefined;
+
+export interface SegmentCacheOptions extends ExecutorOptions {
+  /**
+   * The name of the input file, it must be seekable
+   */
+  inputFile: string;
+  /**
+   * The output definitions, by name
+   */
+  renditions: Record<string, VideoStreamDefinition>;
+  /**
+   * Duration of a segment in seconds
+   */
+  segmentDuration: number;
+  /**
+   * The input stream, @default the first video stream
+   */
+  streamIndex?: number;
+  /**
+   * Output format of the segments, @default mpegts
+   */
+  outputFormat?: string;
+  /**
+   * Maximum number of segments kept in the cache, @default 64
+   */
+  maxSegments?: number;
+  /**
+   * Maximum number of bytes kept in the cache, @default 256MB
+   */
+  maxBytes?: number;
+  /**
+   * Reuse the opened encoders of this pool, @default a private pool
+   */
+  pool?: EncoderPool;
+}
+
+// The warm state of a rendition, it is kept between the requests
+interface Session {
+  formatContext: ffmpeg.FormatContext;
+  // Reads the next packet, avcpp reads packets only after findStreamInfo()
+  read: () => Promise<ffmpeg.Packet>;
+  decoder: ffmpeg.VideoDecoderContext;
+  rescaler: ffmpeg.VideoRescaler | null;
+  pipeline: number;
+  // The segment that the current position of the input leads to, -1 if unknown
+  next: number;
+  // The first frame of the next segment, decoded while looking for the end of the previous one
+  pending: ffmpeg.VideoFrame | null;
+  eof: boolean;
+  // Serializes the requests of the same rendition
+  queue: Promise<unknown>;
+}
+
+/**
+ * Just-in-time transcoding of the segments of a video stream for on-demand
+ * HLS or DASH serving.
+ *
+ * `segment(rendition, index)` returns the encoded segment covering
+ * `[index * segmentDuration, (index + 1) * segmentDuration)` as a Buffer in
+ * `outputFormat`. The first frame of every segment is encoded as a keyframe and
+ * the timestamps are those of the input, so the segments can be played in sequence.
+ *
+ * Every rendition keeps its input, its decoder and its encoder open between the
+ * requests: a request for the segment that follows the previous one continues decoding
+ * where it stopped, any other segment seeks to the last keyframe before its start.
+ * The encoders are returned to the `EncoderPool` after every segment and reused
+ * by the next one if the codec supports flushing. The produced segments are kept
+ * in an LRU cache bounded by `maxSegments` and `maxBytes`, the concurrent requests
+ * of the same segment share a single transcoding.
+ *
+ * Only the video is transcoded, the audio is usually served as a separate rendition.
+ *
+ * @example
+ * const cache = new SegmentCache({
+ *   inputFile: 'movie.mp4',
+ *   segmentDuration: 6,
+ *   renditions: { '720p': def720p, '360p': def360p }
+ * });
+ * const count = await cache.segmentCount();
+ * app.get('/:rendition/:index.ts', async (req, res) => {
+ *   res.send(await cache.segment(req.params.rendition, +req.params.index));
+ * });
+ */
+export class SegmentCache {
+  protected inputFile: string;
+  protected renditions: Record<string, VideoStreamDefinition>;
+  protected segmentDuration: number;
+  protected streamIndex: number | undefined;
+  protected outputFormat: string;
+  protected maxSegments: number;
+  protected maxBytes: number;
+  protected pool: EncoderPool;
+  protected executor: ffmpeg.MediaExecutor | undefined;
+  protected pipeline: number;
+  protected probed: Promise<void> | undefined;
+  protected parameters: ffmpeg.StreamParameters[];
+  protected duration: number;
+  protected sessions: Map<string, Promise<Session>>;
+  // Map preserves the insertion order, the least recently used segment is the first one
+  protected cache: Map<string, Buffer>;
+  protected cachedBytes: number;
+  protected inflight: Map<string, Promise<Buffer>>;
+  /**
+   * Number of segments returned from the cache
+   */
+  hits: number;
+  /**
+   * Number of segments that had to be transcoded
+   */
+  misses: number;
+  /**
+   * Number of requests that required seeking
+   */
+  seeks: number;
+  // Per-stage counters
+  readonly stats = new StageStats;
+
+  constructor(options: SegmentCacheOptions) {
+    if (!(options.segmentDuration > 0))
+      throw new Error('segmentDuration must be positive');
+    this.inputFile = options.inputFile;
+    this.segmentDuration = options.segmentDuration;
+    this.streamIndex = options.streamIndex;
+    this.outputFormat = options.outputFormat ?? 'mpegts';
+    this.maxSegments = options.maxSegments ?? 64;
+    this.maxBytes = options.maxBytes ?? (256 * 1024 * 1024);
+    this.pool = options.pool ?? new EncoderPool;
+    this.executor = options.executor;
+    this.pipeline = options.pipeline ?? 0;
+
+    // The encoders must be opened with the global header flag if the format requires it
+    const format = new OutputFormat;
+    format.setFormat(this.outputFormat, '', '');
+    const globalHeader = format.isFlags(ffmpeg.AV_FMT_GLOBALHEADER);
+    this.renditions = {};
+    for (const name of Object.keys(options.renditions)) {
+      this.renditions[name] = { ...options.renditions[name] };
+      if (globalHeader)
+        this.renditions[name].flags = (this.renditions[name].flags ?? 0) | ffmpeg.AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+
+    this.parameters = [];
+    this.duration = 0;
+    this.sessions = new Map;
+    this.cache = new Map;
+    this.cachedBytes = 0;
+    this.inflight = new Map;
+    this.hits = 0;
+    this.misses = 0;
+    this.seeks = 0;
+  }
+
+  protected probe(): Promise<void> {
+    if (!this.probed) {
+      this.probed = (async () => {
+        verbose(`SegmentCache: probing ${this.inputFile}`);
+        const formatContext = new FormatContext;
+        await formatContext.openInputAsync(this.inputFile);
+        await formatContext.findStreamInfoAsync();
+        for (let i = 0; i < formatContext.streamsCount(); i++) {
+          const stream = formatContext.stream(i);
+          this.parameters.push(stream.parameters());
+          if (this.streamIndex === undefined && stream.isVideo())
+            this.streamIndex = i;
+        }
+        if (this.streamIndex === undefined || !this.parameters[this.streamIndex] ||
+          !formatContext.stream(this.streamIndex).isVideo())
+          throw new Error('Input does not have a video stream');
+        const duration = formatContext.stream(this.streamIndex).duration();
+        this.duration = duration.isValid() && !duration.isNoPts() ? duration.seconds() : 0;
+        await formatContext.closeAsync();
+      })();
+    }
+    return this.probed;
+  }
+
+  /**
+   * Number of segments, 0 if the duration of the input is not known
+   */
+  async segmentCount(): Promise<number> {
+    await this.probe();
+    return Math.ceil(this.duration / this.segmentDuration);
+  }
+
+  /**
+   * Retrieve an encoded segment, from the cache if it is available
+   */
+  async segment(rendition: string, index: number): Promise<Buffer> {
+    if (!this.renditions[rendition])
+      throw new Error(`Unknown rendition ${rendition}`);
+    if (!Number.isInteger(index) || index < 0)
+      throw new Error(`Invalid segment index ${index}`);
+    const count = await this.segmentCount();
+    if (count > 0 && index >= count)
+      throw new Error(`Invalid segment index ${index}, the input has ${count} segments`);
+    const key = `${rendition}:${index}`;
+
+    const cached = this.cache.get(key);
+    if (cached) {
+      // Move it to the end of the LRU order
+      this.cache.delete(key);
+      this.cache.set(key, cached);
+      this.hits++;
+      return cached;
+    }
+    const running = this.inflight.get(key);
+    if (running) {
+      this.hits++;
+      return running;
+    }
+
+    this.misses++;
+    const job = this.session(rendition)
+      .then((session) => {
+        // The requests of the same rendition run one at a time
+        const r = session.queue.then(() => this.transcode(rendition, session, index));
+        session.queue = r.catch(() => undefined);
+        return r;
+      })
+      .then((data) => {
+        this.store(key, data);
+        return data;
+      })
+      .finally(() => {
+        this.inflight.delete(key);
+      });
+    this.inflight.set(key, job);
+    return job;
+  }
+
+  /**
+   * Drop all the cached segments and close all the renditions
+   */
+  async clear(): Promise<void> {
+    this.cache.clear();
+    this.cachedBytes = 0;
+    const sessions = [...this.sessions.values()];
+    this.sessions.clear();
+    for (const s of sessions) {
+      const session = await s.catch(() => null);
+      if (!session) continue;
+      await session.queue;
+      await session.formatContext.closeAsync();
+    }
+  }
+
+  protected store(key: string, data: Buffer): void {
+    this.cache.set(key, data);
+    this.cachedBytes += data.length;
+    while (this.cache.size > 0 && (this.cache.size > this.maxSegments || this.cachedBytes > this.maxBytes)) {
+      const [oldest, evicted] = this.cache.entries().next().value!;
+      verbose(`SegmentCache: evicting ${oldest}`);
+      this.cache.delete(oldest);
+      this.cachedBytes -= evicted.length;
+    }
+  }
+
+  protected session(rendition: string): Promise<Session> {
+    let session = this.sessions.get(rendition);
+    if (!session) {
+      session = (async () => {
+        await this.probe();
+        const streamIndex = this.streamIndex!;
+        verbose(`SegmentCache: opening rendition ${rendition}`);
+        const formatContext = new FormatContext;
+        await formatContext.openInputAsync(this.inputFile);
+        let read: () => Promise<ffmpeg.Packet>;
+        if (formatContext.streamsCount() === this.parameters.length) {
+          for (let i = 0; i < this.parameters.length; i++)
+            formatContext.stream(i).setParameters(this.parameters[i]);
+          read = () => formatContext.readFrameAsync();
+        } else {
+          await formatContext.findStreamInfoAsync();
+          read = () => formatContext.readPacketAsync();
+        }
+        const decoder = new VideoDecoderContext(formatContext.stream(streamIndex));
+        decoder.setRefCountedFrames(true);
+        await decoder.openCodecAsync(new Codec);
+
+        const def = this.renditions[rendition];
+        let rescaler: ffmpeg.VideoRescaler | null = null;
+        if (decoder.width() !== def.width || decoder.height() !== def.height ||
+          decoder.pixelFormat().toString() !== def.pixelFormat.toString()) {
+          rescaler = new ffmpeg.VideoRescaler(def.width, def.height, def.pixelFormat,
+            decoder.width(), decoder.height(), decoder.pixelFormat(), ffmpeg.SWS_BILINEAR);
+        }
+        return {
+          formatContext,
+          read,
+          decoder,
+          rescaler,
+          pipeline: this.pipeline + Object.keys(this.renditions).indexOf(rendition),
+          next: 0,
+          pending: null,
+          eof: false,
+          queue: Promise.resolve()
+        };
+      })();
+      // A failed rendition will be reopened by the next request
+      session.catch(() => this.sessions.delete(rendition));
+      this.sessions.set(rendition, session);
+    }
+    return session;
+  }
+
+  protected decode(s: Session, packet: ffmpeg.Packet): Promise<ffmpeg.VideoFrame> {
+    return this.executor ?
+      this.executor.decodeVideo(s.pipeline, s.decoder, packet) :
+      s.decoder.decodeAsync(packet, true);
+  }
+
+  /**
+   * The next decoded frame of a rendition, null at the end of the input
+   */
+  protected async nextFrame(s: Session): Promise<ffmpeg.VideoFrame | null> {
+    if (s.pending) {
+      const frame = s.pending;
+      s.pending = null;
+      return frame;
+    }
+    for (;;) {
+      if (s.eof) {
+        // Drain the decoder
+        const frame = await this.decode(s, new Packet);
+        return frame.isComplete() ? frame : null;
+      }
+      const packet = await s.read();
+      const info = packet.info();
+      if (info.isNull) {
+        s.eof = true;
+        continue;
+      }
+      if (info.streamIndex !== this.streamIndex) continue;
+      const frame = await this.decode(s, packet);
+      if (frame.isComplete()) return frame;
+    }
+  }
+
+  protected async transcode(rendition: string, s: Session, index: number): Promise<Buffer> {
+    const def = this.renditions[rendition];
+    const start = index * this.segmentDuration;
+    const end = start + this.segmentDuration;
+
+    const adjacent = s.next === index;
+    // The position is unknown if this fails
+    s.next = -1;
+    if (!adjacent) {
+      verbose(`SegmentCache: ${rendition}: seeking to segment ${index}`);
+      const timeBase = this.parameters[this.streamIndex!].timeBase;
+      await s.formatContext.seekAsync(this.streamIndex!, Math.floor(start * timeBase[1] / timeBase[0]));
+      s.decoder.flush();
+      s.pending = null;
+      s.eof = false;
+      this.seeks++;
+    }
+    verbose(`SegmentCache: ${rendition}: segment ${index} [${start}s, ${end}s)`);
+
+    const encoder = this.pool.take(def) ?? await openEncoderContext(def);
+    const encoderTimeBase = await encoder.timeBaseAsync();
+
+    // The muxer writes synchronously to memory
+    const output = new ffmpeg.ReadableCustomIO({ sync: true });
+    const formatContext = new FormatContext;
+    let opened = false;
+    let released = false;
+    try {
+      const format = new OutputFormat;
+      format.setFormat(this.outputFormat, '', '');
+      formatContext.setOutputFormat(format);
+      const stream = formatContext.addVideoStream(encoder);
+      if (def.frameRate)
+        stream.setFrameRate(def.frameRate);
+      formatContext.openReadable(output, 64 * 1024);
+      opened = true;
+      formatContext.writeHeader();
+      const write = (packets: ffmpeg.Packet[]) => {
+        for (const packet of packets) {
+          packet.setStreamIndex(0);
+          formatContext.writePacket(packet);
+        }
+      };
+
+      let first = true;
+      for (;;) {
+        let frame = await this.nextFrame(s);
+        if (!frame) break;
+        const seconds = frame.info().seconds;
+        if (seconds === null || seconds < start) continue;
+        if (seconds >= end) {
+          s.pending = frame;
+          break;
+        }
+        if (s.rescaler)
+          frame = await s.rescaler.rescaleAsync(frame);
+        frame.setPictureType(first ? ffmpeg.AV_PICTURE_TYPE_I : ffmpeg.AV_PICTURE_TYPE_NONE);
+        frame.setTimeBase(encoderTimeBase);
+        first = false;
+        write(await this.stats.measure(this.executor ?
+          this.executor.encodeVideoBatch(s.pipeline, encoder, [frame]) :
+          encoder.encodeBatchAsync([frame])));
+        this.stats.frames++;
+      }
+      write(await this.stats.measure(this.executor ?
+        this.executor.finalizeVideoBatch(s.pipeline, encoder) :
+        encoder.finalizeBatchAsync()));
+      // A drained encoder is reused or replaced by the pool
+      this.pool.release(def, encoder);
+      released = true;
+      formatContext.writeTrailer();
+    } finally {
+      // A failed encoder is in an unknown state and it is not returned to the pool
+      if (!released)
+        encoder.close();
+      if (opened)
+        formatContext.close();
+    }
+    s.next = index + 1;
+
+    const data = Buffer.concat(output.drain());
+    verbose(`SegmentCache: ${rendition}: segment ${index}, ${data.length} bytes`);
+    return data;
+  }
+}
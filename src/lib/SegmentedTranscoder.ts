@@ -0,0 +1,430 @@
+import * as os from 'node:os';
+import { Readable } from 'node:stream';
+import ffmpeg from '@mmomtchev/ffmpeg';
+import { EncodedVideoReadable, ExecutorOptions, MediaEncoder, VideoStreamDefinition } from './MediaStream';
+import { createEncoderContext, findEncoderCodec, openEncoderContext } from './EncoderPool';
+import { StageStats } from './Stats';
+
+const { FormatContext, VideoDecoderContext, Codec, Packet, Timestamp } = ffmpeg;
+
+export const verbose = (process.env.DEBUG_SEGMENTED_TRANSCODER || process.env.DEBUG_ALL) ? console.debug.bind(console) : () => undefined;
+
+export interface SegmentedTranscoderOptions extends ExecutorOptions {
+  /**
+   * The name of the input file, it must be seekable
+   */
+  inputFile: string;
+  /**
+   * The encoded output
+   */
+  output: VideoStreamDefinition;
+  /**
+   * The input stream, @default the first video stream
+   */
+  streamIndex?: number;
+  /**
+   * Number of segments encoded in parallel, @default the number of
+   * CPUs with a MediaExecutor, UV_THREADPOOL_SIZE otherwise
+   */
+  segments?: number;
+  /**
+   * Maximum number of bytes of encoded packets waiting to be pushed
+   * in each segment, its encoding is paused when it is reached, @default 8MB
+   */
+  segmentBufferSize?: number;
+}
+
+interface Segment {
+  // Encoded packets waiting to be pushed
+  packets: ffmpeg.Packet[];
+  // Their size in bytes
+  bytes: number;
+  done: boolean;
+  // Wakes the stitching when a packet is added
+  wake?: () => void;
+  // Wakes the encoding when a packet has been pushed
+  resume?: () => void;
+  // The dts of the segment is shifted by this amount
+  dtsOffset: number | null;
+  // The pts of the first keyframe, null if the segment is empty
+  start: Promise<number | null>;
+  resolveStart: (pts: number | null) => void;
+}
+
+/**
+ * A SegmentedTranscoder decodes and encodes a single video stream of a file
+ * by splitting it at the keyframes into a number of segments that are
+ * transcoded in parallel - each one with its own FormatContext, decoder
+ * and encoder. It is an encoded Readable that can be piped to a Muxer,
+ * the segments are stitched back in order and the packets keep the
+ * timestamps of the input.
+ *
+ * Even the best encoders do not scale linearly beyond a few threads,
+ * this allows to use all the cores when transcoding a long file.
+ * Every segment starts with a keyframe and is encoded independently,
+ * the encoder must produce identical headers for identical settings.
+ * Use a `MediaExecutor` to have each segment run on its own thread
+ * (pipelines `pipeline` to `pipeline + segments - 1`), otherwise all of them
+ * share the libuv thread pool. The encoder's own threads should be limited
+ * through `codecOptions` (for example `threads: '2'`).
+ *
+ * The later segments are buffered in memory after encoding until
+ * all the preceding segments have been pushed, each one is paused
+ * once it has buffered `segmentBufferSize` bytes.
+ *
+ * The encoder of a new segment starts with an empty reorder buffer
+ * and the dts of its first packets can be lower than the last dts of
+ * the previous segment. They are shifted by a constant offset for the
+ * whole segment, and clamped to the pts. This requires a time base
+ * finer than the frame duration, such as the default 1/1000.
+ *
+ * @example
+ * const executor = new ffmpeg.MediaExecutor;
+ * const video = new SegmentedTranscoder({ inputFile: 'input.mp4', output: videoDefinition, executor });
+ * const muxer = new Muxer({ outputFile: 'output.mp4', streams: [video] });
+ * video.pipe(muxer.video[0]);
+ */
+export class SegmentedTranscoder extends Readable implements MediaEncoder, EncodedVideoReadable {
+  protected inputFile: string;
+  protected def: VideoStreamDefinition;
+  protected streamIndex: number | undefined;
+  protected segmentsCount: number;
+  protected segmentBufferSize: number;
+  protected executor: ffmpeg.MediaExecutor | undefined;
+  protected pipeline: number;
+  // The encoder of the first segment, it is used to create the output stream
+  protected encoder: ffmpeg.VideoEncoderContext;
+  protected codec_: ffmpeg.Codec;
+  protected parameters: ffmpeg.StreamParameters[];
+  protected duration: number;
+  protected started: boolean;
+  // The last dts of the output, in the encoder time base
+  protected lastDts: number | null;
+  // Resumes the stitching when the consumer wants more data
+  protected pull: (() => void) | undefined;
+  // Set when the stitching has failed, the paused segments must give up
+  protected aborted: Error | undefined;
+  stream_: ffmpeg.Stream;
+  type = 'Video' as const;
+  ready: boolean;
+  // Per-stage counters
+  readonly stats = new StageStats;
+
+  constructor(options: SegmentedTranscoderOptions) {
+    super({ objectMode: true });
+    this.inputFile = options.inputFile;
+    this.def = { ...options.output };
+    this.streamIndex = options.streamIndex;
+    this.executor = options.executor;
+    this.pipeline = options.pipeline ?? 0;
+    this.segmentsCount = Math.max(options.segments ??
+      (this.executor ? os.cpus().length : +(process.env.UV_THREADPOOL_SIZE ?? 4)), 1);
+    this.segmentBufferSize = options.segmentBufferSize ?? (8 * 1024 * 1024);
+    this.codec_ = findEncoderCodec(this.def);
+    this.encoder = createEncoderContext(this.def, this.codec_);
+    this.parameters = [];
+    this.duration = 0;
+    this.started = false;
+    this.ready = false;
+    this.lastDts = null;
+    this.stream_ = this.encoder.stream();
+  }
+
+  _construct(callback: (error?: Error | null | undefined) => void): void {
+    (async () => {
+      verbose(`SegmentedTranscoder: probing ${this.inputFile}`);
+      const formatContext = new FormatContext;
+      await formatContext.openInputAsync(this.inputFile);
+      await formatContext.findStreamInfoAsync();
+      for (let i = 0; i < formatContext.streamsCount(); i++) {
+        const stream = formatContext.stream(i);
+        this.parameters.push(stream.parameters());
+        if (this.streamIndex === undefined && stream.isVideo())
+          this.streamIndex = i;
+      }
+      if (this.streamIndex === undefined || !this.parameters[this.streamIndex] ||
+        !formatContext.stream(this.streamIndex).isVideo())
+        throw new Error('Input does not have a video stream');
+      const duration = formatContext.stream(this.streamIndex).duration();
+      this.duration = duration.isValid() && !duration.isNoPts() ? duration.seconds() : 0;
+      await formatContext.closeAsync();
+      if (!(this.duration > 0)) {
+        verbose('SegmentedTranscoder: unknown duration, using a single segment');
+        this.segmentsCount = 1;
+      }
+
+      // The Muxer sets AV_CODEC_FLAG_GLOBAL_HEADER on the first encoder
+      // before it is opened, it is carried over to the other segments
+      if (await this.encoder.isFlagsAsync(ffmpeg.AV_CODEC_FLAG_GLOBAL_HEADER))
+        this.def.flags = (this.def.flags ?? 0) | ffmpeg.AV_CODEC_FLAG_GLOBAL_HEADER;
+      await this.encoder.openCodecOptionsAsync(this.def.codecOptions ?? {}, this.codec_);
+      verbose(`SegmentedTranscoder: stream ${this.streamIndex}, ${this.duration}s, ` +
+        `${this.segmentsCount} segments, encoder ${this.codec_.name()}`);
+      callback();
+      this.ready = true;
+      this.emit('ready');
+    })()
+      .catch(callback);
+  }
+
+  _read(): void {
+    if (this.started) {
+      const pull = this.pull;
+      this.pull = undefined;
+      pull?.();
+      return;
+    }
+    this.started = true;
+    this.run()
+      .then(() => {
+        verbose('SegmentedTranscoder: all segments pushed');
+        this.push(null);
+      })
+      .catch((err) => {
+        verbose(`SegmentedTranscoder: ${err}`);
+        this.destroy(err);
+      });
+  }
+
+  protected async run(): Promise<void> {
+    const segments: Segment[] = [];
+    for (let i = 0; i < this.segmentsCount; i++) {
+      let resolveStart: (pts: number | null) => void = () => undefined;
+      const start = new Promise<number | null>((resolve) => {
+        resolveStart = resolve;
+      });
+      segments.push({ packets: [], bytes: 0, done: false, dtsOffset: null, start, resolveStart });
+    }
+
+    const workers = segments.map((s, i) => this.segment(segments, i)
+      .catch((err) => {
+        s.resolveStart(null);
+        throw err;
+      })
+      .finally(() => {
+        s.done = true;
+        s.wake?.();
+      }));
+    // The first error stops the stitching
+    const failed = Promise.all(workers).then(() => new Promise<never>(() => undefined));
+    failed.catch(() => undefined);
+
+    try {
+      for (const s of segments) {
+        for (;;) {
+          while (s.packets.length > 0) {
+            const packet = s.packets.shift()!;
+            s.bytes -= packet.size();
+            s.resume?.();
+            if (!this.pushPacket(s, packet)) {
+              await Promise.race([failed, new Promise<void>((resolve) => {
+                this.pull = resolve;
+              })]);
+            }
+          }
+          if (s.done) break;
+          await Promise.race([failed, new Promise<void>((resolve) => {
+            s.wake = resolve;
+          })]);
+        }
+      }
+    } catch (err) {
+      // Release the segments waiting for room
+      this.aborted = err as Error;
+      for (const s of segments) s.resume?.();
+      throw err;
+    }
+    await Promise.all(workers);
+  }
+
+  /**
+   * Add an encoded packet to a segment, waits while the segment is full
+   */
+  protected async enqueue(segment: Segment, packet: ffmpeg.Packet): Promise<void> {
+    segment.packets.push(packet);
+    segment.bytes += packet.size();
+    segment.wake?.();
+    while (segment.bytes >= this.segmentBufferSize) {
+      if (this.aborted) throw this.aborted;
+      await new Promise<void>((resolve) => {
+        segment.resume = resolve;
+      });
+    }
+    if (this.aborted) throw this.aborted;
+  }
+
+  /**
+   * The packets of a new segment can have a dts that is lower than the last dts
+   * of the previous segment as its encoder starts with an empty reorder buffer,
+   * the dts of the whole segment is shifted by the offset of its first packet
+   */
+  protected pushPacket(segment: Segment, packet: ffmpeg.Packet): boolean {
+    const info = packet.info();
+    if (info.dts !== null) {
+      if (segment.dtsOffset === null)
+        segment.dtsOffset = this.lastDts !== null && info.dts <= this.lastDts ? this.lastDts + 1 - info.dts : 0;
+      let dts = info.dts + segment.dtsOffset;
+      // The frames reordered at the start of the segment cannot go past their pts
+      if (info.pts !== null && dts > info.pts)
+        dts = info.pts;
+      if (this.lastDts !== null && dts <= this.lastDts)
+        throw new Error(`Cannot stitch the segments at dts ${info.dts}, the time base of the encoder ` +
+          `${info.timeBase.join('/')} is too coarse`);
+      if (dts !== info.dts) {
+        verbose(`SegmentedTranscoder: adjusting dts ${info.dts} -> ${dts}`);
+        packet.setDts(new Timestamp(dts, new ffmpeg.Rational(info.timeBase[0], info.timeBase[1])));
+      }
+      this.lastDts = dts;
+    }
+    return this.push(packet);
+  }
+
+  /**
+   * Transcode one segment, it starts at the last keyframe before its
+   * share of the duration and ends at the keyframe where the next non-empty
+   * segment starts
+   */
+  protected async segment(segments: Segment[], idx: number): Promise<void> {
+    const segment = segments[idx];
+    const streamIndex = this.streamIndex!;
+    const pipeline = this.pipeline + idx;
+
+    const formatContext = new FormatContext;
+    await formatContext.openInputAsync(this.inputFile);
+    let read: () => Promise<ffmpeg.Packet>;
+    if (formatContext.streamsCount() === this.parameters.length) {
+      for (let i = 0; i < this.parameters.length; i++)
+        formatContext.stream(i).setParameters(this.parameters[i]);
+      // avcpp reads packets only after findStreamInfo()
+      read = () => formatContext.readFrameAsync();
+    } else {
+      await formatContext.findStreamInfoAsync();
+      read = () => formatContext.readPacketAsync();
+    }
+    const stream = formatContext.stream(streamIndex);
+    const timeBase = this.parameters[streamIndex].timeBase;
+    if (idx > 0) {
+      const target = Math.round(this.duration * idx / this.segmentsCount * timeBase[1] / timeBase[0]);
+      await formatContext.seekAsync(streamIndex, target);
+    }
+
+    // The first keyframe
+    let packet: ffmpeg.Packet;
+    let info: ffmpeg.PacketInfo;
+    do {
+      packet = await read();
+      info = packet.info();
+    } while (!info.isNull && (info.streamIndex !== streamIndex || !info.isKeyPacket));
+    if (info.isNull) {
+      verbose(`SegmentedTranscoder: segment ${idx} is empty`);
+      segment.resolveStart(null);
+      await formatContext.closeAsync();
+      return;
+    }
+    const start = idx > 0 ? (info.pts ?? info.dts ?? 0) : -Infinity;
+    segment.resolveStart(start);
+
+    // The end is the start of the next non-empty segment, if a following
+    // segment starts at the same keyframe, this one is empty
+    let end = Infinity;
+    for (let i = idx + 1; i < segments.length; i++) {
+      const next = await segments[i].start;
+      if (next !== null) {
+        end = next;
+        break;
+      }
+    }
+    if (end <= start) {
+      verbose(`SegmentedTranscoder: segment ${idx} overlaps the next one`);
+      await formatContext.closeAsync();
+      return;
+    }
+    verbose(`SegmentedTranscoder: segment ${idx}: [${start}, ${end}) / ${timeBase.join('/')}`);
+
+    const decoder = new VideoDecoderContext(stream);
+    decoder.setRefCountedFrames(true);
+    await decoder.openCodecAsync(new Codec);
+    const encoder = idx === 0 ? this.encoder : await openEncoderContext(this.def);
+    const encoderTimeBase = await encoder.timeBaseAsync();
+
+    const encode = async (frame: ffmpeg.VideoFrame) => {
+      const frameInfo = frame.info();
+      if (!frameInfo.isComplete || frameInfo.pts === null) return;
+      // The leading frames of an open GOP belong to the previous segment
+      if (frameInfo.pts < start || frameInfo.pts >= end) return;
+      frame.setPictureType(ffmpeg.AV_PICTURE_TYPE_NONE);
+      frame.setTimeBase(encoderTimeBase);
+      const encoded = await this.stats.measure(this.executor ?
+        this.executor.encodeVideo(pipeline, encoder, frame) :
+        encoder.encodeAsync(frame));
+      this.stats.frames++;
+      if (encoded.isComplete())
+        await this.enqueue(segment, encoded);
+    };
+    const decode = (p: ffmpeg.Packet) => this.executor ?
+      this.executor.decodeVideo(pipeline, decoder, p) :
+      decoder.decodeAsync(p, true);
+
+    // The keyframe at the end is still decoded as the leading frames
+    // of an open GOP that precede it in presentation order reference it
+    let pastEnd = false;
+    for (;;) {
+      await encode(await decode(packet));
+      do {
+        packet = await read();
+        info = packet.info();
+      } while (!info.isNull && info.streamIndex !== streamIndex);
+      if (info.isNull) break;
+      const pts = info.pts ?? info.dts ?? 0;
+      if (pts >= end) {
+        if (pastEnd || !info.isKeyPacket) break;
+        pastEnd = true;
+      }
+    }
+
+    // Drain the decoder and then the encoder
+    const flush = new Packet;
+    for (;;) {
+      const frame = await decode(flush);
+      if (!frame.isComplete()) break;
+      await encode(frame);
+    }
+    for (;;) {
+      const encoded = await (this.executor ?
+        this.executor.finalizeVideo(pipeline, encoder) :
+        encoder.finalizeAsync());
+      if (!encoded.isComplete()) break;
+      await this.enqueue(segment, encoded);
+    }
+    await formatContext.closeAsync();
+    verbose(`SegmentedTranscoder: segment ${idx} done`);
+  }
+
+  get stream(): ffmpeg.Stream {
+    return this.stream_;
+  }
+
+  codec(): ffmpeg.Codec {
+    return this.encoder.codec();
+  }
+
+  codecParameters(): ffmpeg.CodecParametersView {
+    return this.stream_.codecParameters();
+  }
+
+  definition(): VideoStreamDefinition {
+    return this.def;
+  }
+
+  context(): ffmpeg.VideoEncoderContext {
+    return this.encoder;
+  }
+
+  isAudio(): boolean {
+    return false;
+  }
+
+  isVideo(): boolean {
+    return true;
+  }
+}
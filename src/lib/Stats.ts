@@ -0,0 +1,46 @@
+import { performance } from 'node:perf_hooks';
+
+/**
+ * Cheap counters of a stage of the streams API.
+ * `asyncTime` is the time spent waiting for the native operations -
+ * this includes both the time spent in the worker thread and the time
+ * spent waiting for a free thread, use `ffmpeg.stats()` to separate them
+ * when using a `MediaExecutor`.
+ * All times are in milliseconds.
+ */
+export class StageStats {
+  /**
+   * Number of native operations
+   */
+  calls = 0;
+  /**
+   * Number of frames or packets produced
+   */
+  frames = 0;
+  /**
+   * Time spent in native operations
+   */
+  asyncTime = 0;
+
+  static readonly fields = ['calls', 'frames', 'asyncTime'] as const;
+
+  /**
+   * Measure a native operation
+   */
+  async measure<T>(op: Promise<T>): Promise<T> {
+    const start = performance.now();
+    try {
+      return await op;
+    } finally {
+      this.calls++;
+      this.asyncTime += performance.now() - start;
+    }
+  }
+
+  /**
+   * A Float64Array snapshot in the order of `StageStats.fields`
+   */
+  snapshot(): Float64Array {
+    return new Float64Array([this.calls, this.frames, this.asyncTime]);
+  }
+}
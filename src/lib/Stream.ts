@@ -1,11 +1,19 @@
-export { AudioStreamDefinition, VideoStreamDefinition, MediaStream, MediaStreamDefinition, MediaTransform } from './MediaStream';
+export { AudioStreamDefinition, VideoStreamDefinition, MediaStream, MediaStreamDefinition, MediaTransform, ExecutorOptions } from './MediaStream';
 export { Muxer } from './Muxer';
-export { Demuxer } from './Demuxer';
-export { VideoEncoder } from './VideoEncoder';
-export { VideoDecoder } from './VideoDecoder';
+export { Demuxer, DemuxerIteratorOptions, DemuxerBufferStats } from './Demuxer';
+export { VideoEncoder, VideoEncoderOptions } from './VideoEncoder';
+export { VideoDecoder, VideoDecoderOptions } from './VideoDecoder';
 export { VideoTransform } from './VideoTransform';
 export { AudioDecoder } from './AudioDecoder';
 export { AudioEncoder } from './AudioEncoder';
 export { AudioTransform } from './AudioTransform';
 export { Filter } from './Filter';
 export { Discarder } from './Discarder';
+export { PrefetchOptions } from './Prefetch';
+export { AbortOptions } from './Abort';
+export { StageStats } from './Stats';
+export { EncoderPool, EncoderPoolOptions, EncoderOptions } from './EncoderPool';
+export { AudioMeter, AudioMeterReading } from './AudioMeter';
+export { SegmentedTranscoder, SegmentedTranscoderOptions } from './SegmentedTranscoder';
+export { SegmentCache, SegmentCacheOptions } from './SegmentCache';
+export { LatencyTracer, LatencyTracerOptions, LatencyStageReport } from './LatencyTracer';
@@ -1,11 +1,29 @@
 import ffmpeg from '@mmomtchev/ffmpeg';
-import { VideoStreamDefinition, MediaTransform, EncodedMediaWritable, MediaDecoder, VideoReadable } from './MediaStream';
+import { VideoStreamDefinition, MediaTransform, EncodedMediaWritable, MediaDecoder, VideoReadable, ExecutorOptions } from './MediaStream';
 import { TransformCallback } from 'stream';
+import { once } from 'node:events';
+import { prefetch, PrefetchOptions } from './Prefetch';
+import { StageStats } from './Stats';
+import { LatencyTracer } from './LatencyTracer';
 
 const { VideoDecoderContext, Codec } = ffmpeg;
 
 export const verbose = (process.env.DEBUG_VIDEO_DECODER || process.env.DEBUG_ALL) ? console.debug.bind(console) : () => undefined;
 
+export interface VideoDecoderOptions extends ExecutorOptions {
+  stream: ffmpeg.Stream;
+  /**
+   * Output every frame as soon as it is decoded: sets `low_delay`,
+   * allows non spec-compliant speedups and disables the frame threading
+   * which delays the output by one frame per thread
+   */
+  lowLatency?: boolean;
+  /**
+   * Stamp the frames leaving the decoder
+   */
+  tracer?: LatencyTracer;
+}
+
 /**
  * A VideoDecoder is Transform stream that can read raw encoded video data
  * from a Demuxer and write decoded video frames.
@@ -15,9 +33,15 @@ export class VideoDecoder extends MediaTransform implements MediaDecoder, Encode
   protected decoder: ffmpeg.VideoDecoderContext;
   protected busy: boolean;
   protected stream: ffmpeg.Stream;
+  protected executor: ffmpeg.MediaExecutor | undefined;
+  protected pipeline: number;
+  protected lowLatency: boolean;
+  protected tracer: LatencyTracer | undefined;
   ready: boolean;
+  // Per-stage counters
+  readonly stats = new StageStats;
 
-  constructor(options: { stream: ffmpeg.Stream; }) {
+  constructor(options: VideoDecoderOptions) {
     super();
     if (!options.stream) {
       throw new Error('Input is not a demuxed stream');
@@ -28,6 +52,10 @@ export class VideoDecoder extends MediaTransform implements MediaDecoder, Encode
     this.stream = options.stream;
     this.decoder = new VideoDecoderContext(this.stream);
     this.decoder.setRefCountedFrames(true);
+    this.executor = options.executor;
+    this.pipeline = options.pipeline ?? 0;
+    this.lowLatency = options.lowLatency ?? false;
+    this.tracer = options.tracer;
     this.busy = false;
     this.ready = false;
   }
@@ -36,7 +64,10 @@ export class VideoDecoder extends MediaTransform implements MediaDecoder, Encode
     (async () => {
       this.busy = true;
       verbose('VideoDecoder: priming the decoder');
-      await this.decoder!.openCodecAsync(new Codec);
+      if (this.lowLatency)
+        await this.decoder!.openCodecOptionsAsync({ flags: '+low_delay', flags2: '+fast', thread_type: 'slice' }, new Codec);
+      else
+        await this.decoder!.openCodecAsync(new Codec);
       verbose('VideoDecoder: decoder primed');
       this.busy = false;
       callback();
@@ -46,24 +77,102 @@ export class VideoDecoder extends MediaTransform implements MediaDecoder, Encode
       .catch(callback);
   }
 
-  _transform(packet: ffmpeg.Packet, encoding: BufferEncoding, callback: TransformCallback): void {
+  /**
+   * Decode a single packet
+   */
+  protected async decode(packet: ffmpeg.Packet): Promise<ffmpeg.VideoFrame | null> {
+    // Do not produce more frames while over the memory budget (ffmpeg.setMemoryBudget)
+    const memory = ffmpeg.waitForMemory();
+    if (memory) {
+      verbose('VideoDecoder: waiting for memory');
+      await memory;
+    }
+    const frame = await this.stats.measure(this.executor ?
+      this.executor.decodeVideo(this.pipeline, this.decoder, packet) :
+      this.decoder!.decodeAsync(packet, true));
+    const info = frame.info();
+    if (info.isComplete) {
+      frame.track();
+      this.stats.frames++;
+      this.tracer?.stamp('decoder', info.seconds);
+      verbose(`VideoDecoder: Decoded frame: pts=${info.pts} / ${info.seconds} / ${info.timeBase.join('/')} / ${info.width}x${info.height}, size=${info.size} / type: ${info.pictureType} }`);
+      return frame;
+    }
+    verbose('VideoDecoder: empty frame');
+    return null;
+  }
+
+  /**
+   * Decode a packet and yield the resulting frames, `null` marks the end
+   * of the input and flushes the frames still held by the decoder.
+   * This is the primitive shared by the Transform stream and the async iterator.
+   */
+  protected async *decodePacket(packet: ffmpeg.Packet | null): AsyncGenerator<ffmpeg.VideoFrame, void, undefined> {
+    if (packet) {
+      const frame = await this.decode(packet);
+      if (frame) yield frame;
+      return;
+    }
+    verbose('VideoDecoder: flushing the decoder');
+    // An empty packet flushes the decoder, it returns one frame per call
+    for (;;) {
+      const frame = await this.decode(new ffmpeg.Packet);
+      if (!frame) return;
+      yield frame;
+    }
+  }
+
+  protected async *decodeAll(source: AsyncIterable<ffmpeg.Packet>): AsyncGenerator<ffmpeg.VideoFrame, void, undefined> {
+    for await (const packet of source)
+      yield* this.decodePacket(packet);
+    yield* this.decodePacket(null);
+  }
+
+  protected decodeChunk(packet: ffmpeg.Packet | null, callback: TransformCallback): void {
     if (this.busy) return void callback(new Error('Decoder called while busy'));
-    verbose('VideoDecoder: decoding chunk');
     (async () => {
       this.busy = true;
-      const frame = await this.decoder!.decodeAsync(packet, true);
-      if (frame.isComplete()) {
-        verbose(`VideoDecoder: Decoded frame: pts=${frame.pts()} / ${frame.pts().seconds()} / ${frame.timeBase()} / ${frame.width()}x${frame.height()}, size=${frame.size()}, ref=${frame.isReferenced()}:${frame.refCount()} / type: ${frame.pictureType()} }`);
+      for await (const frame of this.decodePacket(packet))
         this.push(frame);
-      } else {
-        verbose('VideoDecoder: empty frame');
-      }
       this.busy = false;
       callback();
     })()
       .catch(callback);
   }
 
+  _transform(packet: ffmpeg.Packet, encoding: BufferEncoding, callback: TransformCallback): void {
+    verbose('VideoDecoder: decoding chunk');
+    this.decodeChunk(packet, callback);
+  }
+
+  _flush(callback: TransformCallback): void {
+    this.decodeChunk(null, callback);
+  }
+
+  /**
+   * Pull-based alternative to piping, decodes the packets
+   * coming from `source` and yields the decoded frames.
+   * Cannot be used at the same time as the stream interface.
+   *
+   * @example
+   * for await (const frame of decoder.frames(demuxer.packets({ streams: [0] })))
+   *   process(frame);
+   */
+  async *frames(source: AsyncIterable<ffmpeg.Packet>, options?: PrefetchOptions): AsyncGenerator<ffmpeg.VideoFrame, void, undefined> {
+    if (!this.ready) await once(this, 'ready');
+    const decoded = this.decodeAll(source);
+    this.busy = true;
+    try {
+      yield* prefetch(async () => {
+        const r = await decoded.next();
+        return r.done ? null : r.value;
+      }, options?.prefetch);
+    } finally {
+      this.busy = false;
+      await decoded.return();
+    }
+  }
+
   codec() {
     return this.decoder.codec()!;
   }
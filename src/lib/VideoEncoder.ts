@@ -1,11 +1,38 @@
 import ffmpeg from '@mmomtchev/ffmpeg';
 import { VideoStreamDefinition, MediaTransform, MediaEncoder, EncodedVideoReadable, VideoWritable } from './MediaStream';
 import { TransformCallback } from 'stream';
+import { StageStats } from './Stats';
+import { EncoderOptions, EncoderPool, createEncoderContext, findEncoderCodec } from './EncoderPool';
+import { LatencyTracer } from './LatencyTracer';
 
-const { VideoEncoderContext, VideoFrame } = ffmpeg;
+const { VideoFrame } = ffmpeg;
 
 export const verbose = (process.env.DEBUG_VIDEO_ENCODER || process.env.DEBUG_ALL) ? console.debug.bind(console) : () => undefined;
 
+export interface VideoEncoderOptions extends EncoderOptions {
+  /**
+   * Output every packet as soon as its frame has been received: disables
+   * the B-frames and the lookahead of the codecs that have one.
+   * The codec options in the definition take precedence.
+   */
+  lowLatency?: boolean;
+  /**
+   * Stamp the packets leaving the encoder
+   */
+  tracer?: LatencyTracer;
+}
+
+// The codec options that disable the frame reordering and the lookahead
+function lowLatencyOptions(codec: string): Record<string, string> {
+  if (codec.startsWith('libx264') || codec.startsWith('libx265'))
+    return { bf: '0', tune: 'zerolatency' };
+  if (codec.startsWith('libvpx'))
+    return { bf: '0', deadline: 'realtime', 'lag-in-frames': '0' };
+  if (codec.startsWith('libaom'))
+    return { bf: '0', usage: 'realtime', 'lag-in-frames': '0' };
+  return { bf: '0' };
+}
+
 /**
  * A VideoEncoder is Transform stream that can read raw video frames
  * and write encoded video data to a Muxer.
@@ -16,31 +43,37 @@ export class VideoEncoder extends MediaTransform implements MediaEncoder, Encode
   protected encoder: ffmpeg.VideoEncoderContext;
   protected codec_: ffmpeg.Codec;
   protected busy: boolean;
+  // The time base is fixed once the codec has been opened
+  protected timeBase: ffmpeg.Rational | undefined;
+  protected executor: ffmpeg.MediaExecutor | undefined;
+  protected pipeline: number;
+  protected pool: EncoderPool | undefined;
+  // Set when the encoder context comes from the pool
+  protected opened: boolean;
+  // The callback of a _writev() whose packets have filled the readable side
+  protected pending: ((error?: Error | null) => void) | undefined;
+  protected tracer: LatencyTracer | undefined;
   stream_: ffmpeg.Stream;
   type = 'Video' as const;
   ready: boolean;
+  // Per-stage counters
+  readonly stats = new StageStats;
 
-  constructor(def: VideoStreamDefinition) {
+  constructor(def: VideoStreamDefinition, options?: VideoEncoderOptions) {
     super();
     this.def = { ...def };
-    if (this.def.codec instanceof ffmpeg.Codec) {
-      this.codec_ = ffmpeg.findDecodingCodec(this.def.codec.id());
-    } else {
-      this.codec_ = ffmpeg.findEncodingCodec(this.def.codec);
-    }
+    this.executor = options?.executor;
+    this.pipeline = options?.pipeline ?? 0;
+    this.pool = options?.pool;
+    this.tracer = options?.tracer;
+    this.codec_ = findEncoderCodec(this.def);
     verbose(`VideoEncoder: using ${this.codec_.name()}, ${this.def.width}x${this.def.height}, ` +
       `bitrate ${this.def.bitRate}, format ${this.def.pixelFormat}`);
-    this.encoder = new VideoEncoderContext(this.codec_);
-    this.encoder.setWidth(this.def.width);
-    this.encoder.setHeight(this.def.height);
-    if (this.def.timeBase)
-      this.encoder.setTimeBase(this.def.timeBase);
-    else
-      this.encoder.setTimeBase(new ffmpeg.Rational(1, 1000));
-    this.encoder.setBitRate(this.def.bitRate);
-    this.encoder.setPixelFormat(this.def.pixelFormat);
-    if (def.flags)
-      this.encoder.addFlags(def.flags);
+    if (options?.lowLatency)
+      this.def.codecOptions = { ...lowLatencyOptions(this.codec_.name()), ...this.def.codecOptions };
+    const pooled = this.pool?.take(this.def);
+    this.opened = !!pooled;
+    this.encoder = pooled ?? createEncoderContext(this.def, this.codec_);
     this.busy = false;
     this.ready = false;
     this.stream_ = this.encoder.stream();
@@ -49,8 +82,11 @@ export class VideoEncoder extends MediaTransform implements MediaEncoder, Encode
   _construct(callback: (error?: Error | null | undefined) => void): void {
     (async () => {
       this.busy = true;
-      verbose('VideoEncoder: priming the encoder', this.def.codecOptions);
-      await this.encoder.openCodecOptionsAsync(this.def.codecOptions ?? {}, this.codec_);
+      verbose(`VideoEncoder: priming the encoder, ${this.opened ? 'reusing a pooled encoder' : 'opening'}`,
+        this.def.codecOptions);
+      if (!this.opened)
+        await this.encoder.openCodecOptionsAsync(this.def.codecOptions ?? {}, this.codec_);
+      this.timeBase = await this.encoder.timeBaseAsync();
       verbose(`VideoEncoder: encoder primed, codec ${this.codec_.name()}, ` +
         `bitRate: ${this.encoder.bitRate()}, pixelFormat: ${this.encoder.pixelFormat()}, ` +
         `timeBase: ${this.encoder.timeBase()}, ${this.encoder.width()}x${this.encoder.height()}`
@@ -63,7 +99,7 @@ export class VideoEncoder extends MediaTransform implements MediaEncoder, Encode
       .catch(callback);
   }
 
-  _transform(frame: ffmpeg.Packet, encoding: BufferEncoding, callback: TransformCallback): void {
+  _transform(frame: ffmpeg.VideoFrame, encoding: BufferEncoding, callback: TransformCallback): void {
     verbose('VideoEncoder: received frame');
     if (this.busy) return void callback(new Error('VideoEncoder called while busy, use proper writing semantics'));
     (async () => {
@@ -74,15 +110,19 @@ export class VideoEncoder extends MediaTransform implements MediaEncoder, Encode
       if (!(frame instanceof VideoFrame)) {
         return void callback(new Error('Input is not a raw video'));
       }
-      if (!frame.isValid()) {
+      const info = frame.info();
+      if (!info.isValid) {
         return void callback(new Error('Received invalid frame'));
       }
       frame.setPictureType(ffmpeg.AV_PICTURE_TYPE_NONE);
-      frame.setTimeBase(await this.encoder.timeBaseAsync());
-      const packet = await this.encoder.encodeAsync(frame);
-      verbose(`VideoEncoder: encoded frame: pts=${frame.pts()} / ${frame.pts().seconds()} / ` +
-        `${frame.timeBase()} / ${frame.width()}x${frame.height()}, size=${frame.size()}, ` +
-        `ref=${frame.isReferenced()}:${frame.refCount()} / type: ${frame.pictureType()} }`);
+      frame.setTimeBase(this.timeBase!);
+      const packet = await this.stats.measure(this.executor ?
+        this.executor.encodeVideo(this.pipeline, this.encoder, frame) :
+        this.encoder.encodeAsync(frame));
+      this.stats.frames++;
+      verbose(`VideoEncoder: encoded frame: pts=${info.pts} / ${info.seconds} / ` +
+        `${info.timeBase.join('/')} / ${info.width}x${info.height}, size=${info.size} / type: ${info.pictureType} }`);
+      this.tracer?.stamp('encoder', packet.info().seconds);
       this.push(packet);
       this.busy = false;
       callback();
@@ -90,19 +130,79 @@ export class VideoEncoder extends MediaTransform implements MediaEncoder, Encode
       .catch(callback);
   }
 
+  /**
+   * Called by Writable with all the frames that have been buffered while the
+   * previous operation was running, they are encoded in a single native call
+   */
+  _writev(chunks: { chunk: ffmpeg.VideoFrame, encoding: BufferEncoding; }[], callback: (error?: Error | null) => void): void {
+    verbose(`VideoEncoder: received ${chunks.length} frames`);
+    if (this.busy) return void callback(new Error('VideoEncoder called while busy, use proper writing semantics'));
+    (async () => {
+      this.busy = true;
+      if (!this.encoder) {
+        return void callback(new Error('VideoEncoder is not primed'));
+      }
+      const frames = chunks.map((c) => c.chunk);
+      for (const frame of frames) {
+        if (!(frame instanceof VideoFrame)) {
+          return void callback(new Error('Input is not a raw video'));
+        }
+        if (!frame.info().isValid) {
+          return void callback(new Error('Received invalid frame'));
+        }
+        frame.setPictureType(ffmpeg.AV_PICTURE_TYPE_NONE);
+        frame.setTimeBase(this.timeBase!);
+      }
+      const packets = await this.stats.measure(this.executor ?
+        this.executor.encodeVideoBatch(this.pipeline, this.encoder, frames) :
+        this.encoder.encodeBatchAsync(frames));
+      this.stats.frames += frames.length;
+      verbose(`VideoEncoder: encoded ${frames.length} frames into ${packets.length} packets`);
+      let more = true;
+      for (const packet of packets) {
+        this.tracer?.stamp('encoder', packet.info().seconds);
+        more = this.push(packet) && more;
+      }
+      this.busy = false;
+      this.afterBatch(more, callback);
+    })()
+      .catch(callback);
+  }
+
+  /**
+   * Transform defers the callback of _transform() while the readable side
+   * is full, the same is done here for the batches of _writev()
+   */
+  protected afterBatch(more: boolean, callback: (error?: Error | null) => void): void {
+    if (more) {
+      callback();
+    } else {
+      verbose('VideoEncoder: the readable side is full, waiting for the consumer');
+      this.pending = callback;
+    }
+  }
+
+  _read(size: number): void {
+    const pending = this.pending;
+    this.pending = undefined;
+    pending?.();
+    super._read(size);
+  }
+
   _flush(callback: TransformCallback): void {
     verbose('VideoEncoder: flushing');
     if (this.busy) return void callback(new Error('VideoEncoder called while busy, use proper writing semantics'));
-    let packet: ffmpeg.Packet;
-    let packetIsComplete: boolean;
     (async () => {
-      do {
-        packet = await this.encoder.finalizeAsync();
-        verbose(`Flushing packet, size=${packet.size()}, dts=${packet.dts().toString()}`);
-        // don't touch packet after pushing for async handling
-        packetIsComplete = packet != null && packet.isComplete();
+      // Drain the encoder in a single call
+      const packets = await this.stats.measure(this.executor ?
+        this.executor.finalizeVideoBatch(this.pipeline, this.encoder) :
+        this.encoder.finalizeBatchAsync());
+      verbose(`VideoEncoder: flushing ${packets.length} packets`);
+      // don't touch the packets after pushing for async handling
+      for (const packet of packets)
         this.push(packet);
-      } while (packetIsComplete);
+      if (this.pool)
+        this.pool.release(this.def, this.encoder);
       verbose('VideoEncoder flushed');
       callback();
     })()
@@ -1,11 +1,17 @@
 import { TransformCallback } from 'node:stream';
 import ffmpeg from '@mmomtchev/ffmpeg';
-import { MediaTransform, MediaTransformOptions, VideoReadable, VideoStreamDefinition, VideoWritable } from './MediaStream';
+import { ExecutorOptions, MediaTransform, MediaTransformOptions, VideoReadable, VideoStreamDefinition, VideoWritable } from './MediaStream';
+import { StageStats } from './Stats';
 
-export interface VideoTransformOptions extends MediaTransformOptions {
+export interface VideoTransformOptions extends MediaTransformOptions, ExecutorOptions {
   input: VideoStreamDefinition;
   output: VideoStreamDefinition;
   interpolation: number;
+  /**
+   * Rescale into frames from a VideoFramePool that are recycled once they
+   * are no longer referenced instead of allocating a new frame every time, @default true
+   */
+  pool?: boolean;
 }
 
 /**
@@ -14,20 +20,42 @@ export interface VideoTransformOptions extends MediaTransformOptions {
  */
 export class VideoTransform extends MediaTransform implements VideoWritable, VideoReadable {
   protected rescaler: ffmpeg.VideoRescaler;
+  protected pool: ffmpeg.VideoFramePool | undefined;
+  protected executor: ffmpeg.MediaExecutor | undefined;
+  protected pipeline: number;
+  // Per-stage counters
+  readonly stats = new StageStats;
 
   constructor(options: VideoTransformOptions) {
     super(options);
+    this.executor = options.executor;
+    this.pipeline = options.pipeline ?? 0;
     this.rescaler = new ffmpeg.VideoRescaler(
       options.output.width, options.output.height, options.output.pixelFormat,
       options.input.width, options.input.height, options.input.pixelFormat,
       options.interpolation
     );
+    if (options.pool ?? true)
+      this.pool = new ffmpeg.VideoFramePool(options.output.width, options.output.height, options.output.pixelFormat);
   }
 
   _transform(chunk: ffmpeg.VideoFrame, encoding: BufferEncoding, callback: TransformCallback): void {
     try {
-      this.rescaler.rescaleAsync(chunk)
+      let op: Promise<ffmpeg.VideoFrame>;
+      if (this.pool) {
+        const dst = this.pool.get();
+        op = (this.executor ?
+          this.executor.rescaleInto(this.pipeline, this.rescaler, dst, chunk) :
+          this.rescaler.rescaleIntoAsync(dst, chunk))
+          .then(() => dst);
+      } else {
+        op = this.executor ?
+          this.executor.rescale(this.pipeline, this.rescaler, chunk) :
+          this.rescaler.rescaleAsync(chunk);
+      }
+      this.stats.measure(op)
         .then((frame: ffmpeg.VideoFrame) => {
+          this.stats.frames++;
           this.push(frame);
           callback();
         }).catch(callback);
@@ -17,5 +17,63 @@ describe('audio', () => {
       assert.strictEqual(samples.sampleFormat().name(), 'fltp');
       assert.strictEqual(samples.channelsCount(), 2);
     });
+
+    it('should export all of its properties in a single call', () => {
+      const format = new SampleFormat('fltp');
+      const buffer = Buffer.alloc(2 * 48000 * format.bitsPerSample() / 8);
+
+      const samples = AudioSamples.create(buffer, format, 48000, ffmpeg.AV_CH_LAYOUT_STEREO, 48000);
+      const info = samples.info();
+      assert.isFalse(info.isNull);
+      assert.strictEqual(info.samplesCount, 48000);
+      assert.strictEqual(info.sampleRate, 48000);
+      assert.strictEqual(info.sampleFormat, ffmpeg.AV_SAMPLE_FMT_FLTP);
+      assert.strictEqual(info.channelsCount, 2);
+      assert.strictEqual(info.size, samples.size());
+    });
+
+    it('should support native metering', async () => {
+      // 1 second of a 1kHz sine at -6dBFS on the left channel, silence on the right channel
+      const format = new SampleFormat('s16');
+      const data = new Int16Array(2 * 48000);
+      for (let i = 0; i < 48000; i++)
+        data[2 * i] = Math.round(Math.sin(2 * Math.PI * 1000 * i / 48000) * 16384);
+      const samples = AudioSamples.create(Buffer.from(data.buffer), format, 48000, ffmpeg.AV_CH_LAYOUT_STEREO, 48000);
+
+      const levels = await samples.levelsAsync();
+      assert.instanceOf(levels, Float64Array);
+      assert.lengthOf(levels, 4);
+      assert.closeTo(levels[0], 0.5, 1e-3);
+      assert.closeTo(levels[1], 0.5 / Math.SQRT2, 1e-3);
+      assert.deepEqual([...levels.subarray(2)], [0, 0]);
+
+      const meter = new ffmpeg.LoudnessMeter(48000, 2);
+      await meter.addAsync(samples);
+      const loudness = meter.result();
+      // A 0dBFS 1kHz sine on one channel is -3.01 LUFS
+      assert.closeTo(loudness[0], -9.03, 0.3);
+      assert.strictEqual(loudness[1], -Infinity);
+      assert.closeTo(loudness[2], -9.03, 0.3);
+      assert.closeTo(loudness[3], 0.5, 1e-3);
+      meter.reset();
+      assert.strictEqual(meter.result()[0], -Infinity);
+    });
+
+    it('should weight the channels by their layout in the loudness meter', async () => {
+      // A sine on the fourth channel, the LFE of 5.1 and the back center of 6.0
+      const format = new SampleFormat('s16');
+      const data = new Int16Array(6 * 48000);
+      for (let i = 0; i < 48000; i++)
+        data[6 * i + 3] = Math.round(Math.sin(2 * Math.PI * 1000 * i / 48000) * 16384);
+
+      const loudness = async (layout) => {
+        const samples = AudioSamples.create(Buffer.from(data.buffer), format, 48000, layout, 48000);
+        const meter = new ffmpeg.LoudnessMeter(48000, 6);
+        await meter.addAsync(samples);
+        return meter.result()[0];
+      };
+      assert.strictEqual(await loudness(ffmpeg.AV_CH_LAYOUT_5POINT1), -Infinity);
+      assert.closeTo(await loudness(ffmpeg.AV_CH_LAYOUT_6POINT0), -9.03, 0.3);
+    });
   });
 });
@@ -4,8 +4,9 @@ import * as fs from 'node:fs';
 import { assert } from 'chai';
 
 import ffmpeg from '@mmomtchev/ffmpeg';
-import { Demuxer, AudioDecoder, VideoDecoder } from '@mmomtchev/ffmpeg/stream';
+import { Demuxer, AudioDecoder, VideoDecoder, Discarder } from '@mmomtchev/ffmpeg/stream';
 import { Writable } from 'node:stream';
+import { once } from 'node:events';
 
 describe('Demuxer', () => {
   it('built-in I/O', (done) => {
@@ -99,4 +100,472 @@ describe('Demuxer', () => {
     });
   });
 
+  it('from a file descriptor', async () => {
+    const fd = fs.openSync(path.resolve(__dirname, 'data', 'launch.mp4'), 'r');
+    try {
+      const input = new Demuxer({ inputFd: fd });
+      await once(input, 'ready');
+      assert.lengthOf(input.video, 1);
+      assert.lengthOf(input.audio, 1);
+
+      let packets = 0;
+      for await (const packet of input.packets()) {
+        assert.instanceOf(packet, ffmpeg.Packet);
+        packets++;
+      }
+      assert.isAtLeast(packets, 200);
+    } finally {
+      fs.closeSync(fd);
+    }
+  });
+
+  it('fast open with known parameters', async () => {
+    const first = new Demuxer({ inputFile: path.resolve(__dirname, 'data', 'launch.mp4') });
+    await once(first, 'ready');
+    const parameters = JSON.parse(JSON.stringify(first.parameters()));
+    assert.lengthOf(parameters, 2);
+
+    const input = new Demuxer({
+      inputFile: path.resolve(__dirname, 'data', 'launch.mp4'),
+      probeSize: 32 * 1024,
+      analyzeDuration: 0,
+      knownParameters: parameters
+    });
+    await once(input, 'ready');
+    assert.isTrue(first.probed);
+    assert.isFalse(input.probed);
+    assert.lengthOf(input.video, 1);
+    assert.lengthOf(input.audio, 1);
+    assert.deepEqual(input.parameters().map((p) => p.codecId), parameters.map((p: ffmpeg.StreamParameters) => p.codecId));
+
+    const videoStream = new VideoDecoder(input.video[0]);
+    let videoFrames = 0;
+    for await (const frame of videoStream.frames(input.packets({ streams: [input.streams.indexOf(input.video[0])] }))) {
+      assert.instanceOf(frame, ffmpeg.VideoFrame);
+      videoFrames++;
+    }
+    assert.isAtLeast(videoFrames, 100);
+  });
+
+  it('packet info', async () => {
+    const formatContext = new ffmpeg.FormatContext;
+    await formatContext.openInputAsync(path.resolve(__dirname, 'data', 'launch.mp4'));
+    await formatContext.findStreamInfoAsync();
+
+    const packet = await formatContext.readPacketAsync();
+    const info = packet.info();
+    assert.isFalse(info.isNull);
+    assert.isTrue(info.isComplete);
+    assert.strictEqual(info.size, packet.size());
+    assert.strictEqual(info.streamIndex, packet.streamIndex());
+    assert.closeTo(info.seconds!, packet.pts().seconds(), 1e-9);
+    assert.isArray(info.timeBase);
+    await formatContext.closeAsync();
+  });
+
+  it('async iterators', async () => {
+    const input = new Demuxer({ inputFile: path.resolve(__dirname, 'data', 'launch.mp4') });
+    await once(input, 'ready');
+    const videoIdx = input.streams.indexOf(input.video[0]);
+    const videoStream = new VideoDecoder(input.video[0]);
+
+    let videoFrames = 0;
+    for await (const frame of videoStream.frames(input.packets({ streams: [videoIdx], prefetch: 8 }))) {
+      assert.instanceOf(frame, ffmpeg.VideoFrame);
+      videoFrames++;
+    }
+    assert.isAtLeast(videoFrames, 100);
+    assert.strictEqual(videoStream.stats.frames, videoFrames);
+    assert.isAtLeast(input.stats.frames, videoFrames);
+    assert.isAbove(input.stats.asyncTime, 0);
+  });
+
+  it('async iterators flush the decoder', async () => {
+    // Every video packet of launch.mp4 is a frame, the last ones
+    // are held by the decoder until it is flushed
+    const formatContext = new ffmpeg.FormatContext;
+    await formatContext.openInputAsync(path.resolve(__dirname, 'data', 'launch.mp4'));
+    await formatContext.findStreamInfoAsync();
+    const videoIdx = formatContext.stream(0).isVideo() ? 0 : 1;
+    let videoPackets = 0;
+    for (let packet = await formatContext.readPacketAsync(); !packet.isNull(); packet = await formatContext.readPacketAsync())
+      if (packet.streamIndex() === videoIdx) videoPackets++;
+    await formatContext.closeAsync();
+
+    const input = new Demuxer({ inputFile: path.resolve(__dirname, 'data', 'launch.mp4') });
+    await once(input, 'ready');
+    const videoStream = new VideoDecoder(input.video[0]);
+    let videoFrames = 0;
+    for await (const frame of videoStream.frames(input.packets({ streams: [input.streams.indexOf(input.video[0])] }))) {
+      assert.instanceOf(frame, ffmpeg.VideoFrame);
+      videoFrames++;
+    }
+    assert.strictEqual(videoFrames, videoPackets);
+
+    // The same through the streams
+    const input2 = new Demuxer({ inputFile: path.resolve(__dirname, 'data', 'launch.mp4') });
+    await once(input2, 'ready');
+    const videoStream2 = new VideoDecoder(input2.video[0]);
+    const discard = new Discarder;
+    let streamFrames = 0;
+    videoStream2.on('data', () => streamFrames++);
+    input2.video[0].pipe(videoStream2);
+    input2.audio[0].pipe(discard);
+    await once(videoStream2, 'end');
+    assert.strictEqual(streamFrames, videoPackets);
+  });
+
+  it('native stats', async () => {
+    const inStream = fs.createReadStream(path.resolve(__dirname, 'data', 'launch.mp4'));
+    const input = new Demuxer();
+    inStream.pipe(input.input!);
+    await once(input, 'ready');
+
+    const before = ffmpeg.stats();
+    assert.instanceOf(before, Float64Array);
+    assert.lengthOf(before, ffmpeg.statsFields.length);
+    for await (const packet of input.packets()) {
+      assert.instanceOf(packet, ffmpeg.Packet);
+    }
+    const after = ffmpeg.stats();
+    const writableBytesCopied = ffmpeg.statsFields.indexOf('writableBytesCopied');
+    assert.isAbove(after[writableBytesCopied], before[writableBytesCopied]);
+
+    const ioStats = (input.input as ffmpeg.WritableCustomIO).stats();
+    assert.isAbove(ioStats[0], 0);
+    assert.isAbove(ioStats[1], 0);
+  });
+
+  it('w/ MediaExecutor', async () => {
+    const executor = new ffmpeg.MediaExecutor({ threads: 2 });
+    const input = new Demuxer({ inputFile: path.resolve(__dirname, 'data', 'launch.mp4') });
+    await once(input, 'ready');
+
+    const videoStream = new VideoDecoder({ stream: input.video[0].stream, executor, pipeline: 1 });
+    const audioStream = new AudioDecoder({ stream: input.audio[0].stream, executor, pipeline: 2 });
+    let videoFrames = 0, audioFrames = 0;
+    videoStream.on('data', (data) => {
+      assert.instanceOf(data, ffmpeg.VideoFrame);
+      videoFrames++;
+    });
+    audioStream.on('data', (data) => {
+      assert.instanceOf(data, ffmpeg.AudioSamples);
+      audioFrames++;
+    });
+    input.video[0].pipe(videoStream);
+    input.audio[0].pipe(audioStream);
+    await Promise.all([once(videoStream, 'end'), once(audioStream, 'end')]);
+
+    assert.isAtLeast(videoFrames, 100);
+    assert.isAtLeast(audioFrames, 100);
+    const stats = executor.stats();
+    assert.strictEqual(stats.threads, 2);
+    // Idle pipelines are removed
+    assert.strictEqual(stats.pipelines, 0);
+    assert.isAtLeast(stats.executed, videoFrames + audioFrames);
+    assert.strictEqual(stats.queued, 0);
+    await executor.close();
+    assert.strictEqual(executor.stats().threads, 0);
+    // Closing twice is allowed
+    await executor.close();
+  });
+
+  it('memory accounting', async () => {
+    const formatContext = new ffmpeg.FormatContext;
+    await formatContext.openInputAsync(path.resolve(__dirname, 'data', 'launch.mp4'));
+    await formatContext.findStreamInfoAsync();
+
+    const packet = await formatContext.readPacketAsync();
+    packet.track();
+    assert.isAtLeast(ffmpeg.memoryUsage(), packet.size());
+    assert.isNull(ffmpeg.waitForMemory());
+
+    ffmpeg.setMemoryBudget(1);
+    const wait = ffmpeg.waitForMemory();
+    assert.instanceOf(wait, Promise);
+    ffmpeg.setMemoryBudget(0);
+    await wait;
+    await formatContext.closeAsync();
+  });
+
+  it('backpressure under memory pressure', async () => {
+    global.gc!();
+    const input = new Demuxer({ inputFile: path.resolve(__dirname, 'data', 'launch.mp4') });
+    await once(input, 'ready');
+    const decoder = new VideoDecoder(input.video[0]);
+    const def = decoder.definition();
+    // YUV420P
+    const frameSize = def.width * def.height * 3 / 2;
+    const budget = ffmpeg.memoryUsage() + 8 * frameSize;
+    ffmpeg.setMemoryBudget(budget);
+
+    // A slow consumer that holds on to the frames and releases them in batches
+    let held: ffmpeg.VideoFrame[] = [];
+    let frames = 0;
+    let peak = 0;
+    const sink = new Writable({
+      objectMode: true,
+      highWaterMark: 1000,
+      write(frame: ffmpeg.VideoFrame, encoding, callback) {
+        held.push(frame);
+        frames++;
+        peak = Math.max(peak, ffmpeg.memoryUsage());
+        if (held.length < 4) return void callback();
+        held = [];
+        setTimeout(() => {
+          global.gc!();
+          callback();
+        }, 5);
+      }
+    });
+    try {
+      input.video[0].pipe(decoder).pipe(sink);
+      input.audio[0].pipe(new Discarder);
+      await once(sink, 'finish');
+    } finally {
+      ffmpeg.setMemoryBudget(0);
+    }
+    assert.isAtLeast(frames, 100);
+    // The decoder and the Demuxer check the budget before producing
+    // a frame or a packet, they can go over it by one
+    assert.isBelow(peak, budget + 2 * frameSize);
+  });
+
+  it('synchronous CustomIO with backpressure', async () => {
+    const data = fs.readFileSync(path.resolve(__dirname, 'data', 'launch.mp4'));
+    const highWaterMark = 256 * 1024;
+    const chunk = 4096;
+    const input = new ffmpeg.WritableCustomIO({ sync: true, highWaterMark });
+
+    let offset = 0;
+    const fill = () => {
+      while (offset < data.length)
+        if (!input.write(data.subarray(offset, offset += chunk))) return;
+      input.end();
+    };
+    fill();
+    input.on('drain', fill);
+    // The Writable keeps the rest until ffmpeg has consumed the queue
+    assert.isBelow(offset, data.length);
+
+    const formatContext = new ffmpeg.FormatContext;
+    formatContext.openWritable(input, new ffmpeg.InputFormat, chunk);
+    let packets = 0;
+    let maxQueued = 0;
+    for (; ;) {
+      await new Promise((resolve) => setImmediate(resolve));
+      maxQueued = Math.max(maxQueued, input.stats()[3]);
+      const packet = formatContext.readPacket();
+      if (packet.isNull()) break;
+      packets++;
+    }
+    assert.isAtLeast(packets, 200);
+    assert.isAtMost(maxQueued, highWaterMark + chunk);
+    assert.strictEqual(offset, data.length);
+    formatContext.close();
+  });
+
+  it('synchronous CustomIO without a pull callback ends with the queue', async () => {
+    const input = new ffmpeg.WritableCustomIO({ sync: true });
+    const error = once(input, 'error');
+    input.enqueue(fs.readFileSync(path.resolve(__dirname, 'data', 'launch.mp4')).subarray(0, 64 * 1024));
+    const formatContext = new ffmpeg.FormatContext;
+    formatContext.openWritable(input, new ffmpeg.InputFormat, 4096);
+    // Running out of data without an EOF is an error and not a retryable EAGAIN
+    assert.throws(() => {
+      while (!formatContext.readPacket().isNull());
+    });
+    formatContext.close();
+    // The explanation is on the stream
+    const [err] = await error;
+    assert.match(err.message, /ran out of data/);
+  });
+
+  it('transfer and adopt packets', async () => {
+    const formatContext = new ffmpeg.FormatContext;
+    await formatContext.openInputAsync(path.resolve(__dirname, 'data', 'launch.mp4'));
+    await formatContext.findStreamInfoAsync();
+
+    const ids: number[] = [];
+    const payloads: Buffer[] = [];
+    for (let i = 0; i < 100; i++) {
+      const packet = await formatContext.readPacketAsync();
+      if (packet.isNull()) break;
+      payloads.push(Buffer.from(packet.data()));
+      ids.push(packet.transfer());
+    }
+    await formatContext.closeAsync();
+    global.gc!();
+
+    // The references outlive the packets and the context
+    for (let i = 0; i < ids.length; i++) {
+      if (i % 2) {
+        assert.isTrue(ffmpeg.releaseTransfer(ids[i]));
+        continue;
+      }
+      const adopted = ffmpeg.Packet.adopt(ids[i]);
+      assert.isTrue(adopted.data().equals(payloads[i]));
+      assert.throws(() => ffmpeg.Packet.adopt(ids[i]), /does not exist/);
+      assert.isFalse(ffmpeg.releaseTransfer(ids[i]));
+    }
+    global.gc!();
+  });
+
+  it('synchronous CustomIO', () => {
+    const fd = fs.openSync(path.resolve(__dirname, 'data', 'launch.mp4'), 'r');
+    try {
+      const input = new ffmpeg.WritableCustomIO({
+        pull: (size: number) => {
+          const buffer = Buffer.alloc(size);
+          const len = fs.readSync(fd, buffer);
+          return len > 0 ? buffer.subarray(0, len) : null;
+        }
+      });
+      const formatContext = new ffmpeg.FormatContext;
+      formatContext.openWritable(input, new ffmpeg.InputFormat, 64 * 1024);
+      formatContext.findStreamInfo();
+      assert.strictEqual(formatContext.streamsCount(), 2);
+
+      let packets = 0;
+      for (let packet = formatContext.readPacket(); !packet.isNull(); packet = formatContext.readPacket())
+        packets++;
+      assert.isAtLeast(packets, 200);
+      assert.isAbove(input.stats()[1], 0);
+      formatContext.close();
+    } finally {
+      fs.closeSync(fd);
+    }
+  });
+
+  it('packet payload and Packet.wrap()', async () => {
+    const formatContext = new ffmpeg.FormatContext;
+    await formatContext.openInputAsync(path.resolve(__dirname, 'data', 'launch.mp4'));
+    await formatContext.findStreamInfoAsync();
+    const videoIdx = formatContext.stream(0).isVideo() ? 0 : 1;
+    const decoder = new ffmpeg.VideoDecoderContext(formatContext.stream(videoIdx));
+    decoder.setRefCountedFrames(true);
+    await decoder.openCodecAsync(new ffmpeg.Codec);
+
+    const copied = () => ffmpeg.stats()[ffmpeg.statsFields.indexOf('packetBytesCopied')];
+    const before = copied();
+    let frames = 0;
+    for (let i = 0; i < 50; i++) {
+      const packet = await formatContext.readPacketAsync();
+      const info = packet.info();
+      if (info.isNull) break;
+      if (info.streamIndex !== videoIdx) continue;
+
+      const data = packet.data();
+      assert.instanceOf(data, Buffer);
+      assert.strictEqual(data.length, info.size);
+
+      // The padding allows using the Buffer without copying
+      const padded = Buffer.alloc(data.length + Number(ffmpeg.AV_INPUT_BUFFER_PADDING_SIZE));
+      data.copy(padded);
+      const wrapped = ffmpeg.Packet.wrap(padded.subarray(0, data.length),
+        info.pts, info.dts, info.flags, info.streamIndex, packet.timeBase());
+      const wrappedInfo = wrapped.info();
+      assert.strictEqual(wrappedInfo.size, info.size);
+      assert.strictEqual(wrappedInfo.pts, info.pts);
+      assert.strictEqual(wrappedInfo.dts, info.dts);
+      assert.strictEqual(wrappedInfo.isKeyPacket, info.isKeyPacket);
+      assert.isTrue(wrapped.data().equals(data));
+
+      const frame = await decoder.decodeAsync(wrapped, true);
+      if (frame.isComplete()) frames++;
+    }
+    assert.isAbove(frames, 0);
+    assert.strictEqual(copied(), before);
+
+    // Without padding the Buffer is copied
+    const unpadded = Buffer.from(new ArrayBuffer(4));
+    unpadded.set([0, 0, 0, 1]);
+    ffmpeg.Packet.wrap(unpadded, null, null, 0, 0);
+    assert.strictEqual(copied(), before + 4);
+
+    // A padded Buffer that does not own its ArrayBuffer is copied
+    const shared = Buffer.alloc(8 + Number(ffmpeg.AV_INPUT_BUFFER_PADDING_SIZE));
+    ffmpeg.Packet.wrap(shared.subarray(4, 8), null, null, 0, 0);
+    assert.strictEqual(copied(), before + 8);
+    await formatContext.closeAsync();
+  });
+
+  it('timeout on a stalled ReadStream', async () => {
+    const start = Date.now();
+    const input = new Demuxer({ timeout: 200 });
+    // Write only the beginning of the file, ffmpeg will block waiting for more data
+    const data = fs.readFileSync(path.resolve(__dirname, 'data', 'launch.mp4'));
+    input.input!.write(data.subarray(0, 1024));
+    input.input!.on('error', () => undefined);
+
+    const [err] = await once(input, 'error');
+    assert.instanceOf(err, Error);
+    assert.strictEqual(err.name, 'TimeoutError');
+    assert.isBelow(Date.now() - start, 2000);
+    assert.isTrue(input.input!.destroyed);
+  });
+
+  it('abort with an AbortSignal', async () => {
+    const controller = new AbortController;
+    const input = new Demuxer({ signal: controller.signal });
+    input.input!.on('error', () => undefined);
+    setTimeout(() => controller.abort(), 100);
+
+    const [err] = await once(input, 'error');
+    assert.strictEqual(err.name, 'AbortError');
+
+    // The worker thread has been released
+    const next = new Demuxer({ inputFile: path.resolve(__dirname, 'data', 'launch.mp4') });
+    await once(next, 'ready');
+    assert.lengthOf(next.video, 1);
+  });
+
+  it('abort fails the pending writes', async () => {
+    const input = new ffmpeg.WritableCustomIO();
+    input.write(Buffer.alloc(1024));
+    input.abort();
+
+    // The Writable is not destroyed, the failed write callback ends it
+    const [err] = await once(input, 'error');
+    assert.match(err.message, /aborted/);
+  });
+
+  it('per-stream buffering', async () => {
+    const limit = 32 * 1024;
+    // An AAC packet is never larger than this
+    const slack = 8 * 1024;
+    const input = new Demuxer({ inputFile: path.resolve(__dirname, 'data', 'launch.mp4'), streamBufferSize: limit });
+    await once(input, 'ready');
+    const audioIdx = input.streams.indexOf(input.audio[0]);
+
+    let videoPackets = 0;
+    const video = new Writable({
+      objectMode: true,
+      write: (chunk, encoding, callback) => {
+        assert.instanceOf(chunk, ffmpeg.Packet);
+        videoPackets++;
+        callback();
+      }
+    });
+    input.video[0].pipe(video);
+
+    // The audio is not consumed, the reading stops once its buffer is full
+    await new Promise((resolve) => setTimeout(resolve, 500));
+    const stalled = input.bufferStats();
+    assert.isAbove(stalled.stalls, 0);
+    assert.isAtLeast(stalled.queued[audioIdx], limit);
+    assert.isBelow(stalled.queued[audioIdx], limit + slack);
+    assert.isFalse(video.writableFinished);
+    const frozen = videoPackets;
+    await new Promise((resolve) => setTimeout(resolve, 100));
+    assert.strictEqual(videoPackets, frozen);
+
+    // Consuming the audio resumes the reading
+    input.audio[0].pipe(new Discarder);
+    await once(video, 'finish');
+    assert.isAbove(videoPackets, frozen);
+    const stats = input.bufferStats();
+    assert.strictEqual(stats.streamBufferSize, limit);
+    assert.isBelow(stats.peak[audioIdx], limit + slack);
+  });
 });
@@ -2,8 +2,11 @@ import * as path from 'node:path';
 import * as fs from 'node:fs';
 import { Magick } from 'magickwand.js/native';
 
+import { assert } from 'chai';
+
 import ffmpeg from '@mmomtchev/ffmpeg';
-import { VideoEncoder, Muxer } from '@mmomtchev/ffmpeg/stream';
+import { VideoEncoder, Muxer, EncoderPool } from '@mmomtchev/ffmpeg/stream';
+import { once } from 'node:events';
 
 const width = 320;
 const height = 200;
@@ -90,3 +93,152 @@ it('produce a video from stills', (done) => {
     done(error);
   }
 });
+
+// Encodes 3 clips with the same definition, returns the encoder contexts that were used
+async function encodePooledClips(codec: ffmpeg.AVCodecID, pool: EncoderPool): Promise<ffmpeg.VideoEncoderContext[]> {
+  const format = new ffmpeg.PixelFormat('yuv420p');
+  const timeBase = new ffmpeg.Rational(1, 25);
+  const def = {
+    type: 'Video' as const,
+    codec,
+    bitRate: 2.5e6,
+    width,
+    height,
+    frameRate: new ffmpeg.Rational(25, 1),
+    timeBase,
+    pixelFormat: format
+  };
+  await pool.warm(def, 1);
+
+  const contexts: ffmpeg.VideoEncoderContext[] = [];
+  for (let clip = 0; clip < 3; clip++) {
+    // Non-flushable encoders are replaced in the background
+    await pool.settled();
+    const videoOutput = new VideoEncoder(def, { pool });
+    contexts.push(videoOutput.context());
+    const state = { height: 720 / 2, speed: 0 };
+    let packets = 0;
+    videoOutput.on('data', (packet) => {
+      assert.instanceOf(packet, ffmpeg.Packet);
+      packets++;
+    });
+    for (let pts = 0; pts < 25; pts++) {
+      const blob = new Magick.Blob;
+      genFrame(state).write(blob);
+      const frame = ffmpeg.VideoFrame.create(Buffer.from(blob.data()), format, width, height);
+      frame.setTimeBase(timeBase);
+      frame.setPts(new ffmpeg.Timestamp(pts, timeBase));
+      if (!videoOutput.write(frame))
+        await once(videoOutput, 'drain');
+    }
+    videoOutput.end();
+    await once(videoOutput, 'end');
+    assert.isAtLeast(packets, 25);
+  }
+  return contexts;
+}
+
+it('reuse pooled encoders', async () => {
+  const pool = new EncoderPool;
+  await encodePooledClips(ffmpeg.AV_CODEC_H264, pool);
+  assert.isAtLeast(pool.hits, 3);
+  assert.strictEqual(pool.misses, 0);
+});
+
+it('reopen the pooled encoders that cannot be flushed', async () => {
+  // The H.264 encoder is x264 which does not support AV_CODEC_CAP_ENCODER_FLUSH
+  const pool = new EncoderPool;
+  const contexts = await encodePooledClips(ffmpeg.AV_CODEC_H264, pool);
+  assert.strictEqual(ffmpeg.findEncodingCodec(ffmpeg.AV_CODEC_H264).name(), 'libx264');
+  assert.isAtLeast(pool.hits, 3);
+  assert.strictEqual(pool.misses, 0);
+  assert.isAtLeast(pool.reopened, 2);
+  // Every clip got a fresh context
+  assert.strictEqual(new Set(contexts).size, contexts.length);
+  await pool.settled();
+  pool.clear();
+});
+
+it('encode in batches', async () => {
+  const format = new ffmpeg.PixelFormat('yuv420p');
+  const timeBase = new ffmpeg.Rational(1, 25);
+  const encoder = new ffmpeg.VideoEncoderContext(ffmpeg.findEncodingCodec(ffmpeg.AV_CODEC_H264));
+  encoder.setWidth(width);
+  encoder.setHeight(height);
+  encoder.setTimeBase(timeBase);
+  encoder.setBitRate(2.5e6);
+  encoder.setPixelFormat(format);
+  await encoder.openCodecOptionsAsync({}, encoder.codec());
+
+  const state = { height: 720 / 2, speed: 0 };
+  const frames: ffmpeg.VideoFrame[] = [];
+  for (let pts = 0; pts < 25; pts++) {
+    const blob = new Magick.Blob;
+    genFrame(state).write(blob);
+    const frame = ffmpeg.VideoFrame.create(Buffer.from(blob.data()), format, width, height);
+    frame.setTimeBase(timeBase);
+    frame.setPts(new ffmpeg.Timestamp(pts, timeBase));
+    frames.push(frame);
+  }
+
+  const packets = [
+    ...await encoder.encodeBatchAsync(frames.slice(0, 10)),
+    ...await encoder.encodeBatchAsync(frames.slice(10)),
+    ...await encoder.finalizeBatchAsync()
+  ];
+  assert.lengthOf(packets, 25);
+  for (const packet of packets) {
+    assert.instanceOf(packet, ffmpeg.Packet);
+    assert.isTrue(packet.isComplete());
+  }
+  // Strictly increasing dts
+  for (let i = 1; i < packets.length; i++)
+    assert.isAbove(packets[i].info().dts!, packets[i - 1].info().dts!);
+});
+
+it('encode the corked frames in a batch', async () => {
+  const format = new ffmpeg.PixelFormat('yuv420p');
+  const timeBase = new ffmpeg.Rational(1, 25);
+  const frames = 30;
+  // One packet per frame
+  const videoOutput = new VideoEncoder({
+    type: 'Video',
+    codec: ffmpeg.AV_CODEC_H264,
+    bitRate: 2.5e6,
+    width,
+    height,
+    frameRate: new ffmpeg.Rational(25, 1),
+    timeBase,
+    pixelFormat: format
+  }, { lowLatency: true });
+  await once(videoOutput, 'ready');
+
+  const state = { height: 720 / 2, speed: 0 };
+  videoOutput.cork();
+  for (let pts = 0; pts < frames; pts++) {
+    const blob = new Magick.Blob;
+    genFrame(state).write(blob);
+    const frame = ffmpeg.VideoFrame.create(Buffer.from(blob.data()), format, width, height);
+    frame.setTimeBase(timeBase);
+    frame.setPts(new ffmpeg.Timestamp(pts, timeBase));
+    videoOutput.write(frame);
+  }
+  videoOutput.uncork();
+
+  // A single batch fills the readable side beyond its high-water mark
+  while (videoOutput.readableLength < frames)
+    await new Promise((resolve) => setImmediate(resolve));
+  assert.strictEqual(videoOutput.stats.calls, 1);
+  assert.isAbove(videoOutput.readableLength, videoOutput.readableHighWaterMark);
+  // The write callback is held until the consumer reads
+  assert.strictEqual(videoOutput.writableLength, frames);
+
+  videoOutput.end();
+  let packets = 0;
+  for await (const packet of videoOutput) {
+    assert.instanceOf(packet, ffmpeg.Packet);
+    packets++;
+  }
+  assert.strictEqual(packets, frames);
+  assert.strictEqual(videoOutput.writableLength, 0);
+});
@@ -13,6 +13,7 @@ import {
   MediaTransform, VideoStreamDefinition
 } from '@mmomtchev/ffmpeg/stream';
 import { Readable, Writable } from 'node:stream';
+import { once } from 'node:events';
 import { Magick, MagickCore } from 'magickwand.js/native';
 
 const tempFile = path.resolve(__dirname, 'filter-temp.mkv');
@@ -20,7 +21,7 @@ const tempFile = path.resolve(__dirname, 'filter-temp.mkv');
 describe('filtering', () => {
   afterEach('delete temporary', (done) => {
     if (!process.env.DEBUG_ALL && !process.env.DEBUG_MUXER)
-      fs.rm(tempFile, done);
+      fs.rm(tempFile, { force: true }, done);
     else
       done();
   });
@@ -292,6 +293,149 @@ describe('filtering', () => {
     });
   });
 
+  for (const useExecutor of [false, true]) {
+    it(`w/ zero-copy sources and batched sinks${useExecutor ? ' on a MediaExecutor' : ''}`, (done) => {
+      // This hands over the decoded frames to the filter graph without copying
+      // and drains the sink in batches
+      const demuxer = new Demuxer({ inputFile: path.resolve(__dirname, 'data', 'launch.mp4') });
+
+      demuxer.on('error', done);
+      demuxer.on('ready', () => {
+        try {
+          const audioInput = new Discarder;
+          const videoInput = new VideoDecoder(demuxer.video[0]);
+          const executor = useExecutor ? new ffmpeg.MediaExecutor({ threads: 1 }) : undefined;
+
+          const videoDefinition = videoInput.definition();
+          const width = videoDefinition.width / 2;
+          const height = videoDefinition.height / 2;
+
+          const filter = new Filter({
+            inputs: { 'in': videoDefinition },
+            outputs: { 'out': { ...videoDefinition, width, height } as VideoStreamDefinition },
+            graph: `[in] scale=${width}x${height} [out];  `,
+            timeBase: videoDefinition.timeBase!,
+            zeroCopy: true,
+            executor
+          });
+
+          let frames = 0;
+          filter.sink['out'].on('data', (frame) => {
+            try {
+              assert.instanceOf(frame, ffmpeg.VideoFrame);
+              assert.strictEqual(frame.width(), width);
+              assert.strictEqual(frame.height(), height);
+              frames++;
+            } catch (err) {
+              done(err);
+            }
+          });
+          filter.sink['out'].on('end', () => {
+            try {
+              assert.isAtLeast(frames, 100);
+              void executor?.close();
+              done();
+            } catch (err) {
+              done(err);
+            }
+          });
+          filter.on('error', done);
+
+          demuxer.video[0].pipe(videoInput).pipe(filter.src['in']);
+          demuxer.audio[0].pipe(audioInput);
+        } catch (err) {
+          done(err);
+        }
+      });
+    });
+  }
+
+  it('w/ runtime reconfiguration', (done) => {
+    // This simulates a live input that switches its resolution mid-stream
+    // and changes the parameters of a running filter without rebuilding the graph
+    const demuxer = new Demuxer({ inputFile: path.resolve(__dirname, 'data', 'launch.mp4') });
+
+    demuxer.on('error', done);
+    demuxer.on('ready', () => {
+      try {
+        const audioInput = new Discarder;
+        const videoInput = new VideoDecoder(demuxer.video[0]);
+
+        const videoDefinition = videoInput.definition();
+        const width = videoDefinition.width / 4;
+        const height = videoDefinition.height / 4;
+
+        // 'raw' receives the frames unscaled, their size tells
+        // under which parameters they went through the graph
+        const filter = new Filter({
+          inputs: { 'in': videoDefinition },
+          outputs: {
+            'out': { ...videoDefinition, width, height } as VideoStreamDefinition,
+            'raw': videoDefinition
+          },
+          graph: `[in] split [a][b]; [a] scale=${width}x${height}, hue=s=1 [out]; [b] null [raw];  `,
+          timeBase: videoDefinition.timeBase!
+        });
+
+        // After 50 frames, the input switches to half resolution
+        const rescaler = new ffmpeg.VideoRescaler(
+          videoDefinition.width / 2, videoDefinition.height / 2, videoDefinition.pixelFormat,
+          videoDefinition.width, videoDefinition.height, videoDefinition.pixelFormat,
+          ffmpeg.SWS_BILINEAR);
+        let inputFrames = 0;
+        const resolutionSwitch = new MediaTransform({
+          transform(frame, encoding, callback) {
+            if (inputFrames++ < 50) return void callback(null, frame);
+            (async () => {
+              if (inputFrames === 51) {
+                await filter.reconfigure('in', {
+                  ...videoDefinition,
+                  width: videoDefinition.width / 2,
+                  height: videoDefinition.height / 2
+                } as VideoStreamDefinition);
+                // Turn the video to black and white
+                assert.strictEqual(await filter.sendCommand('hue', 's', '0'), '');
+              }
+              callback(null, await rescaler.rescaleAsync(frame));
+            })().catch(callback);
+          }
+        });
+
+        let frames = 0;
+        filter.sink['out'].on('data', (frame) => {
+          try {
+            assert.strictEqual(frame.width(), width);
+            assert.strictEqual(frame.height(), height);
+            frames++;
+          } catch (err) {
+            done(err);
+          }
+        });
+        const rawSizes: number[] = [];
+        filter.sink['raw'].on('data', (frame) => {
+          rawSizes.push(frame.width());
+        });
+        Promise.all([once(filter.sink['out'], 'end'), once(filter.sink['raw'], 'end')])
+          .then(() => {
+            assert.isAtLeast(frames, 100);
+            assert.strictEqual(frames, inputFrames);
+            assert.strictEqual(rawSizes.length, inputFrames);
+            // Every frame written before the switch came out at the old size
+            assert.deepEqual(rawSizes.slice(0, 50), Array(50).fill(videoDefinition.width));
+            assert.deepEqual(rawSizes.slice(50), Array(inputFrames - 50).fill(videoDefinition.width / 2));
+            done();
+          })
+          .catch(done);
+        filter.on('error', done);
+
+        demuxer.video[0].pipe(videoInput).pipe(resolutionSwitch).pipe(filter.src['in']);
+        demuxer.audio[0].pipe(audioInput);
+      } catch (err) {
+        done(err);
+      }
+    });
+  });
+
   describe('error handling', () => {
     it('error when constructing the filter', (done) => {
       const demuxer = new Demuxer({ inputFile: path.resolve(__dirname, 'data', 'launch.mp4') });
@@ -451,4 +595,35 @@ describe('filtering', () => {
       });
     });
   });
+
+  it('w/ async iterator', async () => {
+    const demuxer = new Demuxer({ inputFile: path.resolve(__dirname, 'data', 'launch.mp4') });
+    await once(demuxer, 'ready');
+
+    const audioInput = new Discarder;
+    const videoInput = new VideoDecoder(demuxer.video[0]);
+    const videoDefinition = videoInput.definition();
+
+    const filter = new Filter({
+      inputs: {
+        'in': videoDefinition
+      },
+      outputs: {
+        'out': { ...videoDefinition, width: videoDefinition.width / 2, height: videoDefinition.height / 2 }
+      },
+      graph: `[in] scale=${videoDefinition.width / 2}:${videoDefinition.height / 2} [out];  `,
+      timeBase: videoDefinition.timeBase!
+    });
+
+    demuxer.video[0].pipe(videoInput).pipe(filter.src['in']);
+    demuxer.audio[0].pipe(audioInput);
+
+    let frames = 0;
+    for await (const frame of filter.frames('out')) {
+      assert.instanceOf(frame, ffmpeg.VideoFrame);
+      assert.strictEqual((frame as ffmpeg.VideoFrame).width(), videoDefinition.width / 2);
+      frames++;
+    }
+    assert.isAtLeast(frames, 100);
+  });
 });
@@ -3,7 +3,7 @@ import * as path from 'node:path';
 import { assert } from 'chai';
 
 import ffmpeg from '@mmomtchev/ffmpeg';
-import { Muxer, Demuxer, VideoDecoder, VideoEncoder, AudioDecoder, AudioEncoder } from '@mmomtchev/ffmpeg/stream';
+import { Muxer, Demuxer, VideoDecoder, VideoEncoder, AudioDecoder, AudioEncoder, Discarder, LatencyTracer } from '@mmomtchev/ffmpeg/stream';
 
 // These test-examples uses ffmpeg's built-in network capabilities - which include the RTMP protocol
 describe('using ffmpeg built-in networking', () => {
@@ -110,4 +110,85 @@ describe('using ffmpeg built-in networking', () => {
       }
     });
   });
+
+  it('low-latency RTMP streaming with latency tracing', (done) => {
+    const serverTracer = new LatencyTracer;
+    const clientTracer = new LatencyTracer({ lastStage: 'decoder' });
+    const demuxer = new Demuxer({ inputFile: path.resolve(__dirname, 'data', 'launch.mp4'), tracer: serverTracer });
+
+    demuxer.on('error', done);
+    demuxer.on('ready', () => {
+      try {
+        // Setup a video-only server
+        const videoInput = new VideoDecoder({ stream: demuxer.video[0].stream, lowLatency: true, tracer: serverTracer });
+        const videoDefinition = videoInput.definition();
+
+        const videoOutput = new VideoEncoder({
+          type: 'Video',
+          codec: ffmpeg.AV_CODEC_H264,
+          bitRate: 2.5e6,
+          width: videoDefinition.width,
+          height: videoDefinition.height,
+          frameRate: new ffmpeg.Rational(25, 1),
+          pixelFormat: videoDefinition.pixelFormat
+        }, { lowLatency: true, tracer: serverTracer });
+
+        const muxer = new Muxer({
+          outputFile: 'rtmp://localhost:9098/video',
+          outputFormat: 'flv',
+          openOptions: { listen: '1' },
+          streams: [videoOutput],
+          lowLatency: true,
+          tracer: serverTracer
+        });
+
+        muxer.on('error', done);
+
+        demuxer.video[0].pipe(videoInput).pipe(videoOutput).pipe(muxer.video[0]);
+        demuxer.audio[0].pipe(new Discarder);
+
+        setTimeout(() => {
+          const client = new Demuxer({ inputFile: 'rtmp://localhost:9098/video', lowLatency: true, tracer: clientTracer });
+          client.on('error', done);
+          client.on('ready', () => {
+            try {
+              const videoStream = new VideoDecoder({ stream: client.video[0].stream, lowLatency: true, tracer: clientTracer });
+
+              let videoFrames = 0;
+              videoStream.on('data', (frame) => {
+                assert.instanceOf(frame, ffmpeg.VideoFrame);
+                videoFrames++;
+              });
+
+              // See above for the closing of the connection
+              client.video[0].on('error', () => undefined);
+              client.removeAllListeners('error');
+              client.on('error', () => {
+                try {
+                  const server = serverTracer.report();
+                  for (const stage of ['demuxer', 'decoder', 'encoder', 'muxer']) {
+                    assert.isAbove(server[stage].count, 0);
+                    assert.isAtLeast(server[stage].max, server[stage].mean);
+                  }
+                  assert.isAbove(clientTracer.report().decoder.count, 0);
+                  if (videoFrames < 100)
+                    console.warn('::notice title=RTMP connection reset::Very few frames received before TCP RESET, ' +
+                      `videoFrames=${videoFrames}`);
+                  done();
+                } catch (err) {
+                  done(err);
+                }
+              });
+
+              client.video[0].pipe(videoStream);
+            } catch (err) {
+              done(err);
+            }
+          });
+        }, 5000);
+      } catch (err) {
+        done(err);
+      }
+    });
+  });
 });
@@ -1,10 +1,11 @@
 import * as path from 'node:path';
 import * as fs from 'node:fs';
+import { once } from 'node:events';
 
 import { assert } from 'chai';
 
 import ffmpeg from '@mmomtchev/ffmpeg';
-import { Muxer, Demuxer, VideoDecoder, VideoEncoder, AudioDecoder, AudioEncoder, Discarder } from '@mmomtchev/ffmpeg/stream';
+import { Muxer, Demuxer, VideoDecoder, VideoEncoder, AudioDecoder, AudioEncoder, Discarder, SegmentedTranscoder, SegmentCache } from '@mmomtchev/ffmpeg/stream';
 
 const tempFile = path.resolve(__dirname, 'temp.mp4');
 
@@ -162,4 +163,139 @@ describe('transcode', () => {
       }
     });
   });
+
+  it('segmented parallel encoding', (done) => {
+    const inputFile = path.resolve(__dirname, 'data', 'launch.mp4');
+    const input = new Demuxer({ inputFile });
+
+    input.on('ready', () => {
+      try {
+        const videoInput = new VideoDecoder(input.video[0]);
+        const videoDefinition = videoInput.definition();
+        input.video[0].destroy();
+        input.audio[0].destroy();
+
+        // Every input frame is a video packet and the output has only the video stream
+        const countPackets = (file: string) => {
+          const formatContext = new ffmpeg.FormatContext;
+          formatContext.openInput(file);
+          formatContext.findStreamInfo();
+          let packets = 0;
+          for (let packet = formatContext.readPacket(); !packet.isNull(); packet = formatContext.readPacket())
+            if (formatContext.stream(packet.streamIndex()).isVideo())
+              packets++;
+          formatContext.close();
+          return packets;
+        };
+        const inputFrames = countPackets(inputFile);
+
+        const executor = new ffmpeg.MediaExecutor({ threads: 3 });
+        const videoOutput = new SegmentedTranscoder({
+          inputFile,
+          segments: 3,
+          executor,
+          output: {
+            type: 'Video',
+            codec: ffmpeg.AV_CODEC_H264,
+            bitRate: 2.5e6,
+            width: videoDefinition.width,
+            height: videoDefinition.height,
+            frameRate: new ffmpeg.Rational(25, 1),
+            pixelFormat: videoDefinition.pixelFormat,
+            codecOptions: { threads: '1' }
+          }
+        });
+
+        const output = new Muxer({ outputFile: tempFile, streams: [videoOutput] });
+
+        output.on('finish', () => {
+          try {
+            void executor.close();
+            // No frame is lost or duplicated at the segment boundaries
+            assert.strictEqual(videoOutput.stats.frames, inputFrames);
+            assert.strictEqual(countPackets(tempFile), inputFrames);
+            done();
+          } catch (err) {
+            done(err);
+          }
+        });
+        videoOutput.on('error', done);
+        output.on('error', done);
+
+        videoOutput.pipe(output.video[0]);
+      } catch (err) {
+        done(err);
+      }
+    });
+  });
+
+  it('just-in-time segment cache', async () => {
+    const inputFile = path.resolve(__dirname, 'data', 'launch.mp4');
+    const input = new Demuxer({ inputFile });
+    await once(input, 'ready');
+    const videoDefinition = new VideoDecoder(input.video[0]).definition();
+    input.video[0].destroy();
+    input.audio[0].destroy();
+
+    const rendition = (width: number, height: number) => ({
+      type: 'Video' as const,
+      codec: ffmpeg.AV_CODEC_H264,
+      bitRate: 1e6,
+      width,
+      height,
+      frameRate: new ffmpeg.Rational(25, 1),
+      pixelFormat: videoDefinition.pixelFormat
+    });
+    const cache = new SegmentCache({
+      inputFile,
+      segmentDuration: 2,
+      renditions: {
+        full: rendition(videoDefinition.width, videoDefinition.height),
+        half: rendition(Math.round(videoDefinition.width / 4) * 2, Math.round(videoDefinition.height / 4) * 2)
+      }
+    });
+    const count = await cache.segmentCount();
+    assert.isAtLeast(count, 3);
+
+    // Adjacent segments continue decoding without seeking
+    const s0 = await cache.segment('half', 0);
+    const s1 = await cache.segment('half', 1);
+    assert.strictEqual(cache.seeks, 0);
+    assert.strictEqual(cache.misses, 2);
+    for (const segment of [s0, s1]) {
+      // MPEG-TS packets
+      assert.strictEqual(segment[0], 0x47);
+      assert.strictEqual(segment.length % 188, 0);
+    }
+
+    // Cache hit
+    assert.strictEqual(await cache.segment('half', 0), s0);
+    assert.strictEqual(cache.hits, 1);
+
+    // Seeking
+    const last = await cache.segment('half', count - 1);
+    assert.isAbove(last.length, 0);
+    assert.strictEqual(cache.seeks, 1);
+
+    // Out of range
+    let error: Error | undefined;
+    await cache.segment('half', count).catch((e) => { error = e; });
+    assert.match(error?.message ?? '', /Invalid segment index/);
+
+    // Concurrent requests share the transcoding
+    const [a, b] = await Promise.all([cache.segment('full', 1), cache.segment('full', 1)]);
+    assert.strictEqual(a, b);
+    assert.strictEqual(cache.misses, 4);
+
+    // Every segment starts with a keyframe
+    fs.writeFileSync(tempFile, s1);
+    const formatContext = new ffmpeg.FormatContext;
+    formatContext.openInput(tempFile);
+    formatContext.findStreamInfo();
+    const first = formatContext.readPacket();
+    assert.isTrue(first.info().isKeyPacket);
+    formatContext.close();
+
+    await cache.clear();
+  });
 });
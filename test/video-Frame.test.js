@@ -1,3 +1,5 @@
+const path = require('node:path');
+const { Worker } = require('node:worker_threads');
 const { assert } = require('chai');
 
 const ffmpeg = require('..');
@@ -18,5 +20,158 @@ describe('video', () => {
       assert.strictEqual(frame.width(), 160);
       assert.strictEqual(frame.height(), 120);
     });
+
+    it('should export all of its properties in a single call', () => {
+      const format = new PixelFormat('yuv420p');
+      const buffer = Buffer.alloc(160 * 120 * format.bitsPerPixel() / 8);
+
+      const frame = VideoFrame.create(buffer, format, 160, 120);
+      frame.setTimeBase(new ffmpeg.Rational(1, 25));
+      frame.setPts(new ffmpeg.Timestamp(50, new ffmpeg.Rational(1, 25)));
+      const info = frame.info();
+      assert.isFalse(info.isNull);
+      assert.isTrue(info.isValid);
+      assert.strictEqual(info.width, 160);
+      assert.strictEqual(info.height, 120);
+      assert.strictEqual(info.pixelFormat, ffmpeg.AV_PIX_FMT_YUV420P);
+      assert.strictEqual(info.size, frame.size());
+      assert.strictEqual(info.pts, 50);
+      assert.deepEqual(info.timeBase, [1, 25]);
+      assert.strictEqual(info.seconds, 2);
+    });
+
+    it('should be encodable to an image in a single call', async () => {
+      const format = new PixelFormat('yuv420p');
+      const buffer = Buffer.alloc(160 * 120 * format.bitsPerPixel() / 8);
+      const frame = VideoFrame.create(buffer, format, 160, 120);
+
+      const jpeg = await frame.encodeImageAsync('jpeg', { width: 80, quality: 75 });
+      assert.instanceOf(jpeg, Buffer);
+      assert.deepEqual([...jpeg.subarray(0, 2)], [0xff, 0xd8]);
+
+      const png = frame.encodeImage('png', 0, 0, 0);
+      assert.instanceOf(png, Buffer);
+      assert.strictEqual(png.subarray(1, 4).toString(), 'PNG');
+
+      assert.throws(() => frame.encodeImage('no-such-format', 0, 0, 0), /No image encoder/);
+    });
+
+    it('should support native analysis', async () => {
+      const format = new PixelFormat('yuv420p');
+      const size = 160 * 120;
+      const buffer = Buffer.alloc(size * format.bitsPerPixel() / 8, 128);
+      buffer.fill(16, 0, size);
+      const frame = VideoFrame.create(buffer, format, 160, 120);
+      const changed = Buffer.from(buffer);
+      changed.fill(32, 0, size / 2);
+      const other = VideoFrame.create(changed, format, 160, 120);
+
+      const histogram = await frame.histogramAsync(0);
+      assert.instanceOf(histogram, Uint32Array);
+      assert.lengthOf(histogram, 256);
+      assert.strictEqual(histogram[16], size);
+      assert.strictEqual(frame.histogram(1)[128], size / 4);
+
+      const stats = frame.planeStats();
+      assert.instanceOf(stats, Float64Array);
+      assert.deepEqual([...stats], [16, 0, 128, 0, 128, 0]);
+
+      const psnr = await frame.psnrAsync(frame);
+      assert.strictEqual(psnr[3], Infinity);
+      assert.isBelow(frame.psnr(other)[0], 30);
+      assert.strictEqual(frame.psnr(other)[1], Infinity);
+
+      const ssim = await frame.ssimAsync(frame);
+      assert.closeTo(ssim[3], 1, 1e-9);
+      assert.isBelow(frame.ssim(other)[0], 1);
+
+      assert.strictEqual(await frame.differenceAsync(frame), 0);
+      assert.closeTo(frame.difference(other), 16 / 255 / 2, 1e-9);
+    });
+
+    it('should reject the semi-planar formats in the native analysis', () => {
+      const format = new PixelFormat('nv12');
+      const buffer = Buffer.alloc(160 * 120 * format.bitsPerPixel() / 8, 128);
+      const frame = VideoFrame.create(buffer, format, 160, 120);
+      assert.throws(() => frame.histogram(1), /planar/);
+      assert.throws(() => frame.planeStats(), /planar/);
+      assert.throws(() => frame.psnr(frame), /planar/);
+      assert.throws(() => frame.difference(frame), /planar/);
+    });
+
+    it('should be transferable without copying', () => {
+      const format = new PixelFormat('yuv420p');
+      const buffer = Buffer.alloc(160 * 120 * format.bitsPerPixel() / 8);
+
+      const frame = VideoFrame.create(buffer, format, 160, 120);
+      frame.setTimeBase(new ffmpeg.Rational(1, 25));
+      frame.setStreamIndex(1);
+      const refs = frame.refCount();
+      const id = frame.transfer();
+      assert.isNumber(id);
+      assert.strictEqual(frame.refCount(), refs + 1);
+
+      const adopted = VideoFrame.adopt(id);
+      assert.instanceOf(adopted, VideoFrame);
+      assert.strictEqual(frame.refCount(), refs + 1);
+      assert.strictEqual(adopted.width(), 160);
+      assert.strictEqual(adopted.height(), 120);
+      assert.strictEqual(adopted.streamIndex(), 1);
+      assert.strictEqual(adopted.timeBase().toString(), '1/25');
+      assert.throws(() => VideoFrame.adopt(id), /does not exist/);
+
+      assert.isTrue(ffmpeg.releaseTransfer(frame.transfer()));
+      assert.isFalse(ffmpeg.releaseTransfer(id));
+    });
+
+    it('should be transferable to a worker thread', (done) => {
+      const format = new PixelFormat('yuv420p');
+      const buffer = Buffer.alloc(160 * 120 * format.bitsPerPixel() / 8);
+
+      const frame = VideoFrame.create(buffer, format, 160, 120);
+      const worker = new Worker(`
+        const { parentPort, workerData } = require('node:worker_threads');
+        const ffmpeg = require(workerData.module);
+        const frame = ffmpeg.VideoFrame.adopt(workerData.id);
+        parentPort.postMessage([frame.width(), frame.height()]);
+      `, { eval: true, workerData: { module: path.resolve(__dirname, '..'), id: frame.transfer() } });
+      worker.on('message', (msg) => {
+        try {
+          assert.deepEqual(msg, [160, 120]);
+          done();
+        } catch (e) {
+          done(e);
+        }
+      });
+      worker.on('error', done);
+    });
+  });
+
+  describe('VideoFramePool', () => {
+    it('should rescale into pooled frames', async () => {
+      const format = new PixelFormat('yuv420p');
+      const buffer = Buffer.alloc(160 * 120 * format.bitsPerPixel() / 8, 128);
+      const src = VideoFrame.create(buffer, format, 160, 120);
+      src.setTimeBase(new ffmpeg.Rational(1, 25));
+      src.setPts(new ffmpeg.Timestamp(10, new ffmpeg.Rational(1, 25)));
+
+      const rescaler = new ffmpeg.VideoRescaler(80, 60, format, 160, 120, format, ffmpeg.SWS_BILINEAR);
+      const pool = new ffmpeg.VideoFramePool(80, 60, format);
+      assert.strictEqual(pool.width(), 80);
+      assert.strictEqual(pool.height(), 60);
+
+      const dst = pool.get();
+      assert.instanceOf(dst, VideoFrame);
+      await rescaler.rescaleIntoAsync(dst, src);
+      const info = dst.info();
+      assert.strictEqual(info.width, 80);
+      assert.strictEqual(info.height, 60);
+      assert.strictEqual(info.pts, 10);
+      assert.closeTo(dst.planeStats()[0], 128, 1);
+
+      rescaler.rescaleInto(pool.get(), src);
+      const wrong = new ffmpeg.VideoFramePool(40, 30, format);
+      assert.throws(() => rescaler.rescaleInto(wrong.get(), src), /does not match/);
+    });
   });
 });